@@ -27,6 +27,13 @@
 
 #define N_BLOCKS 100 // NOTE: This needs to be modified to calculate the average number of blocks 
 
+// Delayed allocation: a file written from its start keeps its data in memory and gets 
+// its blocks when it is flushed (close, seek, read, or the budget is reached), so the 
+// final size is known and one allocation covers the whole file. 0 disables it.
+#ifndef B_DELALLOC_BUDGET
+#define B_DELALLOC_BUDGET (8 * 1024 * 1024) // bytes held back by all open files
+#endif
+
 typedef struct b_fcb
 	{
 	/** TODO add al the information you need in the file control block **/
@@ -40,16 +47,23 @@ typedef struct b_fcb
 	
 	int flags;		
 
-	int parentIdx; // parent DE's index
+	int goalLBA; // where the first blocks of an empty file are wanted (its directory)
 
     char* buf;		//holds the open file buffer
+	int bufDirty;	// buf holds written bytes that are not on disk yet
+
+    inode_st* fi; // holds infor of the file (its inode, held until b_close)
 
-    directory_entry* fi; // holds infor of DE (file) 
+	int delayed;	// 1 while written data goes to delayBuf, no blocks allocated yet
+	char* delayBuf;	// data written so far when delayed (index bytes)
+	int delayCap;	// size of delayBuf, a multiple of B_CHUNK_SIZE
 
 	} b_fcb;
 	
 b_fcb fcbArray[MAXFCBS];
 
+int delayedTotal = 0;	// bytes held in the delayBuf of all open files
+
 int startup = 0;	//Indicates that this has not been initialized
 
 //Method to initialize our file system
@@ -106,34 +120,47 @@ b_io_fd b_open (char * filename, int flags)
 	if (parser.lastElement == NULL || strcmp(parser.lastElement, "..") == 0 ||\
 				 strcmp(parser.lastElement, ".") == 0 ) {
 		printf("Error - please provide a valid file name\n");
+		releaseDir(parser.retParent);
 		return -1;
 	}
 	
-	if (parser.retParent[parser.index].is_directory) return -1;
+	if (parser.index != -1 && parser.retParent[parser.index].is_directory) {
+		releaseDir(parser.retParent);
+		return -1;
+	}
 		
 	if (parser.index == -1 && ((flags & O_CREAT) == O_CREAT)) {
 		// If the file does not exist and the flags include O_CREAT, create a new file
 		parser.index = makeDirOrFile(parser, 0, NULL);
-		// If the new file cannot be created, return an error
-		if (parser.index == -1) return -1;
+		if (parser.index != -1 && writeDirEntry(parser.retParent, parser.index) == -1) {
+			parser.index = -1;
+		}
 	}
 
-	if (parser.index == -1) return -1;
+	// The file does not exist or can not be created
+	if (parser.index == -1) {
+		releaseDir(parser.retParent);
+		return -1;
+	}
 		
-	// Store the parent directory entry (DE) index in the fcb struct
-	fcbArray[returnFd].parentIdx = parser.index;
-
-	// Store the valid DE as file info
-	fcbArray[returnFd].fi = &parser.retParent[parser.index];
+	// The file is reached through its inode, held until b_close; the parent
+	// directory is only needed to place the first blocks of the file
+	fcbArray[returnFd].fi = inodeGet(parser.retParent[parser.index].inode);
+	fcbArray[returnFd].goalLBA = dirInode(parser.retParent)->extents[0].startLoc;
+	releaseDir(parser.retParent);
 	if (fcbArray[returnFd].fi == NULL) return -1;
 
 	// If O_TRUNC is set and the file contains blocks, delete all the blocks associated with the file
 	if ( (flags & O_TRUNC) ) {
-		int status = removeDE(parser.retParent, parser.index, 1);
+		int status = inodeTruncate(fcbArray[returnFd].fi);
 		
 		// Update the modification time for the file info
 		fcbArray[returnFd].fi->modification_time = curTime;
-		if (status == -1) return -1;
+		if (status == -1) {
+			inodePut(fcbArray[returnFd].fi);
+			fcbArray[returnFd].fi = NULL;
+			return -1;
+		}
 	}
 
 	// Update the access time for the file info
@@ -149,11 +176,28 @@ b_io_fd b_open (char * filename, int flags)
 
 	fcbArray[returnFd].nBlocks = N_BLOCKS;
 
+	// Blocks the file already owns on disk
+	fcbArray[returnFd].totalBlocks = 0;
+	for (int i = 0; i < fcbArray[returnFd].fi->ext_length; i++) {
+		fcbArray[returnFd].totalBlocks += fcbArray[returnFd].fi->extents[i].countBlock;
+	}
+
 	// Allocate and initialize memory based on the number of blocks
 	fcbArray[returnFd].buf = (char*) calloc(sizeof(char), B_CHUNK_SIZE);
-	if (fcbArray[returnFd].buf == NULL) return -1;
+	if (fcbArray[returnFd].buf == NULL) {
+		inodePut(fcbArray[returnFd].fi);
+		fcbArray[returnFd].fi = NULL;
+		return -1;
+	}
 
 	fcbArray[returnFd].curLBAPos = 0;
+	fcbArray[returnFd].bufDirty = 0;
+
+	// An empty file opened for writing starts with no blocks: its data waits in memory
+	fcbArray[returnFd].delayed = (B_DELALLOC_BUDGET > 0 && (flags & O_WRONLY) == O_WRONLY &&
+				fcbArray[returnFd].fi->ext_length == 0 && fcbArray[returnFd].index == 0);
+	fcbArray[returnFd].delayBuf = NULL;
+	fcbArray[returnFd].delayCap = 0;
 
 	return returnFd;  // all set
 
@@ -168,6 +212,9 @@ int b_seek(b_io_fd fd, off_t offset, int whence)
 	{
         return (-1); 	// Invalid file descriptor
     }
+
+	// Positions are only known on disk once the delayed data has blocks
+	if (flushDelayed(fd) == -1) return -1;
     
 	// Calculate new position based on whence
     off_t newPos;
@@ -225,8 +272,14 @@ int b_seek(b_io_fd fd, off_t offset, int whence)
         
 		//Read check loads and reads until EOF
         if ((fcbArray[fd].flags & O_RDONLY) == O_RDONLY && 
+            newPos < fcbArray[fd].fi->file_size && isUnwritten(fd, newBlockPos)) {
+            memset(fcbArray[fd].buf, 0, B_CHUNK_SIZE);
+        } else if ((fcbArray[fd].flags & O_RDONLY) == O_RDONLY && 
             newPos < fcbArray[fd].fi->file_size) {
-            if (LBAread(fcbArray[fd].buf, 1, finder.foundLBA) != 1) {
+            int prevClass = ioSetClass(IO_CLASS_DATA);
+            int readBlocks = cacheRead(fcbArray[fd].buf, 1, finder.foundLBA);
+            ioSetClass(prevClass);
+            if (readBlocks != 1) {
                 return -1;
             }
         }
@@ -254,15 +307,22 @@ int b_write (b_io_fd fd, char * buffer, int count)
 	// File is opened in write-only mode
     if ((fcbArray[fd].flags & O_WRONLY) != O_WRONLY) return -1;
 
+	// Keep the data in memory while the file is delayed and within budget
+	if (fcbArray[fd].delayed) {
+		int status = delayWrite(fd, buffer, count);
+		if (status == 1) ioRecordUser(IO_OP_WRITE, count);
+		if (status != 0) return (status == 1) ? count : -1;
+	}
+
     // Allocate free space on disk and make sure the disk has enough space.
     if (fcbArray[fd].fi->ext_length == 0) {
 		
 		// Allocate the default number of free blocks (100 blocks) with the standard block size
 		if (allocateFSBlocks(fd, 1) == -1) return -1;
-		printf("Start writing data to disk...\n");
 	}
 
 	int wStatus = writeBuffer(count, fd, buffer);
+	if (wStatus == 0) ioRecordUser(IO_OP_WRITE, count);
 	return (wStatus == 0) ? count : -1; // Return the number of bytes written
 	}
 
@@ -309,6 +369,9 @@ int b_read(b_io_fd fd, char* buffer, int count)
         return -1;  // File not open for this descriptor
     }
 
+    // Data still held in memory is put on disk first
+    if (flushDelayed(fd) == -1) return -1;
+
     // Check read permissions
     if ((fcbArray[fd].flags & O_RDONLY) != O_RDONLY)
     {
@@ -338,16 +401,27 @@ int b_read(b_io_fd fd, char* buffer, int count)
         int remainingInExtent = finder.remain * B_CHUNK_SIZE - blockOffset;
         int maxRead = min(remainingInExtent, bytesToRead - totalRead);
 
-        // For block-aligned reads larger than a block
-        if (blockOffset == 0 && maxRead >= B_CHUNK_SIZE) 
+        // For block-aligned reads larger than a block, read every whole block
+        // left in the request at once, even when it spans several extents
+        if (blockOffset == 0 && (bytesToRead - totalRead) >= B_CHUNK_SIZE) 
         {
-            int blocksToRead = maxRead / B_CHUNK_SIZE;
-            int bytesRead = LBAread(buffer + totalRead, blocksToRead, finder.foundLBA);
-            if (bytesRead < 0) 
+            int blocksToRead = (bytesToRead - totalRead) / B_CHUNK_SIZE;
+
+            // Blocks reserved by b_fallocate and never written read as zeros
+            int firstUnwritten = fcbArray[fd].totalBlocks - fcbArray[fd].fi->unwritten_blocks;
+            if (fcbArray[fd].curLBAPos >= firstUnwritten)
             {
-                return totalRead > 0 ? totalRead : -1;
+                memset(buffer + totalRead, 0, blocksToRead * B_CHUNK_SIZE);
             }
-            bytesRead *= B_CHUNK_SIZE;
+            else
+            {
+                blocksToRead = min(blocksToRead, firstUnwritten - fcbArray[fd].curLBAPos);
+                if (transferBlocks(fd, AIO_READ, buffer + totalRead, blocksToRead) == -1) 
+                {
+                    return totalRead > 0 ? totalRead : -1;
+                }
+            }
+            int bytesRead = blocksToRead * B_CHUNK_SIZE;
             totalRead += bytesRead;
             fcbArray[fd].index += bytesRead;
             fcbArray[fd].curLBAPos += blocksToRead;
@@ -358,7 +432,18 @@ int b_read(b_io_fd fd, char* buffer, int count)
             // Read the block into our buffer if needed
             if (fcbArray[fd].curBlockIdx != fcbArray[fd].curLBAPos) 
             {
-                if (LBAread(fcbArray[fd].buf, 1, finder.foundLBA) != 1) 
+                int readBlocks = 1;
+                if (isUnwritten(fd, fcbArray[fd].curLBAPos)) 
+                {
+                    memset(fcbArray[fd].buf, 0, B_CHUNK_SIZE);
+                }
+                else
+                {
+                    int prevClass = ioSetClass(IO_CLASS_DATA);
+                    readBlocks = cacheRead(fcbArray[fd].buf, 1, finder.foundLBA);
+                    ioSetClass(prevClass);
+                }
+                if (readBlocks != 1) 
                 {
                     return totalRead > 0 ? totalRead : -1;
                 }
@@ -379,6 +464,7 @@ int b_read(b_io_fd fd, char* buffer, int count)
             }
         }
     }
+    ioRecordUser(IO_OP_READ, totalRead);
     return totalRead;
 }
 
@@ -397,15 +483,19 @@ int b_read(b_io_fd fd, char* buffer, int count)
 int b_close (b_io_fd fd){
 
 	// Check to see if file discriptor is valid and between 0 and MAXFCBS-1
-	if (fd < 0 || fd >= MAXFCBS){
+	if (fd < 0 || fd >= MAXFCBS || fcbArray[fd].fi == NULL){
 		return -1; 
 	}
 
 	// Checking if the memory is full by using O_WRONLY which is for write
 	if ( (fcbArray[fd].flags & O_WRONLY) == O_WRONLY) {
 
-		// Checks if the pointer is more then size of file
-		if (fcbArray[fd].index > fcbArray[fd].fi->file_size){
+		// The size is final now: the delayed data gets its blocks in one allocation
+		if (flushDelayed(fd) == -1) return -1;
+
+		// Checks if the pointer is more then size of file, or the buffer holds
+		// data inside a size set by b_fallocate
+		if (fcbArray[fd].index > fcbArray[fd].fi->file_size || fcbArray[fd].bufDirty){
 
 			// Commit in order to save it in the drive
 			if(commitBlocks(fd, 1, NULL, 0) == -1){
@@ -419,8 +509,8 @@ int b_close (b_io_fd fd){
 		// returns -1 and in case it fails 
 		if (trimBlocks(fd) == -1) return -1;
 		
-		// Writes a directory to disk at the specified location
-		if(writeDirHelper(fcbArray[fd].fi - fcbArray[fd].parentIdx) == -1){
+		// Writes the inode of the file back to the inode table on disk
+		if(writeInode(fcbArray[fd].fi) == -1){
 			return -1; //error 
 		}
 
@@ -428,10 +518,16 @@ int b_close (b_io_fd fd){
 
 	// This will release the datas from the memory
 		freePtr((void**) &fcbArray[fd].buf, "This is FCB buffer");
+		freePtr((void**) &fcbArray[fd].delayBuf, "Delayed write buffer");
+		delayedTotal -= fcbArray[fd].delayCap;
+		fcbArray[fd].delayCap = 0;
+		fcbArray[fd].delayed = 0;
 		
 	// In case the memory is full we add what is what is below in order to 
-	// chose another empty memory to release it into that.
-	fcbArray[fd].fi == NULL;
+	// chose another empty memory to release it into that. The inode held
+	// since b_open is put back (and released if the file was removed meanwhile)
+	inodePut(fcbArray[fd].fi);
+	fcbArray[fd].fi = NULL;
 
 	// Once the buffer release successfuly for close it returns 0
 	return 0; //successful
@@ -498,6 +594,7 @@ int writeBuffer(int count, b_io_fd fd, char *buffer) {
 
 		// Count is smaller than the remaining data
 		memcpy(fcbArray[fd].buf + bufferPos, buffer + callerBufPos, count);
+		fcbArray[fd].bufDirty = 1;
 		
 		fcbArray[fd].index += count;
 		count = 0;
@@ -506,52 +603,107 @@ int writeBuffer(int count, b_io_fd fd, char *buffer) {
 	return 0;
 }
 
+/** Append data of a delayed file to its in-memory buffer, growing the buffer by 
+ * doubling. When the buffer would exceed B_DELALLOC_BUDGET (shared by all open 
+ * files) the data is flushed instead and the caller writes the bytes to disk.
+ * @return 1 if the bytes were buffered, 0 if the caller must write them, -1 on failure
+ * @author Danish Nguyen
+ */
+int delayWrite(b_io_fd fd, char* buffer, int count) {
+	int needed = fcbArray[fd].index + count;
+
+	if (needed > fcbArray[fd].delayCap) {
+		int newCap = max(fcbArray[fd].delayCap, B_CHUNK_SIZE);
+		while (newCap < needed) newCap *= 2;
+
+		if (delayedTotal - fcbArray[fd].delayCap + newCap > B_DELALLOC_BUDGET) {
+			return (flushDelayed(fd) == -1) ? -1 : 0;
+		}
+
+		char* newBuf = realloc(fcbArray[fd].delayBuf, newCap);
+		if (newBuf == NULL) return (flushDelayed(fd) == -1) ? -1 : 0;
+
+		// Bytes past the data are zero, so the last block is written padded
+		memset(newBuf + fcbArray[fd].delayCap, 0, newCap - fcbArray[fd].delayCap);
+		delayedTotal += newCap - fcbArray[fd].delayCap;
+		fcbArray[fd].delayBuf = newBuf;
+		fcbArray[fd].delayCap = newCap;
+	}
+
+	memcpy(fcbArray[fd].delayBuf + fcbArray[fd].index, buffer, count);
+	fcbArray[fd].index += count;
+	return 1;
+}
+
+/** End delayed allocation for a file: allocate the blocks for everything written 
+ * so far in one request and write them with one transfer. The partial last block
+ * stays in the FCB buffer, as if the data had been written by writeBuffer, so 
+ * later writes continue on the normal path. On failure the file stays delayed
+ * with its data, so a later flush or b_close tries again.
+ * @return 0 on success (or nothing to flush), -1 on failure
+ * @author Danish Nguyen
+ */
+int flushDelayed(b_io_fd fd) {
+	if (!fcbArray[fd].delayed) return 0;
+
+	int bytes = fcbArray[fd].index;
+
+	if (bytes > 0) {
+		// Ask for exactly the blocks holding the data, allocateFSBlocks adds them
+		// (a failed transfer already got them)
+		int needed = computeBlockNeeded(bytes, B_CHUNK_SIZE);
+		fcbArray[fd].nBlocks = needed - fcbArray[fd].totalBlocks;
+
+		// The padded last block goes with the full ones
+		if ((fcbArray[fd].nBlocks > 0 && allocateFSBlocks(fd, 1) == -1) ||
+				transferBlocks(fd, AIO_WRITE, fcbArray[fd].delayBuf, needed) == -1) {
+			printf("Error - flushDelayed: %d bytes of fd %d are not on disk yet\n", bytes, fd);
+			return -1;
+		}
+
+		// Later allocations double from the size of the data
+		int fullBlocks = bytes / B_CHUNK_SIZE;
+		memcpy(fcbArray[fd].buf, fcbArray[fd].delayBuf + fullBlocks * B_CHUNK_SIZE, 
+													bytes % B_CHUNK_SIZE);
+		fcbArray[fd].nBlocks = needed;
+		fcbArray[fd].curLBAPos = fullBlocks;
+		fcbArray[fd].fi->file_size = bytes;
+	}
+
+	fcbArray[fd].delayed = 0;
+	freePtr((void**) &fcbArray[fd].delayBuf, "Delayed write buffer");
+	delayedTotal -= fcbArray[fd].delayCap;
+	fcbArray[fd].delayCap = 0;
+	return 0;
+}
+
 /** Save data from a block or multiple blocks from caller's buffer to disk
  * @return 0 on success; -1 on failure
  * @author Danish Nguyen
  */
 int commitBlocks(b_io_fd fd, int nBlocks, char* buffer, int callerBufPos){
+	// Blocks reserved by b_fallocate become written blocks
+	if (claimUnwritten(fd, fcbArray[fd].curLBAPos, nBlocks) == -1) return -1;
+
 	// Check if the file has enough space before start writting data.
 	// If there's not enough space, try to allocate more free blocks on disk for the file
-	if ( (fcbArray[fd].curLBAPos + nBlocks) > (fcbArray[fd].totalBlocks - 1)) {
+	// (b_fallocate and flushDelayed leave a small request size, it may take a few doublings)
+	while ( (fcbArray[fd].curLBAPos + nBlocks) > fcbArray[fd].totalBlocks) {
 		if ( allocateFSBlocks(fd, 2) == -1 ) return -1;
 	} 
 	
-	// Update file size on commit
-	fcbArray[fd].fi->file_size = fcbArray[fd].index;
+	// Update file size on commit, a size set by b_fallocate is kept
+	fcbArray[fd].fi->file_size = max(fcbArray[fd].fi->file_size, fcbArray[fd].index);
 	
-	// Writing multiple blocks of data into disk. Handled discontiounus
-	if (nBlocks > 1) {
-		/** Iterates through the file's extents (continuous sections of disk blocks)
-		 * - Uses FindLBAOnDisk to locate the starting position based on the current LBA.
-		 * - Determines the smaller of the remaining blocks in the extent or the number of blocks to write.
-		 * - Writes the determined number of blocks to disk and updates the caller's buffer position.
-		 * - Adjusts the file descriptor's current LBA position accordingly
-		 * 	Note: This approach has O(n^2) complexity and is inefficient for large files 
-		 */ 
-
-		while (nBlocks > 0) {
-			LBAFinder finderLBA = findLBAOnDisk(fd, fcbArray[fd].curLBAPos);
-			
-			if (finderLBA.foundLBA == -1) {
-				printf("Error - findLBAOnDisk: [ %d | %d] \n", fd, fcbArray[fd].curLBAPos);
-				return -1;
-			}
-			
-			int numOfBlocks =  min(finderLBA.remain, nBlocks);
-			int writtenBlocks = LBAwrite(buffer + callerBufPos, numOfBlocks, finderLBA.foundLBA);
-			
-			if (writtenBlocks != numOfBlocks) {
-				printf("Error - writtenBlocks \n");
-				return -1;
-			}
-
-			callerBufPos += (B_CHUNK_SIZE * numOfBlocks);
-			nBlocks -= numOfBlocks;
-
-			// Update current pos in file to account for the blocks being written
-			fcbArray[fd].curLBAPos += numOfBlocks;
+	// Writing blocks of data from the caller's buffer into disk. Handled discontiounus
+	if (buffer != NULL) {
+		// All extents covered by the write are submitted together (transferBlocks)
+		if (transferBlocks(fd, AIO_WRITE, buffer + callerBufPos, nBlocks) == -1) {
+			printf("Error - writtenBlocks \n");
+			return -1;
 		}
+		// Update current pos in file to account for the blocks being written
+		fcbArray[fd].curLBAPos += nBlocks;
 		return 0;
 	}
 
@@ -567,78 +719,218 @@ int commitBlocks(b_io_fd fd, int nBlocks, char* buffer, int callerBufPos){
 	fcbArray[fd].curLBAPos += nBlocks;
 
 	// Write buffer to disk
-	int writeBlocks = LBAwrite(fcbArray[fd].buf, 1, idxLBA);
+	int prevClass = ioSetClass(IO_CLASS_DATA);
+	int writeBlocks = cacheWrite(fcbArray[fd].buf, 1, idxLBA);
+	ioSetClass(prevClass);
 
 	if (writeBlocks < 1) {
 		printf("Error - writtenBlocks \n");
 		return -1;}
 
 	memset(fcbArray[fd].buf, 0, B_CHUNK_SIZE);
+	fcbArray[fd].bufDirty = 0;
 	return 0;
 }
 
+/** Reserve the blocks of [offset, offset + len) of a file ahead of writing. 
+ * Missing blocks are allocated in one request, so they come as one extent when 
+ * the free space allows. Every block past the written data is kept as unwritten 
+ * in the inode: they read as zeros without disk access until written. The file size grows to 
+ * offset + len if it is smaller.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int b_fallocate (b_io_fd fd, off_t offset, off_t len)
+	{
+	if (startup == 0) b_init();  //Initialize our system
+
+	if ((fd < 0) || (fd >= MAXFCBS) || fcbArray[fd].fi == NULL || offset < 0 || len <= 0)
+		{
+		return (-1);
+		}
+	if ((fcbArray[fd].flags & O_WRONLY) != O_WRONLY) return -1;
+
+	// Data held back by delayed allocation gets its blocks first
+	if (flushDelayed(fd) == -1) return -1;
+
+	// Blocks the file already had past its data (left by earlier allocations) 
+	// hold stale data: they become unwritten too, with the blocks added here
+	int firstUnwritten = fcbArray[fd].totalBlocks - fcbArray[fd].fi->unwritten_blocks;
+	int dataEnd = max(fcbArray[fd].fi->file_size, fcbArray[fd].index);
+	int writtenEnd = min(firstUnwritten, computeBlockNeeded(dataEnd, B_CHUNK_SIZE));
+
+	int missing = computeBlockNeeded(offset + len, B_CHUNK_SIZE) - fcbArray[fd].totalBlocks;
+	if (missing > 0) {
+		fcbArray[fd].nBlocks = missing;
+		if (allocateFSBlocks(fd, 1) == -1) return -1;
+	}
+
+	if (offset + len > fcbArray[fd].fi->file_size) {
+		fcbArray[fd].fi->unwritten_blocks = fcbArray[fd].totalBlocks - writtenEnd;
+		fcbArray[fd].fi->file_size = offset + len;
+	}
+	return 0;
+	}
+
+/** Blocks [idxLBA, idxLBA + nBlocks) of a file are about to be written: the 
+ * unwritten blocks among them become written. Unwritten blocks skipped before 
+ * idxLBA are zeroed on disk, so they still read as zeros once written.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int claimUnwritten(b_io_fd fd, int idxLBA, int nBlocks) {
+	int firstUnwritten = fcbArray[fd].totalBlocks - fcbArray[fd].fi->unwritten_blocks;
+	int end = min(idxLBA + nBlocks, fcbArray[fd].totalBlocks);
+	if (fcbArray[fd].fi->unwritten_blocks == 0 || end <= firstUnwritten) return 0;
+
+	for (int pos = firstUnwritten; pos < idxLBA; ) {
+		LBAFinder finder = findLBAOnDisk(fd, pos);
+		if (finder.foundLBA == -1) return -1;
+
+		int count = min(finder.remain, idxLBA - pos);
+		char* zeros = calloc(count, B_CHUNK_SIZE);
+		if (zeros == NULL) return -1;
+
+		int prevClass = ioSetClass(IO_CLASS_DATA);
+		int written = cacheWrite(zeros, count, finder.foundLBA);
+		ioSetClass(prevClass);
+		free(zeros);
+
+		if (written < count) return -1;
+		pos += count;
+	}
+
+	fcbArray[fd].fi->unwritten_blocks = fcbArray[fd].totalBlocks - end;
+	return 0;
+}
+
+// @return 1 if block idxLBA of the file is reserved but not written yet, 0 otherwise
+int isUnwritten(b_io_fd fd, int idxLBA) {
+	return idxLBA >= fcbArray[fd].totalBlocks - fcbArray[fd].fi->unwritten_blocks;
+}
+
+/** Reads or writes nBlocks whole blocks of a file starting at its current LBA 
+ * position. The file's extents are looked up first and the transfer is issued 
+ * as vectored calls of up to MAX_EXTENTS segments, so a fragmented file costs 
+ * one call instead of one per extent. curLBAPos is not moved.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int transferBlocks(b_io_fd fd, int op, char* buffer, int nBlocks) {
+	lba_seg_st segs[MAX_EXTENTS];
+	int nSegs = 0;
+	uint64_t segBlocks = 0;
+	int status = 0;
+
+	int posLBA = fcbArray[fd].curLBAPos;
+
+	while (nBlocks > 0) {
+		LBAFinder finderLBA = findLBAOnDisk(fd, posLBA);
+
+		if (finderLBA.foundLBA == -1) {
+			printf("Error - findLBAOnDisk: [ %d | %d] \n", fd, posLBA);
+			status = -1;
+			break;
+		}
+		int numOfBlocks = min(finderLBA.remain, nBlocks);
+		segs[nSegs++] = (lba_seg_st) { buffer, numOfBlocks, finderLBA.foundLBA };
+		segBlocks += numOfBlocks;
+
+		buffer += (B_CHUNK_SIZE * numOfBlocks);
+		nBlocks -= numOfBlocks;
+		posLBA += numOfBlocks;
+
+		// Issue the segments once the vector is full or the transfer is complete
+		if (nSegs == MAX_EXTENTS || nBlocks == 0) {
+			int prevClass = ioSetClass(IO_CLASS_DATA);
+			uint64_t done = (op == AIO_READ) ? cacheReadv(segs, nSegs) 
+											 : cacheWritev(segs, nSegs);
+			ioSetClass(prevClass);
+			if (done < segBlocks) {
+				status = -1;
+				break;
+			}
+			nSegs = 0;
+			segBlocks = 0;
+		}
+	}
+	return status;
+}
+
 /** Allocate more blocks on the disk for a file. Merge the newly allocated blocks with 
- * the last file's existing extents if possible 
+ * the last file's existing extents if possible. The inode holds MAX_EXTENTS extents:
+ * when the free space is too fragmented for that, the blocks are asked again as 
+ * fewer, longer extents, and the allocation fails if they still do not fit.
  * @return 0 on success, -1 if allocation fails
  * @author Danish Nguyen
  */
 int allocateFSBlocks(b_io_fd fd, int n){
+	inode_st* fi = fcbArray[fd].fi;
 
 	// Double the number of blocks to allocate compared to the last request
 	fcbArray[fd].nBlocks *= n;
-
-	// Request allocation of free blocks from the disk
-	extents_st fileExt = allocateBlocks(fcbArray[fd].nBlocks, 0);
+	int nBlocks = fcbArray[fd].nBlocks;
+
+	// Request allocation of free blocks from the disk, right after the file's last 
+	// extent so they can be merged with it, or near its directory for a new file
+	int lastExt = fi->ext_length - 1;
+	int goal = (lastExt >= 0) ? fi->extents[lastExt].startLoc + 
+				fi->extents[lastExt].countBlock : fcbArray[fd].goalLBA;
+	extents_st fileExt = allocateBlocks(nBlocks, 0, goal);
+
+	if (fileExt.extents && countFileExtents(fd, fileExt) > MAX_EXTENTS) {
+		returnExtents(fileExt);
+
+		// Each extent then spans at least the share of one free slot
+		int slots = max(MAX_EXTENTS - fi->ext_length, 1);
+		fileExt = allocateBlocks(nBlocks, computeBlockNeeded(nBlocks, slots), goal);
+
+		if (fileExt.extents && countFileExtents(fd, fileExt) > MAX_EXTENTS) {
+			returnExtents(fileExt);
+			printf("Free space too fragmented for the file\n");
+			return -1;
+		}
+	}
 	if (!fileExt.size || !fileExt.extents) {
 		printf("Not enough space on disk\n");
 		return -1;
 	}
 
 	// Update total block count for the file
-	fcbArray[fd].totalBlocks += fcbArray[fd].nBlocks;
-	
-	// If the file is newly created, add the new extent to the current file
-	if (fcbArray[fd].fi->ext_length == 0) {
-		memcpy(fcbArray[fd].fi->extents, fileExt.extents, fileExt.size * sizeof(extent_st));
-        fcbArray[fd].fi->ext_length = fileExt.size;
-		
-		freeExtents(&fileExt);
-		return 0;
-	}
+	fcbArray[fd].totalBlocks += nBlocks;
 
-	// Merge the newly allocated blocks with the file's existing extents (if possible)
-	// Get the last extent of the file to check if the new blocks can be merged	
-	int lastIdx = fcbArray[fd].fi->ext_length - 1;
-	
-	int lastStart = fcbArray[fd].fi->extents[lastIdx].startLoc;
-	int lastCount = fcbArray[fd].fi->extents[lastIdx].countBlock;
-	
-	int index = 1; // Counter for how many new extents are added
+	// Append the new extents, an extent that directly follows the last one is merged
+	for (int i = 0; i < fileExt.size; i++) {
+		extent_st* tail = (fi->ext_length > 0) ? &fi->extents[fi->ext_length - 1] : NULL;
 
-	// Go through the newly allocated extents
-	for (size_t i = 0; i < fileExt.size; i++) {
-		int start = fileExt.extents[i].startLoc;
-		int count = fileExt.extents[i].countBlock;
-
-		// if the new extent directly follows the last extent, merge them
-		if (lastStart + lastCount == start) {
-			fcbArray[fd].fi->extents[lastIdx].countBlock += count;
-			continue; // Continue to the next extent as it has been merged
+		if (tail && tail->startLoc + tail->countBlock == fileExt.extents[i].startLoc) {
+			tail->countBlock += fileExt.extents[i].countBlock;
+		} else {
+			fi->extents[fi->ext_length++] = fileExt.extents[i];
 		}
-
-		// Otherwise, add new extent as a separate entry
-		fcbArray[fd].fi->extents[lastIdx + index].startLoc = start;
-		fcbArray[fd].fi->extents[lastIdx + index].countBlock = count;
-		index++;
 	}
 
-	// Adjust the length of extents in the file info
-	fcbArray[fd].fi->ext_length += (index - 1);
-
 	freeExtents(&fileExt);
 	return 0;
 }
 
+/** Count the extents of a file once exts are appended to it, the way 
+ * allocateFSBlocks merges them
+ * @return number of extents
+ * @author Danish Nguyen
+ */
+int countFileExtents(b_io_fd fd, extents_st exts) {
+	inode_st* fi = fcbArray[fd].fi;
+	int count = fi->ext_length;
+	int end = (count > 0) ? fi->extents[count - 1].startLoc + fi->extents[count - 1].countBlock : -1;
+
+	for (int i = 0; i < exts.size; i++) {
+		if (exts.extents[i].startLoc != end) count++;
+		end = exts.extents[i].startLoc + exts.extents[i].countBlock;
+	}
+	return count;
+}
+
 /**
  * Release unused blocks back to FS map after finishing writing to the file
  * Any extents that exceed required blocks will be removed
@@ -655,6 +947,10 @@ int trimBlocks(b_io_fd fd) {
 	// If the number of blocks used matches the total allocated blocks, no trimming is needed
 	if (blocksUsed == fcbArray[fd].totalBlocks) return 0;
 
+	// The trimmed blocks are the last ones, where unwritten blocks are
+	fcbArray[fd].fi->unwritten_blocks = max(0, fcbArray[fd].fi->unwritten_blocks - 
+										(fcbArray[fd].totalBlocks - blocksUsed));
+
 	for (size_t i = 0; i < fcbArray[fd].fi->ext_length; i++) {
 
 		// Current extent has more blocks than needed
@@ -698,14 +994,18 @@ int trimBlocksHelper(b_io_fd fd, int index){
 	// If there are no extents left to process after the given index, return success
 	if ((index + 1) >= fcbArray[fd].fi->ext_length ) return 0;
 
-	for (size_t i = (index + 1); i < fcbArray[fd].fi->ext_length; i++) {
+	// The extents released are only dropped from the inode once all are gone,
+	// a failure leaks the rest rather than leaving freed blocks listed
+	int extLength = fcbArray[fd].fi->ext_length;
+	int status = 0;
+	for (int i = index + 1; i < extLength && status == 0; i++) {
 		int start = fcbArray[fd].fi->extents[i].startLoc;
 		int count = fcbArray[fd].fi->extents[i].countBlock;
 		
-		if (releaseBlocks(start, count) == -1) return -1;
-		fcbArray[fd].fi->ext_length --;
+		if (releaseBlocks(start, count) == -1) status = -1;
 	}
-	return 0;
+	fcbArray[fd].fi->ext_length = index + 1;
+	return status;
 }
 
 /** Find the actual LBA on disk base on the index position
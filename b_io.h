@@ -26,6 +26,7 @@ int b_read (b_io_fd fd, char * buffer, int count);
 int b_write (b_io_fd fd, char * buffer, int count);
 int b_seek (b_io_fd fd, off_t offset, int whence);
 int b_close (b_io_fd fd);
+int b_fallocate (b_io_fd fd, off_t offset, off_t len);
 
 
 
@@ -33,6 +34,11 @@ int writeBuffer(int count, b_io_fd fd, char* buffer);
 int readBuffer(int count, b_io_fd fd, char* buffer);
 
 int commitBlocks(b_io_fd fd, int nBlocks, char* buf, int calPos);
+int delayWrite(b_io_fd fd, char* buffer, int count);
+int flushDelayed(b_io_fd fd);
+int claimUnwritten(b_io_fd fd, int idxLBA, int nBlocks);
+int isUnwritten(b_io_fd fd, int idxLBA);
+int transferBlocks(b_io_fd fd, int op, char* buffer, int nBlocks);
 
 
 typedef struct LBAFinder {
@@ -42,6 +48,7 @@ typedef struct LBAFinder {
 
 LBAFinder findLBAOnDisk(b_io_fd fd, int idxLBA);
 int allocateFSBlocks(b_io_fd fd, int n);
+int countFileExtents(b_io_fd fd, extents_st exts);
 
 int trimBlocks(b_io_fd fd);
 int trimBlocksHelper(b_io_fd fd, int idx);
@@ -0,0 +1,104 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: lbabench.c
+*
+* Description:: Micro benchmark for the LBA layer. It is linked once
+* against the prebuilt fsLow.o and once against fsLowMmap.c (make bench)
+* and times the same single block, multi block and random workloads on a
+* fresh volume so both backends can be compared. The mmap build also
+* times LBAborrow, the zero-copy access of that backend.
+*
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fsLow.h"
+
+#define BENCH_ROUNDS 4      // passes over the volume for each workload
+#define BENCH_MULTI 16      // blocks per request for the multi block workload
+
+// Returns the current time in seconds
+static double nowSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char* name, double sec, uint64_t calls, uint64_t blocks, uint64_t blockSize) {
+    printf("| %-22s | %10.0f calls/s | %8.2f MB/s |\n", name, calls / sec,
+            (blocks * blockSize) / sec / (1024 * 1024));
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("Usage: lbabench volumeFileName volumeSize blockSize\n");
+        return -1;
+    }
+    uint64_t volSize = atoll(argv[2]);
+    uint64_t blockSize = atoll(argv[3]);
+
+    if (startPartitionSystem(argv[1], &volSize, &blockSize) != PART_NOERROR) {
+        printf("Start Partition Failed\n");
+        return -1;
+    }
+    uint64_t nBlocks = volSize / blockSize - 1;
+
+    char* buf = malloc(blockSize * BENCH_MULTI);
+    if (!buf) return -1;
+    memset(buf, 0xA5, blockSize * BENCH_MULTI);
+
+#ifdef FSLOW_MMAP
+    printf("\n|-------- LBA benchmark: fsLowMmap.c (%llu blocks) --------|\n", (ull_t) nBlocks);
+#else
+    printf("\n|-------- LBA benchmark: fsLow.o (%llu blocks) --------|\n", (ull_t) nBlocks);
+#endif
+
+    uint64_t calls = 0;
+    double start = nowSec();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+        for (uint64_t i = 0; i < nBlocks; i++, calls++) LBAwrite(buf, 1, i);
+    report("sequential write 1", nowSec() - start, calls, calls, blockSize);
+
+    calls = 0;
+    start = nowSec();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+        for (uint64_t i = 0; i < nBlocks; i++, calls++) LBAread(buf, 1, i);
+    report("sequential read 1", nowSec() - start, calls, calls, blockSize);
+
+    calls = 0;
+    start = nowSec();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+        for (uint64_t i = 0; i + BENCH_MULTI <= nBlocks; i += BENCH_MULTI, calls++) 
+            LBAread(buf, BENCH_MULTI, i);
+    report("sequential read 16", nowSec() - start, calls, calls * BENCH_MULTI, blockSize);
+
+    srand(415);
+    calls = 0;
+    start = nowSec();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+        for (uint64_t i = 0; i < nBlocks; i++, calls++) LBAread(buf, 1, rand() % nBlocks);
+    report("random read 1", nowSec() - start, calls, calls, blockSize);
+
+#ifdef FSLOW_MMAP
+    // Zero-copy: look at the first byte of every block in place
+    volatile char sink = 0;
+    calls = 0;
+    start = nowSec();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+        for (uint64_t i = 0; i < nBlocks; i++, calls++) sink ^= *(char*) LBAborrow(1, i);
+    report("borrow 1 (zero-copy)", nowSec() - start, calls, calls, blockSize);
+#endif
+
+    free(buf);
+    closePartitionSystem();
+    return 0;
+}
@@ -26,8 +26,15 @@
 #include "structs/DE.h"
 #include "structs/FreeSpace.h"
 #include "structs/VCB.h"
+#include "structs/BlockCache.h"
+#include "structs/AsyncIO.h"
+#include "structs/Journal.h"
+#include "structs/Discard.h"
+#include "structs/DirCache.h"
+#include "structs/Inode.h"
+#include "structs/Readahead.h"
 
-#define SIGNATURE 6565676850526897110
+#define SIGNATURE 6565676850526897111
 
 volume_control_block * vcb;
 
@@ -41,12 +48,31 @@ int initFileSystem (uint64_t numberOfBlocks, uint64_t blockSize)
 {
     printf ("Initializing File System with %ld blocks with a block size of %ld\n", numberOfBlocks, blockSize);
     
+    // Start the I/O workers, every block read/write then goes through the block cache
+    if (initAsyncIO(AIO_WORKERS) == -1) return -1;
+    if (initBlockCache(BLOCK_CACHE_SIZE, blockSize) == -1) return -1;
+    if (initReadahead() == -1) return -1;
+
     // Allocate first block on the disk into memory which store vcb struct
     vcb = malloc(blockSize);
     if (vcb == NULL) return -1;
     
     // Read first block on disk & return if error
-    if (LBAread(vcb, 1, 0) < 1) return -1;
+    int prevClass = ioSetClass(IO_CLASS_VCB);
+    int readBlocks = cacheRead(vcb, 1, 0);
+    ioSetClass(prevClass);
+    if (readBlocks < 1) return -1;
+
+    // Bring the metadata back to its last committed state after a crash
+    if (vcb->signature == SIGNATURE) {
+        int replayed = replayJournal();
+        if (replayed == -1) return -1;
+
+        prevClass = ioSetClass(IO_CLASS_VCB);
+        readBlocks = (replayed > 0) ? cacheRead(vcb, 1, 0) : 1;
+        ioSetClass(prevClass);
+        if (readBlocks < 1) return -1;
+    }
     
     vcb->free_space_map = NULL; 
     vcb->root_dir_ptr = NULL;
@@ -63,10 +89,12 @@ int initFileSystem (uint64_t numberOfBlocks, uint64_t blockSize)
     // Signature is matched with current File System
     if (vcb->signature == SIGNATURE) {
 		
+        validateFSEngine();
         vcb->free_space_map = loadFreeSpaceMap(FREESPACE_START_LOC);
-        vcb->root_dir_ptr = readDirHelper(vcb->root_loc);
+        vcb->root_dir_ptr = dirCacheGet(vcb->root_ino);
 
 		if (vcb->root_dir_ptr == NULL || vcb->free_space_map == NULL ) return -1;
+        if (startJournal() == -1) return -1;
 
         // displayRootDE();
         volumeInfo(numberOfBlocks);
@@ -83,13 +111,25 @@ int initFileSystem (uint64_t numberOfBlocks, uint64_t blockSize)
     // Load the free space map into memory
     vcb->free_space_map = initFreeSpace(numberOfBlocks, blockSize);
     if (vcb->free_space_map == NULL) return -1;
+
+    // Reserve the metadata journal right after the free space map
+    if (formatJournal(numberOfBlocks) == -1) return -1;
+
+    // The inode table holds the metadata of every file and directory
+    if (formatInodeTable(INODE_TABLE_INITIAL) == -1) return -1;
     
     // Initialize root directory
     vcb->root_dir_ptr = createDirectory(DIRECTORY_ENTRIES, NULL);
     if (vcb->root_dir_ptr == NULL) return -1;
+
+    // The root lives in the directory cache like every loaded directory
+    if (dirCacheAdd(vcb->root_dir_ptr) == -1) return -1;
     
-    // Initialize root LBA location
-    vcb->root_loc = vcb->root_dir_ptr->extents[0].startLoc;
+    // Initialize root inode number
+    vcb->root_ino = dirInode(vcb->root_dir_ptr)->ino;
+
+    // Make the new volume durable before the first operation
+    if (startJournal() == -1 || journalCheckpoint() == -1) return -1;
 
     volumeInfo(numberOfBlocks);
     return 0;
@@ -97,23 +137,54 @@ int initFileSystem (uint64_t numberOfBlocks, uint64_t blockSize)
 	
 void exitFileSystem ()
 {
+    // Nothing is read ahead once the volume starts going down
+    exitReadahead();
+
+    // The root and the cwd are owned by the directory cache. Directories and
+    // their inodes are given back first: an inode removed while held is
+    // released now, before the metadata goes to disk
+    releaseDir(vcb->cwdLoadDE);
+    vcb->cwdLoadDE = NULL;
+    vcb->root_dir_ptr = NULL;
+    freeDirCache();
+
     // Write Volumn Control Block back to the disk
-    if (LBAwrite(vcb, 1, 0) < 1){
+    int prevClass = ioSetClass(IO_CLASS_VCB);
+    if (cacheWrite(vcb, 1, 0) < 1){
         printf("Unable to write VCB to disk!\n");
     }
+    ioSetClass(prevClass);
 
     // Write updated free space map to disk; print write failure
-    if (writeFSToDisk(vcb->fs_st.curExtentLBA) == -1){
+    if (writeFSToDisk() == -1){
         printf("Unable to write free space map to disk!\n");
     }
+
+    // Commit the last metadata changes and write them home
+    if (exitJournal() == -1){
+        printf("Unable to checkpoint the metadata journal!\n");
+    }
+
+    // Push all dirty blocks held by the cache to the disk
+    if (cacheFlush() == -1){
+        printf("Unable to flush block cache to disk!\n");
+    }
+
+    // Punch the blocks released since the last checkpoint out of the volume file
+    if (discardFlush() == -1){
+        printf("Unable to discard released blocks!\n");
+    }
+    exitDiscard();
+
+    // Summary of the I/O done since mount, including write amplification
+    printf("\n---- I/O summary ----\n");
+    printIOStats(vcb->block_size);
+
+    freeBlockCache();
+    exitAsyncIO();
     
-    freePtr((void**) &vcb->fs_st.terExtTBMap, "Tetiary Table");
-    freePtr((void**) &vcb->free_space_map, "Free Space");
+    freeFreeSpace();
     
-    if (vcb->cwdLoadDE != vcb->root_dir_ptr){
-        freePtr((void**) &vcb->cwdLoadDE, "CWD DE loaded");
-    }
-    freePtr((void**) &vcb->root_dir_ptr, "Directory Entry");
     freePtr((void**) &vcb->cwdStrPath, "CWD Str Path");
 
     freePtr((void**) &vcb, "Volume Control Block");
@@ -135,7 +206,7 @@ void volumeInfo(int nBlocks){
 // It also loads and prints tertiary extent table details.
 void testFreeSpaceTertiary(){
     /* TEST ALLOCATE */
-    extents_st test = allocateBlocks(19450, 0);
+    extents_st test = allocateBlocks(19450, 0, -1);
 
     /* TEST RELEASE */
     for (size_t id = 40; id < 10000 ; id++) { //1480 extents
@@ -164,31 +235,28 @@ void testFreeSpaceTertiary(){
 
 void displayRootDE(){
     // directory_entry* newDir = createDirectory(DIRECTORY_ENTRIES, vcb->root_dir_ptr);
-    // directory_entry* newDir = readDirHelper(42);
-    
-    // for (size_t i = 0; i < newDir->ext_length ; i++) { //vcb->fs_st.extentLength
-    //     printf( "newDir: [%d: %d]\n", newDir->extents[i].startLoc, newDir->extents[i].countBlock);
-    // }
+    // directory_entry* newDir = readDirHelper(vcb->root_ino);
     
-    printf("%-11s %-10s %-7s %-4s %-4s %-4s %-7s\n",
-       "Name", "Size", "LBA", "Used", "Type", "Ext", "Count");
+    printf("%-11s %-10s %-7s %-4s %-4s %-4s %-7s %-5s\n",
+       "Name", "Size", "LBA", "Used", "Type", "Ext", "Count", "Inode");
 
-    for (size_t i = 0; i < DIRECTORY_ENTRIES; i++){
+    for (size_t i = 0; i < sizeOfDE(vcb->root_dir_ptr); i++){
         if (!vcb->root_dir_ptr[i].is_used) continue;
-        printf("%-11s %-10d %-7d %-4d %-4d %-4d %-7d\n", 
+
+        inode_st* inode = inodeGet(vcb->root_dir_ptr[i].inode);
+        if (inode == NULL) continue;
+
+        printf("%-11s %-10d %-7d %-4d %-4d %-4d %-7d %-5u\n", 
             vcb->root_dir_ptr[i].file_name,
-            vcb->root_dir_ptr[i].file_size,
-            vcb->root_dir_ptr[i].extents->startLoc,
+            inode->file_size,
+            inode->extents->startLoc,
             vcb->root_dir_ptr[i].is_used,
-            vcb->root_dir_ptr[i].is_directory,
-            vcb->root_dir_ptr[i].ext_length,
-            vcb->root_dir_ptr[i].extents->countBlock);
+            inode->is_directory,
+            inode->ext_length,
+            inode->extents->countBlock,
+            inode->ino);
         
-        // if (vcb->root_dir_ptr[i].ext_length < 2) continue;
-
-        // for (size_t j = 0; j < vcb->root_dir_ptr[i].ext_length ; j++) {
-        //     printf("EXT: [ %d | %d ]\n", vcb->root_dir_ptr[i].extents[j].startLoc, vcb->root_dir_ptr[i].extents[j].countBlock);
-        // }
+        inodePut(inode);
     }
 }
 
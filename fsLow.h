@@ -64,6 +64,12 @@ uint64_t LBAwrite (void * buffer, uint64_t lbaCount, uint64_t lbaPosition);
 
 uint64_t LBAread (void * buffer, uint64_t lbaCount, uint64_t lbaPosition);
 
+#ifdef FSLOW_MMAP
+// Only provided by the memory mapped backend (fsLowMmap.c, make BACKEND=mmap)
+// Returns a pointer to the blocks on the volume itself, NULL if out of range
+void* LBAborrow (uint64_t lbaCount, uint64_t lbaPosition);
+#endif
+
 void runFSLowTest();  //Do not use this, for testing only
 
 #define MINBLOCKSIZE 512
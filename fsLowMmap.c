@@ -0,0 +1,230 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: fsLowMmap.c
+*
+* Description:: Open source replacement for fsLow.o that maps the whole
+* volume file into memory. It keeps the same contract as fsLow.h
+* (startPartitionSystem, closePartitionSystem, LBAread, LBAwrite) and
+* the same partition header layout, so a volume created by one backend
+* can be opened by the other. LBAread/LBAwrite become a memcpy instead
+* of a system call, and LBAborrow hands out a pointer to the mapped
+* blocks (only used by the LBA benchmark).
+*
+* Build with: make BACKEND=mmap
+*
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "fsLow.h"
+
+#define PART_CAPTION_LEN 64
+#define PART_VOLNAME "Untitled\n\n"
+
+/* Partition header stored in the block before LBA 0. The layout matches the
+ * one written by fsLow.o so both backends can share the same volume file. */
+typedef struct partition_header_st {
+    char caption[PART_CAPTION_LEN]; // human readable caption
+    uint64_t signature;             // PART_SIGNATURE
+    uint64_t volumeSize;            // volume size in bytes as requested
+    uint64_t blockSize;             // size of one block in bytes
+    uint64_t numberOfBlocks;        // number of blocks presented to the FS
+    uint64_t reserved[2];
+    uint64_t signature2;            // PART_SIGNATURE2
+    char volumeName[16];
+} partition_header_st;
+
+/* Runtime state of the mapped volume */
+typedef struct mmap_partition_st {
+    int fd;
+    char* base;              // start of the mapping (partition header)
+    size_t mapLength;        // bytes mapped
+    uint64_t blockSize;
+    uint64_t numberOfBlocks;
+} mmap_partition_st;
+
+static mmap_partition_st part = { -1, NULL, 0, 0, 0 };
+
+static int createPartition(char* filename, uint64_t volSize, uint64_t blockSize);
+static uint64_t clampCount(uint64_t lbaCount, uint64_t lbaPosition);
+
+/** Opens (creating if needed) the volume file and maps it into memory.
+ * @return 0 on success, -1 if the file can not be opened, -2 if there is not
+ * enough space for the volume, PART_ERR_INVALID if the header is not valid
+ */
+int startPartitionSystem (char * filename, uint64_t * volSize, uint64_t * blockSize) {
+    if (access(filename, F_OK) != 0) {
+        // Block size must be a power of 2 and at least MINBLOCKSIZE
+        uint64_t bSize = MINBLOCKSIZE;
+        while (bSize < *blockSize) bSize <<= 1;
+
+        int status = createPartition(filename, *volSize, bSize);
+        if (status != 0) return status;
+    }
+
+    part.fd = open(filename, O_RDWR);
+    if (part.fd == -1) {
+        printf("About to abort - problem opening file.  Error No: %d\n", errno);
+        return -1;
+    }
+
+    partition_header_st header;
+    if (pread(part.fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.signature != PART_SIGNATURE || header.signature2 != PART_SIGNATURE2) {
+        *volSize = 0;
+        *blockSize = 0;
+        close(part.fd);
+        part.fd = -1;
+        return PART_ERR_INVALID;
+    }
+
+    part.blockSize = header.blockSize;
+    part.numberOfBlocks = header.numberOfBlocks;
+    part.mapLength = (part.numberOfBlocks + 1) * part.blockSize;
+
+    part.base = mmap(NULL, part.mapLength, PROT_READ | PROT_WRITE, MAP_SHARED, part.fd, 0);
+    if (part.base == MAP_FAILED) {
+        printf("Unable to map volume %s.  Error No: %d\n", filename, errno);
+        part.base = NULL;
+        close(part.fd);
+        part.fd = -1;
+        return -1;
+    }
+
+    *volSize = header.volumeSize;
+    *blockSize = header.blockSize;
+    return PART_NOERROR;
+}
+
+/** Writes the mapped pages back to the volume file and releases the mapping
+ * @return 0 on success, -1 if the partition is not open
+ */
+int closePartitionSystem () {
+    if (part.base == NULL) return -1;
+
+    msync(part.base, part.mapLength, MS_SYNC);
+    munmap(part.base, part.mapLength);
+    close(part.fd);
+
+    part = (mmap_partition_st) { -1, NULL, 0, 0, 0 };
+    return 0;
+}
+
+/** Copies lbaCount blocks from the mapping to buffer
+ * @return number of blocks read */
+uint64_t LBAread (void * buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    lbaCount = clampCount(lbaCount, lbaPosition);
+    if (lbaCount == 0 || buffer == NULL) return 0;
+
+    memcpy(buffer, part.base + (lbaPosition + 1) * part.blockSize, lbaCount * part.blockSize);
+    return lbaCount;
+}
+
+/** Copies lbaCount blocks from buffer into the mapping
+ * @return number of blocks written */
+uint64_t LBAwrite (void * buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    lbaCount = clampCount(lbaCount, lbaPosition);
+    if (lbaCount == 0 || buffer == NULL) return 0;
+
+    memcpy(part.base + (lbaPosition + 1) * part.blockSize, buffer, lbaCount * part.blockSize);
+    return lbaCount;
+}
+
+/** Zero-copy access to lbaCount blocks starting at lbaPosition. The pointer
+ * stays valid until closePartitionSystem; writes through it change the volume.
+ * @return pointer to the first block or NULL if the range is not on the volume
+ */
+void* LBAborrow (uint64_t lbaCount, uint64_t lbaPosition) {
+    if (clampCount(lbaCount, lbaPosition) != lbaCount || lbaCount == 0) return NULL;
+    return part.base + (lbaPosition + 1) * part.blockSize;
+}
+
+/** Writes and reads back a few blocks to check the backend works */
+void runFSLowTest() {
+    if (part.base == NULL) {
+        printf("System not initialized.  Test Failed\n");
+        return;
+    }
+    char* buf = malloc(part.blockSize * 2);
+    if (buf == NULL) {
+        printf("Failed to malloc initial buffer.  Test Failed\n");
+        return;
+    }
+    for (uint64_t i = 0; i < part.blockSize * 2; i++) buf[i] = (char) i;
+
+    printf("Wrote block %d with a result of %d\n", 0, (int) LBAwrite(buf, 2, 0));
+    memset(buf, 0, part.blockSize * 2);
+    printf("Read block %d with a result of %d\n", 0, (int) LBAread(buf, 2, 0));
+    free(buf);
+}
+
+/** Creates a sparse volume file and writes the partition header in front of it
+ * @return 0 on success, -1 if the file can not be created, -2 if there is
+ * not enough space for the volume
+ */
+static int createPartition(char* filename, uint64_t volSize, uint64_t blockSize) {
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) {
+        printf("About to abort - problem opening file.  Error No: %d\n", errno);
+        return -1;
+    }
+
+    uint64_t nBlocks = volSize / blockSize;
+
+    // The header takes one block in front of the volume
+    if (ftruncate(fd, (nBlocks + 1) * blockSize) == -1) {
+        close(fd);
+        unlink(filename);
+        return -2;
+    }
+
+    char* headerBlock = calloc(1, blockSize);
+    if (headerBlock == NULL) {
+        close(fd);
+        return -1;
+    }
+
+    partition_header_st* header = (partition_header_st*) headerBlock;
+    strcpy(header->caption, PART_CAPTION);
+    header->signature = PART_SIGNATURE;
+    header->volumeSize = volSize;
+    header->blockSize = blockSize;
+    header->numberOfBlocks = nBlocks;
+    header->signature2 = PART_SIGNATURE2;
+    strcpy(header->volumeName, PART_VOLNAME);
+
+    ssize_t written = pwrite(fd, headerBlock, blockSize, 0);
+    free(headerBlock);
+    fsync(fd);
+    close(fd);
+
+    if (written != blockSize) return -2;
+
+    printf("Created a volume with %llu bytes, broken into %llu blocks of %llu bytes.\n",
+            (ull_t) volSize, (ull_t) nBlocks, (ull_t) blockSize);
+    return 0;
+}
+
+/** Limits a transfer to the blocks that exist on the volume
+ * @return number of blocks that can be transferred */
+static uint64_t clampCount(uint64_t lbaCount, uint64_t lbaPosition) {
+    if (part.base == NULL || lbaPosition >= part.numberOfBlocks) return 0;
+    if (lbaPosition + lbaCount > part.numberOfBlocks) {
+        return part.numberOfBlocks - lbaPosition;
+    }
+    return lbaCount;
+}
@@ -24,9 +24,13 @@
 #include <readline/history.h>
 #include <getopt.h>
 #include <string.h>
+#include <fnmatch.h>
 
 #include "fsLow.h"
 #include "mfs.h"
+#include "structs/Defrag.h"
+#include "structs/Discard.h"
+#include "structs/Walk.h"
 
 #define PERMISSIONS (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
 
@@ -34,6 +38,7 @@
 #define DOUBLE_QUOTE	0x22
 #define BUFFERLEN		2000
 #define DIRMAX_LEN		4096
+#define READDIR_BATCH	64		// entries listed by ls per call of fs_readdirplus
 
 /****   SET THESE TO 1 WHEN READY TO TEST THAT COMMAND ****/
 #define CMDLS_ON	1
@@ -47,6 +52,12 @@
 #define CMDPWD_ON	1
 #define CMDTOUCH_ON	1
 #define CMDCAT_ON	1
+#define CMDIOSTAT_ON	1
+#define CMDCOMPACT_ON	1
+#define CMDDEFRAG_ON	1
+#define CMDLN_ON	1
+#define CMDDU_ON	1
+#define CMDFIND_ON	1
 
 
 typedef struct dispatch_t
@@ -62,6 +73,7 @@ int cmd_cp (int argcnt, char *argvec[]);
 int cmd_mv (int argcnt, char *argvec[]);
 int cmd_md (int argcnt, char *argvec[]);
 int cmd_rm (int argcnt, char *argvec[]);
+int cmd_ln (int argcnt, char *argvec[]);
 int cmd_touch (int argcnt, char *argvec[]);
 int cmd_cat (int argcnt, char *argvec[]);
 int cmd_cp2l (int argcnt, char *argvec[]);
@@ -69,6 +81,11 @@ int cmd_cp2fs (int argcnt, char *argvec[]);
 int cmd_cd (int argcnt, char *argvec[]);
 int cmd_pwd (int argcnt, char *argvec[]);
 int cmd_history (int argcnt, char *argvec[]);
+int cmd_iostat (int argcnt, char *argvec[]);
+int cmd_compact (int argcnt, char *argvec[]);
+int cmd_defrag (int argcnt, char *argvec[]);
+int cmd_du (int argcnt, char *argvec[]);
+int cmd_find (int argcnt, char *argvec[]);
 int cmd_help (int argcnt, char *argvec[]);
 
 dispatch_t dispatchTable[] = {
@@ -77,6 +94,7 @@ dispatch_t dispatchTable[] = {
 	{"mv", cmd_mv, "Moves a file - source dest"},
 	{"md", cmd_md, "Make a new directory"},
 	{"rm", cmd_rm, "Removes a file or directory"},
+	{"ln", cmd_ln, "Adds a name to a file - target linkname"},
         {"touch",cmd_touch, "Touches/Creates a file"},
         {"cat", cmd_cat, "Limited version of cat that displace the file to the console"},
 	{"cp2l", cmd_cp2l, "Copies a file from the test file system to the linux file system"},
@@ -84,39 +102,52 @@ dispatch_t dispatchTable[] = {
 	{"cd", cmd_cd, "Changes directory"},
 	{"pwd", cmd_pwd, "Prints the working directory"},
 	{"history", cmd_history, "Prints out the history"},
+	{"iostat", cmd_iostat, "Prints block I/O counters per subsystem - [-r to reset]"},
+	{"compact", cmd_compact, "Compacts the free space extent tables"},
+	{"defrag", cmd_defrag, "Moves fragmented files and directories to contiguous blocks - [ms budget]"},
+	{"du", cmd_du, "Prints the space used by a tree - [pathname]"},
+	{"find", cmd_find, "Lists the entries of a tree - [pathname] [-name pattern] [-type f|d]"},
 	{"help", cmd_help, "Prints out help"}
 };
 
 static int dispatchcount = sizeof (dispatchTable) / sizeof (dispatch_t);
 
-// Display files for use by ls command
+// Display files for use by ls command, READDIR_BATCH entries at a time
 int displayFiles (fdDir * dirp, int flall, int fllong)
 	{
 #if (CMDLS_ON == 1)				
 	if (dirp == NULL)	//get out if error
 		return (-1);
 	
-	struct fs_diriteminfo * di;
-	struct fs_stat statbuf;
+	struct fs_direntplus * batch;
+	int count;
 	
-	di = fs_readdir (dirp);
-	// printf("\n");
-	while (di != NULL) 
+	batch = malloc (READDIR_BATCH * sizeof (struct fs_direntplus));
+	if (batch == NULL)
 		{
-		if ((di->d_name[0] != '.') || (flall)) //if not all and starts with '.' it is hidden
+		fs_closedir (dirp);
+		return (-1);
+		}
+	
+	while ((count = fs_readdirplus (dirp, batch, READDIR_BATCH)) > 0) 
+		{
+		for (int i = 0; i < count; i++)
 			{
-			if (fllong)
+			struct fs_diriteminfo * di = &batch[i].di;
+			if ((di->d_name[0] != '.') || (flall)) //if not all and starts with '.' it is hidden
 				{
-				fs_stat (di->d_name, &statbuf);
-				printf ("%s    %9ld   %s\n", fs_isDir(di->d_name)?"D":"-", statbuf.st_size, di->d_name);
-				}
-			else
-				{
-				printf ("%s\n", di->d_name);
+				if (fllong)
+					{
+					printf ("%s    %9ld   %s\n", (di->fileType == 'D')?"D":"-", batch[i].st.st_size, di->d_name);
+					}
+				else
+					{
+					printf ("%s\n", di->d_name);
+					}
 				}
 			}
-		di = fs_readdir (dirp);
 		}
+	free (batch);
 	fs_closedir (dirp);
 #endif
 	return 0;
@@ -346,6 +377,11 @@ int cmd_cp (int argcnt, char *argvec[])
 	
 	testfs_src_fd = b_open (src, O_RDONLY);
 	testfs_dest_fd = b_open (dest, O_WRONLY | O_CREAT | O_TRUNC);
+
+	// Reserve the whole copy up front so it lands in as few extents as possible
+	struct fs_stat srcStat;
+	if (testfs_dest_fd >= 0 && fs_stat (src, &srcStat) == 0 && srcStat.st_size > 0)
+		b_fallocate (testfs_dest_fd, 0, srcStat.st_size);
 	do 
 		{
 		readcnt = b_read (testfs_src_fd, buf, BUFFERLEN);
@@ -415,6 +451,27 @@ int cmd_md (int argcnt, char *argvec[])
 	return -1;
 	}
 	
+/****************************************************
+*  Hard link commmand
+****************************************************/
+int cmd_ln (int argcnt, char *argvec[])
+	{
+#if (CMDLN_ON == 1)
+	if (argcnt != 3)
+		{
+		printf("Usage: ln target linkname\n");
+		return -1;
+		}
+	if (fs_link(argvec[1], argvec[2]) != 0)
+		{
+		printf("ln: cannot link '%s' to '%s'\n", argvec[2], argvec[1]);
+		return -1;
+		}
+	return 0;
+#endif
+	return -1;
+	}
+
 /****************************************************
 *  Remove directory or file commmand
 ****************************************************/
@@ -521,6 +578,11 @@ int cmd_cp2fs (int argcnt, char *argvec[])
 	
 	testfs_fd = b_open (dest, O_WRONLY | O_CREAT | O_TRUNC);
 	linux_fd = open (src, O_RDONLY);
+
+	// Reserve the whole import up front so it lands in as few extents as possible
+	struct stat srcStat;
+	if (testfs_fd >= 0 && linux_fd >= 0 && fstat (linux_fd, &srcStat) == 0 && srcStat.st_size > 0)
+		b_fallocate (testfs_fd, 0, srcStat.st_size);
 	do 
 		{
 		readcnt = read (linux_fd, buf, BUFFERLEN);
@@ -614,6 +676,225 @@ int cmd_history (int argcnt, char *argvec[])
 	return 0;
 	}
 	
+/****************************************************
+*  I/O statistics commmand
+****************************************************/
+int cmd_iostat (int argcnt, char *argvec[])
+	{
+#if (CMDIOSTAT_ON == 1)
+	if (argcnt > 2 || (argcnt == 2 && strcmp(argvec[1], "-r") != 0))
+		{
+		printf ("Usage: iostat [-r]\n");
+		return (-1);
+		}
+	printIOStats(vcb->block_size);
+
+	// -r clears the counters after printing them
+	if (argcnt == 2) resetIOStats();
+#endif
+	return 0;
+	}
+
+/****************************************************
+*  Free space compaction commmand
+****************************************************/
+int cmd_compact (int argcnt, char *argvec[])
+	{
+#if (CMDCOMPACT_ON == 1)
+	if (vcb->fs_engine != FS_ENGINE_EXTENT)
+		{
+		printf ("Free space engine has no extent tables to compact\n");
+		return 0;
+		}
+
+	int extents = vcb->fs_st.extentLength;
+	int tables = vcb->fs_st.terExtLength;
+
+	if (compactFreeSpace() == -1)
+		{
+		printf ("Compaction failed\n");
+		return (-1);
+		}
+	printf ("Extents: %d -> %d, secondary tables: %d -> %d\n", extents,
+		vcb->fs_st.extentLength, tables, vcb->fs_st.terExtLength);
+#endif
+	return 0;
+	}
+
+/****************************************************
+*  Defragment commmand
+****************************************************/
+int cmd_defrag (int argcnt, char *argvec[])
+	{
+#if (CMDDEFRAG_ON == 1)
+	if (argcnt > 2)
+		{
+		printf ("Usage: defrag [ms]\n");
+		return (-1);
+		}
+
+	// Without a budget the whole pass runs at once
+	int budget = (argcnt == 2) ? atoi (argvec[1]) : 0;
+	defrag_stats_st stats;
+
+	if (defragVolume (budget, &stats) == -1)
+		{
+		printf ("Defragmentation failed\n");
+		return (-1);
+		}
+	printf ("Visited %d files, %d directories, moved %d\n", stats.files, stats.dirs, stats.moved);
+	printf ("Fragmented entries: %d -> %d, extents: %d -> %d\n", stats.fragmentedBefore,
+		stats.fragmentedAfter, stats.extentsBefore, stats.extentsAfter);
+	printf ("Free space extents: %d -> %d\n", stats.freeExtentsBefore, stats.freeExtentsAfter);
+	printf (stats.complete ? "Pass complete\n" : "Budget spent, run defrag again to continue\n");
+#endif
+	return 0;
+	}
+
+/****************************************************
+*  Disk usage commmand
+****************************************************/
+typedef struct du_total_st
+	{
+	long bytes;
+	int files;
+	int dirs;
+	pthread_mutex_t lock;
+	} du_total_st;
+
+// fs_walk callback: add the blocks of an entry (runs on the threads of the walk)
+static int duVisit (const char * path, const directory_entry * entry, const inode_st * inode,
+			int depth, void * arg)
+	{
+	du_total_st * total = (du_total_st *) arg;
+	long blocks = 0;
+	for (int i = 0; i < inode->ext_length; i++)
+		blocks += inode->extents[i].countBlock;
+
+	pthread_mutex_lock (&total->lock);
+	total->bytes += blocks * vcb->block_size;
+	if (inode->is_directory) total->dirs++;
+	else total->files++;
+	pthread_mutex_unlock (&total->lock);
+	return 0;
+	}
+
+int cmd_du (int argcnt, char *argvec[])
+	{
+#if (CMDDU_ON == 1)
+	char cwd[DIRMAX_LEN];
+	if (argcnt > 2)
+		{
+		printf ("Usage: du [pathname]\n");
+		return (-1);
+		}
+	char * path = (argcnt == 2) ? argvec[1] : fs_getcwd (cwd, DIRMAX_LEN);
+
+	du_total_st total = { 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+	if (fs_walk (path, duVisit, &total, 0) != 0)
+		{
+		printf ("du: cannot walk '%s'\n", path);
+		return (-1);
+		}
+	printf ("%9ld   %s   (%d files, %d directories)\n", total.bytes, path, total.files, total.dirs);
+#endif
+	return 0;
+	}
+
+/****************************************************
+*  Find commmand
+****************************************************/
+typedef struct find_query_st
+	{
+	const char * pattern;	/* names matched, NULL for any */
+	char type;				/* 'f' or 'd', 0 for any */
+	char ** paths;			/* paths found, sorted once the walk is over */
+	int count;
+	int capacity;
+	pthread_mutex_t lock;
+	} find_query_st;
+
+// fs_walk callback: keep the path of a matching entry (runs on the threads of the walk)
+static int findVisit (const char * path, const directory_entry * entry, const inode_st * inode,
+			int depth, void * arg)
+	{
+	find_query_st * query = (find_query_st *) arg;
+
+	if (query->type && (query->type == 'd') != (inode->is_directory != 0))
+		return 0;
+	if (query->pattern && fnmatch (query->pattern, entry->file_name, 0) != 0)
+		return 0;
+
+	char * copy = strdup (path);
+	if (copy == NULL)
+		return (-1);
+
+	pthread_mutex_lock (&query->lock);
+	if (query->count == query->capacity)
+		{
+		int capacity = (query->capacity > 0) ? query->capacity * 2 : 64;
+		char ** paths = realloc (query->paths, capacity * sizeof (char *));
+		if (paths == NULL)
+			{
+			pthread_mutex_unlock (&query->lock);
+			free (copy);
+			return (-1);
+			}
+		query->paths = paths;
+		query->capacity = capacity;
+		}
+	query->paths[query->count++] = copy;
+	pthread_mutex_unlock (&query->lock);
+	return 0;
+	}
+
+static int comparePaths (const void * a, const void * b)
+	{
+	return strcmp (*(char * const *) a, *(char * const *) b);
+	}
+
+int cmd_find (int argcnt, char *argvec[])
+	{
+#if (CMDFIND_ON == 1)
+	char cwd[DIRMAX_LEN];
+	char * path = NULL;
+	find_query_st query = { NULL, 0, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+	for (int k = 1; k < argcnt; k++)
+		{
+		if (strcmp (argvec[k], "-name") == 0 && k + 1 < argcnt)
+			query.pattern = argvec[++k];
+		else if (strcmp (argvec[k], "-type") == 0 && k + 1 < argcnt &&
+				(strcmp (argvec[k + 1], "f") == 0 || strcmp (argvec[k + 1], "d") == 0))
+			query.type = argvec[++k][0];
+		else if (argvec[k][0] != '-' && path == NULL)
+			path = argvec[k];
+		else
+			{
+			printf ("Usage: find [pathname] [-name pattern] [-type f|d]\n");
+			return (-1);
+			}
+		}
+	if (path == NULL)
+		path = fs_getcwd (cwd, DIRMAX_LEN);
+
+	// The walk finds the entries in any order, they are printed sorted
+	int status = fs_walk (path, findVisit, &query, 0);
+	if (status != 0)
+		printf ("find: cannot walk '%s'\n", path);
+
+	qsort (query.paths, query.count, sizeof (char *), comparePaths);
+	for (int i = 0; i < query.count; i++)
+		{
+		printf ("%s\n", query.paths[i]);
+		free (query.paths[i]);
+		}
+	free (query.paths);
+	return (status == 0) ? 0 : (-1);
+#endif
+	return 0;
+	}
+
 /****************************************************
 *  Help commmand
 ****************************************************/
@@ -765,6 +1046,12 @@ int main (int argc, char * argv[])
 		printf ("Start Partition Failed:  %d\n", retVal);
 		return (retVal);
 		}
+
+	// Released blocks are punched out of the volume file when the host allows it
+	initDiscard (filename, blockSize);
+
+	// Block I/O addresses the volume file by offset, so requests can overlap
+	initVolumeIO (filename, blockSize, volumeSize / blockSize);
 		
 	retVal = initFileSystem (volumeSize / blockSize, blockSize);
 	
@@ -819,6 +1106,11 @@ int main (int argc, char * argv[])
 #else
         printf ("| rm                   |    OFF   |\n");  
 #endif
+#if (CMDLN_ON == 1)
+        printf ("| ln                   |    ON    |\n");  
+#else
+        printf ("| ln                   |    OFF   |\n");  
+#endif
 #if (CMDCP_ON == 1)
         printf ("| cp                   |    ON    |\n");  
 #else
@@ -838,6 +1130,31 @@ int main (int argc, char * argv[])
         printf ("| cp2l                 |    ON    |\n");  
 #else
         printf ("| cp2l                 |    OFF   |\n");
+#endif
+#if (CMDIOSTAT_ON == 1)
+        printf ("| iostat               |    ON    |\n");  
+#else
+        printf ("| iostat               |    OFF   |\n");
+#endif
+#if (CMDCOMPACT_ON == 1)
+        printf ("| compact              |    ON    |\n");  
+#else
+        printf ("| compact              |    OFF   |\n");
+#endif
+#if (CMDDEFRAG_ON == 1)
+        printf ("| defrag               |    ON    |\n");  
+#else
+        printf ("| defrag               |    OFF   |\n");
+#endif
+#if (CMDDU_ON == 1)
+        printf ("| du                   |    ON    |\n");  
+#else
+        printf ("| du                   |    OFF   |\n");
+#endif
+#if (CMDFIND_ON == 1)
+        printf ("| find                 |    ON    |\n");  
+#else
+        printf ("| find                 |    OFF   |\n");
 #endif
         printf ("|---------------------------------|\n");
 
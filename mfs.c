@@ -21,6 +21,18 @@
 #include "structs/ParsePath.h"
 #include "structs/VCB.h"
 #include "structs/DE.h"
+#include "structs/DirCache.h"
+#include "structs/DirIndex.h"
+#include "structs/Readahead.h"
+
+// Directories loaded while walking a path, given back once the walk is over
+typedef struct {
+    directory_entry **dirs;
+    int count;
+} path_walk_st;
+
+static directory_entry *keepLoaded(path_walk_st *walk, directory_entry *dir);
+static int endWalk(path_walk_st *walk, parsepath_st *result, int status);
 
 // @author: Atharva Walawalkar
 
@@ -42,6 +54,27 @@ directory_entry *FindHelper(directory_entry *current, const char *name)
         }
     }*/
 
+    // A cached lookup skips the scan; a cached index is checked before use
+    int dirIno = dirInode(current)->ino;
+    int cached = dirCacheLookup(dirIno, name);
+    if (cached == DIR_NAME_ABSENT)
+    {
+        return NULL;
+    }
+    if (cached >= 0 && cached < sizeOfDE(current) && current[cached].is_used &&
+        strcmp(current[cached].file_name, name) == 0)
+    {
+        return &current[cached];
+    }
+
+    // The hashed index of the directory finds the entry without a scan
+    int indexed = dirIndexFind(current, name);
+    if (indexed != DIR_INDEX_NONE)
+    {
+        dirCacheRemember(dirIno, name, indexed);
+        return (indexed == -1) ? NULL : &current[indexed];
+    }
+
     for (int i = 0; i < sizeOfDE(current); i++)
     {
         // printf("Checking entry %d: %s (used: %d)\n", i, current[i].file_name,
@@ -49,13 +82,19 @@ directory_entry *FindHelper(directory_entry *current, const char *name)
 
         if (current[i].is_used && strcmp(current[i].file_name, name) == 0)
         {
+            dirCacheRemember(dirIno, name, i);
             return &current[i];
         }
     }
     
+    dirCacheRemember(dirIno, name, DIR_NAME_ABSENT);
     return NULL;
 }
 
+/** Parse a path. On success result->retParent holds a reference on the
+ * directory cache: give it back with releaseDir when done with it.
+ * @return 0 on success, -1 on failure
+ */
 int parsePath(const char *path, parsepath_st *result)
 {
 
@@ -83,6 +122,7 @@ int parsePath(const char *path, parsepath_st *result)
             result->index = 0;
             result->lastElement[0] = '.';
             result->lastElement[1] = '\0';
+            dirCacheHold(result->retParent);
             return 0;
         }
         path++;
@@ -110,6 +150,7 @@ int parsePath(const char *path, parsepath_st *result)
         result->retParent = parent;
         result->index = -1;
         result->lastElement[0] = '\0';
+        dirCacheHold(result->retParent);
         return 0;
     }
 
@@ -121,6 +162,14 @@ int parsePath(const char *path, parsepath_st *result)
         return -1;
     }
 
+    // At most one directory is loaded per path component
+    path_walk_st walk = { malloc((strlen(path) / 2 + 2) * sizeof(directory_entry *)), 0 };
+    if (walk.dirs == NULL)
+    {
+        free(path_copy);
+        return -1;
+    }
+
     // The result structure populated
     result->retParent = parent;
     result->index = -1;
@@ -135,7 +184,7 @@ int parsePath(const char *path, parsepath_st *result)
     {
         free(path_copy);
         // printf("Path was just /");
-        return 0;
+        return endWalk(&walk, result, 0);
     }
 
     while (token1 != NULL)
@@ -160,14 +209,14 @@ int parsePath(const char *path, parsepath_st *result)
             // printf("Last element: %s\n", result->lastElement);
 
             // Make sure current is loaded before searching
-            if (current->ext_length > 0)
+            if (current->inode != INODE_NONE)
             {
-                current = loadDir(current);
+                current = keepLoaded(&walk, loadDir(current));
                 if (!current)
                 {
                     // printf("Failed to load parent directory for last element\n");
                     free(path_copy);
-                    return -1;
+                    return endWalk(&walk, result, -1);
                 }
             }
 
@@ -202,13 +251,13 @@ int parsePath(const char *path, parsepath_st *result)
             if (parent != vcb->root_dir_ptr)
             { // Don't go up if already at root
                 current = parent;
-                if (current[1].ext_length > 0)
+                if (current[1].inode != INODE_NONE)
                 { // ".." entry is always at index 1
-                    parent = loadDir(&current[1]);
+                    parent = keepLoaded(&walk, loadDir(&current[1]));
                     if (!parent)
                     {
                         free(path_copy);
-                        return -1;
+                        return endWalk(&walk, result, -1);
                     }
                 }
             }
@@ -223,18 +272,18 @@ int parsePath(const char *path, parsepath_st *result)
         {
             // printf("Failed to find/load directory: %s\n", token1);
             free(path_copy);
-            return -1;
+            return endWalk(&walk, result, -1);
         }
 
-        // Load the directory if it has extents
-        if (next_dir->ext_length > 0)
+        // Load the directory if it has an inode
+        if (next_dir->inode != INODE_NONE)
         {
-            directory_entry *loaded_dir = loadDir(next_dir);
+            directory_entry *loaded_dir = keepLoaded(&walk, loadDir(next_dir));
             if (!loaded_dir)
             {
                 // printf("Failed to load directory from LBA\n");
                 free(path_copy);
-                return -1;
+                return endWalk(&walk, result, -1);
             }
             parent = current;
             current = loaded_dir;
@@ -253,7 +302,35 @@ int parsePath(const char *path, parsepath_st *result)
 
     free(path_copy);
     // printf("Path parsing complete. Index: %d\n\n", result->index);
-    return 0;
+    return endWalk(&walk, result, 0);
+}
+
+// Remember a directory loaded by the walk so endWalk gives it back
+static directory_entry *keepLoaded(path_walk_st *walk, directory_entry *dir)
+{
+    if (dir)
+    {
+        walk->dirs[walk->count++] = dir;
+    }
+    return dir;
+}
+
+/** Ends a walk: the directory returned in result gets its own reference,
+ * then the directories loaded on the way are given back
+ * @return status
+ */
+static int endWalk(path_walk_st *walk, parsepath_st *result, int status)
+{
+    if (status == 0)
+    {
+        dirCacheHold(result->retParent);
+    }
+    for (int i = 0; i < walk->count; i++)
+    {
+        releaseDir(walk->dirs[i]);
+    }
+    free(walk->dirs);
+    return status;
 }
 
 /** Get current working directory
@@ -288,21 +365,23 @@ int fs_setcwd(char* pathname) {
 
     parsepath_st parser = { NULL, -1, "" };
 
-    if (parsePath(pathname, &parser) != 0 || parser.index == -1) return -1;
-
-    // If the last element exists but is not a directory, return failure
-    if ( !parser.retParent[parser.index].is_directory ) return -1;
-    
-    int newDirLoc = parser.retParent[parser.index].extents->startLoc;
+    if (parsePath(pathname, &parser) != 0) return -1;
 
-    // If navigating to another directory entry, ensure cwdLoadDE is not NULL and not pointing to root.
-    // Free the old cwdLoadDE and load the new directory entry from disk.
-    if (vcb->cwdLoadDE && ( vcb->cwdLoadDE != vcb->root_dir_ptr )) {
-        freePtr((void**) &vcb->cwdLoadDE, "CWD Str Path");
-        vcb->cwdLoadDE = NULL;
+    // If the last element does not exist or is not a directory, return failure
+    if (parser.index == -1 || !parser.retParent[parser.index].is_directory) {
+        releaseDir(parser.retParent);
+        return -1;
     }
-    // If cwdLoadDE is root_dir_ptr or NULL, load new DE to cwdLoadDE
-    vcb->cwdLoadDE = loadDir(&parser.retParent[parser.index]);
+
+    // Load the new directory before the old cwd is given back, they may be the same
+    directory_entry* newCwd = loadDir(&parser.retParent[parser.index]);
+    releaseDir(parser.retParent);
+    if (!newCwd) return -1;
+
+    // The cwd holds its directory in the directory cache (root_dir_ptr is never freed)
+    releaseDir(vcb->cwdLoadDE);
+    vcb->cwdLoadDE = newCwd;
+    readaheadDir(newCwd);
     
     // Create a pointer to point to old cwd string path
     char* oldStrPath = vcb->cwdStrPath;
@@ -387,22 +466,32 @@ int fs_mkdir(const char *pathname, mode_t mode) {
     if (parsePath(pathname, &parser) != 0) return -1;
     if ( parser.index != -1 ) {
         printf("Error - mkdir: \"%s\": File exists \n", parser.retParent[parser.index].file_name);
+        releaseDir(parser.retParent);
         return -1;
     }
     
     directory_entry *newDir = createDirectory(DIRECTORY_ENTRIES, parser.retParent);
-    if (!newDir) return -1;
+    if (!newDir) {
+        releaseDir(parser.retParent);
+        return -1;
+    }
 
     int deIdx = makeDirOrFile(parser, 1, newDir);
     
-    // Nomore entry availible in parent directory
-    if (deIdx == -1) printf("Error - mkdir: Unable to create directory \n");
+    // Nomore entry availible in parent directory: the new directory has no
+    // name, its inode and blocks are released with the buffer
+    if (deIdx == -1) {
+        printf("Error - mkdir: Unable to create directory \n");
+        dirInode(newDir)->nlink = 0;
+    }
 
     /** Frees memory allocated for the new directory once the operation is complete.
         Writes the changes back to disk after updating. */
-    freePtr((void**) &newDir, "DE msf.c");
+    freeDirBuffer(newDir);
     
-    return (deIdx == -1) ? -1 : writeDirHelper(parser.retParent);
+    int status = (deIdx == -1) ? -1 : writeDirEntry(parser.retParent, deIdx);
+    releaseDir(parser.retParent);
+    return status;
 }
 
 /** Deletes a file at a specified path
@@ -432,9 +521,12 @@ int fs_isDir(char *path)
     parsepath_st parser = {NULL, -1, ""};
     int isValid = parsePath(path, &parser);
 
-    if (isValid != 0 || parser.index < 0)
+    if (isValid != 0)
         return 0;
-    return (parser.retParent[parser.index].is_directory);
+
+    int isDir = (parser.index >= 0) && parser.retParent[parser.index].is_directory;
+    releaseDir(parser.retParent);
+    return isDir;
 }
 
 /** Checks if a given path corresponds to a directory
@@ -453,6 +545,19 @@ int fs_isFile(char *path)
  * @returns 0 if path is valid, -1 if path is not valid
  * @author Arvin Ghanizadeh
  */
+// Copy the metadata of an inode into a stat buffer
+static void fillStat(inode_st *inode, struct fs_stat *buf)
+{
+    buf->st_size = inode->file_size;
+
+    buf->st_blksize = (blksize_t)4096; // this is 4 Kilobytes
+    buf->st_blocks = (buf->st_size + MINBLOCKSIZE - 1) / MINBLOCKSIZE;
+
+    buf->st_createtime = inode->creation_time;
+    buf->st_modtime = inode->modification_time;
+    buf->st_accesstime = inode->access_time;
+}
+
 int fs_stat(const char *path, struct fs_stat *buf)
 {
     if (path == NULL || buf == NULL)
@@ -470,15 +575,25 @@ int fs_stat(const char *path, struct fs_stat *buf)
         return -1;
     }
 
-    buf->st_size = parser.retParent->file_size;
-
-    buf->st_blksize = (blksize_t)4096; // this is 4 Kilobytes
-    buf->st_blocks = (buf->st_size + MINBLOCKSIZE - 1) / MINBLOCKSIZE;
+    // The entry named by the path; the directory itself when the path ends in one
+    if (parser.index == -1 && parser.lastElement[0] != '\0')
+    {
+        releaseDir(parser.retParent);
+        return -1;
+    }
+    // Its metadata is one read of the inode table away (none when already held)
+    inode_st* inode = (parser.index == -1) ? dirInode(parser.retParent) : 
+                            inodeGet(parser.retParent[parser.index].inode);
+    if (inode == NULL)
+    {
+        releaseDir(parser.retParent);
+        return -1;
+    }
 
-    buf->st_createtime = parser.retParent->creation_time;
-    buf->st_modtime = parser.retParent->modification_time;
-    buf->st_accesstime = parser.retParent->access_time;
+    fillStat(inode, buf);
 
+    if (parser.index != -1) inodePut(inode);
+    releaseDir(parser.retParent);
     return 0;
 }
 
@@ -494,6 +609,25 @@ fdDir *fs_opendir(const char *pathname)
     int isValid = parsePath(pathname, &parser);
 
     if (isValid != 0 || parser.retParent == NULL || !parser.retParent->is_directory)
+    {
+        printf("Error: no directory at %s\n", pathname);
+        if (isValid == 0) releaseDir(parser.retParent);
+        return NULL;
+    }
+
+    // The directory named by the path, the parent itself for an empty path
+    directory_entry *dir = parser.retParent;
+    if (parser.index != -1)
+    {
+        dir = loadDir(&parser.retParent[parser.index]);
+        releaseDir(parser.retParent);
+    }
+    else if (parser.lastElement[0] != '\0')
+    {
+        dir = NULL;
+        releaseDir(parser.retParent);
+    }
+    if (dir == NULL)
     {
         printf("Error: no directory at %s\n", pathname);
         return NULL;
@@ -503,13 +637,18 @@ fdDir *fs_opendir(const char *pathname)
     if (dirp == NULL)
     {
         printf("Error: fdDir malloc failed\n");
+        releaseDir(dir);
         return NULL;
     }
 
     dirp->d_reclen = sizeof(directory_entry);
     dirp->dirEntryPosition = 0;
-    dirp->de = parser.retParent;
+    dirp->de = dir; // the reference is kept until fs_closedir
     dirp->di = NULL;
+    dirCacheStreams(dir, 1); // its entries stay where dirEntryPosition finds them
+
+    // What is in the directory is likely to be opened next
+    readaheadDir(dir);
 
     return dirp;
 }
@@ -524,26 +663,22 @@ fdDir *fs_opendir(const char *pathname)
 struct fs_diriteminfo *fs_readdir(fdDir *dirp)
 {
 
-    if (dirp == NULL || dirp->de == NULL || dirp->dirEntryPosition >= sizeOfDE(dirp->de))
+    if (dirp == NULL || dirp->de == NULL)
     {
         return NULL;
     }
-    directory_entry *currentEntry;
-
-    // vcb->cwdLoadDE is only populated when CD command is invoked
-    // otherwise use loaded Root  
-    if( vcb->cwdLoadDE == NULL){
-        currentEntry = &(dirp->de[dirp->dirEntryPosition]);
-    }else{
-        currentEntry = &(vcb->cwdLoadDE[dirp->dirEntryPosition]);
-    }
 
-    // ignore unused entries
-    if (!currentEntry->is_used)
+    // ignore unused entries of the directory opened by fs_opendir (a grown
+    // directory may have many of them in a row)
+    while (dirp->dirEntryPosition < sizeOfDE(dirp->de) && !dirp->de[dirp->dirEntryPosition].is_used)
     {
         dirp->dirEntryPosition++;
-        return fs_readdir(dirp);
     }
+    if (dirp->dirEntryPosition >= sizeOfDE(dirp->de))
+    {
+        return NULL;
+    }
+    directory_entry *currentEntry = &(dirp->de[dirp->dirEntryPosition]);
 
     // printf("CURR_DIR == %s\n",currentEntry->file_name);
 
@@ -569,6 +704,54 @@ struct fs_diriteminfo *fs_readdir(fdDir *dirp)
     return dirp->di;
 }
 
+/**
+ * Retrieves up to n of the next entries of an "open" directory with their
+ * stat fields, in one pass over the directory loaded by fs_opendir: nothing
+ * is parsed or loaded again, only the inode of each entry is read.
+ * Shares its position with fs_readdir.
+ * @returns: the number of entries filled in, 0 at the end of the directory,
+ * -1 if an error occurs.
+ * @author Danish Nguyen
+ */
+int fs_readdirplus(fdDir *dirp, struct fs_direntplus *array, int n)
+{
+    if (dirp == NULL || dirp->de == NULL || array == NULL || n < 0)
+    {
+        return -1;
+    }
+
+    int nEntries = sizeOfDE(dirp->de);
+    int count = 0;
+
+    while (count < n && dirp->dirEntryPosition < nEntries)
+    {
+        directory_entry *entry = &(dirp->de[dirp->dirEntryPosition]);
+        if (!entry->is_used)
+        {
+            dirp->dirEntryPosition++;
+            continue;
+        }
+
+        // "." is the directory held by dirp, its inode is already in memory
+        inode_st *inode = (dirp->dirEntryPosition == 0) ? dirInode(dirp->de) : inodeGet(entry->inode);
+        if (inode == NULL)
+        {
+            return (count > 0) ? count : -1;
+        }
+
+        struct fs_direntplus *out = &array[count++];
+        out->di.d_reclen = dirp->d_reclen;
+        out->di.fileType = entry->is_directory ? 'D' : 'F';
+        strncpy(out->di.d_name, entry->file_name, 255);
+        out->di.d_name[255] = '\0';
+        fillStat(inode, &out->st);
+
+        if (dirp->dirEntryPosition != 0) inodePut(inode);
+        dirp->dirEntryPosition++;
+    }
+    return count;
+}
+
 /**
  * Closes an "open" directory and frees associated resources by freeing the
  * pointer to the directory or file data record structure.
@@ -587,48 +770,114 @@ int fs_closedir(fdDir *dirp)
         free(dirp->di);
     }
 
+    dirCacheStreams(dirp->de, -1);
+    releaseDir(dirp->de);
     free(dirp);
     return 0;
 }
 
 
 /** Create new file or directory
- * @returns index in parent DE on success, 0 on failure
+ * @returns index in parent DE on success, -1 on failure
  * @anchor Danish Nguyen
  */
 int makeDirOrFile(parsepath_st parser, int isDir, directory_entry* newDir){
-    /** Iterates through the parent directory to find an unused entry.
-     * Updates that entry with the last element's name and new DE metadata.*/
+    /** A new directory already has its inode; a new file gets an empty one.
+     * The entry naming it is added to the parent by linkEntry. */
 
-    time_t curTime = time(NULL);
-    
-    for (int i = 0; i < sizeOfDE(parser.retParent); i++) {
-        // Found unused directory entry
-        if (!parser.retParent[i].is_used) {
-            memset(parser.retParent[i].file_name, 0, MAX_FILENAME);
-            strncpy(parser.retParent[i].file_name, parser.lastElement, MAX_FILENAME - 1);
-
-            // Create new directory
-            if (isDir && newDir) {
-                memcpy(parser.retParent[i].extents, newDir->extents, newDir->ext_length * sizeof(extent_st));
-                parser.retParent[i].ext_length = newDir->ext_length;
-                parser.retParent[i].is_directory = 1;
-                parser.retParent[i].file_size = newDir->file_size;
-            
-            // Create a new file
-            } else {
-                parser.retParent[i].is_directory = 0;
-                parser.retParent[i].file_size = 0;
-                parser.retParent[i].ext_length = 0;
-            }
-            parser.retParent[i].is_used = 1;
-            parser.retParent[i].creation_time = curTime;
-            parser.retParent[i].access_time = curTime;
-            parser.retParent[i].modification_time = curTime;
-            return i;
-        }
+    if (isDir && newDir) return linkEntry(parser.retParent, parser.lastElement, dirInode(newDir));
+
+    inode_st* inode = inodeAlloc(0);
+    if (inode == NULL) return -1;
+
+    int i = linkEntry(parser.retParent, parser.lastElement, inode);
+
+    // Without a name the inode is released when put back
+    if (i == -1) inode->nlink = 0;
+    inodePut(inode);
+    return i;
+}
+
+/** Names an inode in a directory: takes the unused entry given by the free
+ * slot hint of the directory, growing the directory when it is full, and
+ * fills it with the name, type and inode number. The inode already counts
+ * the link. The entry is indexed but not written, the caller writes it.
+ * @returns index in parent DE on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int linkEntry(directory_entry* parent, const char* name, inode_st* inode) {
+    int i = dirIndexFreeEntry(parent);
+    if (i == -1) {
+        if (growDir(parent) == -1) return -1;
+        i = dirIndexFreeEntry(parent);
+        if (i == -1) return -1;
     }
-    return -1;
+
+    memset(parent[i].file_name, 0, MAX_FILENAME);
+    strncpy(parent[i].file_name, name, MAX_FILENAME - 1);
+
+    parent[i].inode = inode->ino;
+    parent[i].is_directory = inode->is_directory;
+    parent[i].is_used = 1;
+
+    if (dirIndexAdd(parent, i) == -1) {
+        parent[i].is_used = 0;
+        parent[i].inode = INODE_NONE;
+        return -1;
+    }
+
+    // Replaces the "not found" the lookup of this name left in the cache
+    dirCacheRemember(dirInode(parent)->ino, parent[i].file_name, i);
+    return i;
+}
+
+/** Creates a new name (newpath) for the file at oldpath. Both names share
+ * the inode: data, size and times, until one of them is removed.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int fs_link(const char *oldpath, const char *newpath) {
+    parsepath_st oldParser = { NULL, -1, "" };
+    parsepath_st newParser = { NULL, -1, "" };
+
+    if (parsePath(oldpath, &oldParser) != 0) return -1;
+    if (oldParser.index == -1 || oldParser.retParent[oldParser.index].is_directory) {
+        printf("Error - ln: \"%s\": No such file\n", oldpath);
+        releaseDir(oldParser.retParent);
+        return -1;
+    }
+
+    inode_st* inode = inodeGet(oldParser.retParent[oldParser.index].inode);
+    releaseDir(oldParser.retParent);
+    if (inode == NULL) return -1;
+
+    if (parsePath(newpath, &newParser) != 0) {
+        inodePut(inode);
+        return -1;
+    }
+    if (newParser.index != -1 || newParser.lastElement[0] == '\0') {
+        printf("Error - ln: \"%s\": File exists\n", newpath);
+        releaseDir(newParser.retParent);
+        inodePut(inode);
+        return -1;
+    }
+
+    // The inode counts the new name before any entry points to it
+    inode->nlink++;
+    int status = writeInode(inode);
+
+    int i = (status == 0) ? linkEntry(newParser.retParent, newParser.lastElement, inode) : -1;
+    if (i == -1) {
+        inode->nlink--;
+        writeInode(inode);
+        status = -1;
+    } else {
+        status = writeDirEntry(newParser.retParent, i);
+    }
+
+    inodePut(inode);
+    releaseDir(newParser.retParent);
+    return status;
 }
 
 /** Iterate through each entry in the directory and count entries that are 
@@ -658,26 +907,44 @@ int deleteBlod(const char* pathname, int isDir) {
 
     if (parser.index == -1) {
         printf("rm: %s: No such file or directory\n", parser.lastElement );
+        releaseDir(parser.retParent);
         return -1; // Can not remove not exist dir
     }
 
-    if (parser.retParent[parser.index].is_directory != isDir) return -1;
+    if (parser.retParent[parser.index].is_directory != isDir) {
+        releaseDir(parser.retParent);
+        return -1;
+    }
 
     // If target is a directory, loaded to memory and check if it's empty
+    uint32_t removeIno = parser.retParent[parser.index].inode;
     if (isDir) { // isDir <=> 1
         directory_entry *removeDir = loadDir(&parser.retParent[parser.index]);
         
         // Ensure it can be loaded and is empty before deleting
         if ( !removeDir || !isDirEmpty(removeDir)) {
             printf("Cannot remove '%s': Is a directory and not empty\n", parser.retParent[parser.index].file_name);
+            releaseDir(removeDir);
+            releaseDir(parser.retParent);
             return -1;
         }
-        freePtr((void**) &removeDir, "Free rm dir");
+        releaseDir(removeDir);
     }
 
-    // Mark the target directory/file entry as unused in its parent metadata
-    int status = removeDE(parser.retParent, parser.index, 0);
-
-    // Update the parent directory on disk with the changes
-    return (status == -1) ? -1 : writeDirHelper(parser.retParent);
+    // Take the name out of the index while the entry still holds it, then mark
+    // the target directory/file entry as unused in its parent metadata; its
+    // inode is released once this was its last name and nobody holds it
+    int status = dirIndexRemove(parser.retParent, parser.index);
+    if (status == 0) status = removeDE(parser.retParent, parser.index);
+
+    // The name is gone from the parent, and a removed directory from the cache
+    dirCacheForget(dirInode(parser.retParent)->ino, parser.lastElement);
+    if (isDir) dirCacheInvalidate(removeIno);
+
+    // Update the entry in the parent directory on disk, then give back the
+    // blocks of a parent left mostly empty
+    if (status == 0) status = writeDirEntry(parser.retParent, parser.index);
+    if (status == 0) status = shrinkDir(parser.retParent);
+    releaseDir(parser.retParent);
+    return status;
 }
\ No newline at end of file
@@ -56,6 +56,7 @@ char* cleanPath(const char* srcPath);
 int isDirEmpty(directory_entry *de);
 int deleteBlod(const char* pathname, int isDir);
 int makeDirOrFile(parsepath_st parser, int isDir, directory_entry* newDir);
+int linkEntry(directory_entry* parent, const char* name, inode_st* inode);
 
 
 // This structure is returned by fs_readdir to provide the caller with information
@@ -95,6 +96,7 @@ int fs_setcwd(char *pathname);   //linux chdir
 int fs_isFile(char * filename);	//return 1 if file, 0 otherwise
 int fs_isDir(char * pathname);		//return 1 if directory, 0 otherwise
 int fs_delete(const char* filename);	//removes a file
+int fs_link(const char* oldpath, const char* newpath);	//adds a name to a file
 
 
 // This is the strucutre that is filled in from a call to fs_stat
@@ -110,5 +112,14 @@ struct fs_stat
 
 int fs_stat(const char *path, struct fs_stat *buf);
 
+// An entry of a directory with its metadata, filled in by fs_readdirplus
+struct fs_direntplus
+	{
+	struct fs_diriteminfo di;	/* name and type, as returned by fs_readdir */
+	struct fs_stat st;			/* as filled in by fs_stat */
+	};
+
+int fs_readdirplus(fdDir *dirp, struct fs_direntplus *array, int n);
+
 #endif
 
@@ -0,0 +1,562 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: AsyncIO.c
+*
+* Description:: Asynchronous block I/O engine. Completion is tracked per
+* batch. The prebuilt fsLow.o shares one file offset between lseek and
+* read/write, so with that backend the engine opens the volume file a
+* second time and addresses blocks by offset: submitted requests go to
+* an io_uring ring, whose completions a reaper thread collects, or into
+* a bounded queue served by pthread workers issuing pread/pwrite when
+* the ring can not be set up. Without the second descriptor the LBA
+* calls of fsLow.o take turns behind a lock. With the mmap backend
+* (FSLOW_MMAP) the workers copy blocks in parallel.
+*
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "structs/AsyncIO.h"
+
+/* The io_uring ring, mapped from the kernel (no liburing needed)
+ * - fd: ring descriptor, -1 when there is no ring
+ * - sqHead ... cqes: fields of the submission and completion rings
+ * - sqMap / cqMap / sqeMap and their lengths: the three mappings, cqMap is
+ *   sqMap when the kernel maps both rings at once */
+typedef struct aio_ring_st {
+    int fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void *sqMap, *cqMap, *sqeMap;
+    size_t sqMapLen, cqMapLen, sqeMapLen;
+} aio_ring_st;
+
+static pthread_t workers[AIO_MAX_WORKERS];
+static int nRunning = 0;    // number of worker threads started
+static int stopping = 0;    // set by exitAsyncIO to end the workers
+
+static aio_req_st* queue[AIO_QUEUE_DEPTH]; // circular queue of requests
+static int qHead = 0;
+static int qCount = 0;
+
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t notFull = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t completed = PTHREAD_COND_INITIALIZER;
+
+#ifndef FSLOW_MMAP
+static pthread_mutex_t lbaLock = PTHREAD_MUTEX_INITIALIZER; // fsLow.o is not thread safe
+#endif
+
+static int volumeFd = -1;       // private descriptor of the volume file, -1 if not open
+static uint64_t volBlockSize = 0;
+static uint64_t volBlocks = 0;
+
+static aio_ring_st ring = { -1 };
+static pthread_t reaper;
+static int ringRunning = 0;     // 1 while the reaper thread runs
+static int ringInFlight = 0;    // requests in the ring, guarded by queueLock
+static pthread_mutex_t sqLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Both backends: with mmap a write can run during a snapshot read as well
+static pthread_mutex_t genLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t writeGen = 0;   // bumped when a write starts and when it ends
+static int writesActive = 0;    // writes started and not ended yet
+
+static void* workerMain(void* arg);
+static void runRequest(aio_req_st* req);
+static void completeRequest(aio_req_st* req);
+static uint64_t transferv(int op, lba_seg_st* segs, int nSegs);
+static void bumpWriteGen(int started);
+static uint64_t clampCount(uint64_t lbaCount, uint64_t lbaPosition);
+static uint64_t fdTransfer(int op, void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+static int setupRing();
+static void closeRing();
+static int ringSubmit(aio_req_st* req);
+static void* reaperMain(void* arg);
+static void ringComplete(aio_req_st* req, int res);
+
+/** Opens the volume file for the engine, so requests address blocks by offset
+ * instead of going through the shared file position of fsLow.o. Must be called
+ * with the path given to startPartitionSystem, before initAsyncIO. The mmap
+ * backend has no use for it.
+ * @return 0 on success, -1 if the LBA calls are used
+ * @author Danish Nguyen
+ */
+int initVolumeIO(const char* volumePath, uint64_t blockSize, uint64_t numberOfBlocks) {
+#ifdef FSLOW_MMAP
+    return -1;
+#else
+    if (volumeFd != -1) close(volumeFd);
+
+    volumeFd = open(volumePath, O_RDWR);
+    if (volumeFd == -1) return -1;
+
+    volBlockSize = blockSize;
+    volBlocks = numberOfBlocks;
+    return 0;
+#endif
+}
+
+/** Starts the io_uring reaper when the volume file is open and the kernel
+ * has io_uring, the worker pool otherwise. With 0 workers every request runs
+ * synchronously inside asyncSubmit.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int initAsyncIO(int nWorkers) {
+    if (nRunning > 0 || ringRunning) return 0;
+    if (nWorkers > AIO_MAX_WORKERS) nWorkers = AIO_MAX_WORKERS;
+
+    stopping = 0;
+    if (volumeFd != -1 && nWorkers > 0 && setupRing() == 0) {
+        if (pthread_create(&reaper, NULL, reaperMain, NULL) == 0) {
+            ringRunning = 1;
+            return 0;
+        }
+        closeRing();
+    }
+
+    for (int i = 0; i < nWorkers; i++) {
+        if (pthread_create(&workers[i], NULL, workerMain, NULL) != 0) {
+            printf("Unable to start I/O worker %d\n", i);
+            break;
+        }
+        nRunning++;
+    }
+    return (nWorkers > 0 && nRunning == 0) ? -1 : 0;
+}
+
+/** Lets the workers or the ring finish the queued requests, stops them and
+ * closes the volume file opened by initVolumeIO */
+void exitAsyncIO() {
+    pthread_mutex_lock(&queueLock);
+    stopping = 1;
+    pthread_cond_broadcast(&notEmpty);
+    pthread_mutex_unlock(&queueLock);
+
+    for (int i = 0; i < nRunning; i++) pthread_join(workers[i], NULL);
+    nRunning = 0;
+
+    if (ringRunning) {
+        // A request without a caller tells the reaper to stop once the ring is empty
+        if (ringSubmit(NULL) == 0) pthread_join(reaper, NULL);
+        else pthread_cancel(reaper);
+        ringRunning = 0;
+        closeRing();
+    }
+    if (volumeFd != -1) close(volumeFd);
+    volumeFd = -1;
+}
+
+/** Queues one request of a batch. Blocks while the queue is full.
+ * @return 0 on success, -1 on invalid request
+ */
+int asyncSubmit(aio_batch_st* batch, aio_req_st* req) {
+    if (!batch || !req || (req->op != AIO_READ && req->op != AIO_WRITE)) return -1;
+
+    req->batch = batch;
+    req->ioClass = ioGetClass();
+    req->result = 0;
+    req->done = 0;
+    req->started = 0;
+
+    pthread_mutex_lock(&queueLock);
+    batch->pending++;
+
+    if (ringRunning) {
+        while (ringInFlight == AIO_QUEUE_DEPTH) pthread_cond_wait(&notFull, &queueLock);
+        ringInFlight++;
+        pthread_mutex_unlock(&queueLock);
+
+        // Requests the ring does not take run here
+        if (ringSubmit(req) == -1) ringComplete(req, -1);
+        return 0;
+    }
+
+    // No worker to hand the request to, run it now
+    if (nRunning == 0) {
+        pthread_mutex_unlock(&queueLock);
+        runRequest(req);
+        completeRequest(req);
+        return 0;
+    }
+
+    while (qCount == AIO_QUEUE_DEPTH) pthread_cond_wait(&notFull, &queueLock);
+
+    queue[(qHead + qCount) % AIO_QUEUE_DEPTH] = req;
+    qCount++;
+
+    pthread_cond_signal(&notEmpty);
+    pthread_mutex_unlock(&queueLock);
+    return 0;
+}
+
+/** Queues every request of the batch
+ * @return 0 on success, -1 if a request is invalid */
+int asyncSubmitAll(aio_batch_st* batch) {
+    for (int i = 0; i < batch->count; i++) {
+        if (asyncSubmit(batch, &batch->reqs[i]) == -1) return -1;
+    }
+    return 0;
+}
+
+/** Non blocking check on a batch
+ * @return number of requests of the batch that are still in flight */
+int asyncPending(aio_batch_st* batch) {
+    pthread_mutex_lock(&queueLock);
+    int pending = batch->pending;
+    pthread_mutex_unlock(&queueLock);
+    return pending;
+}
+
+/** Blocks until every submitted request of the batch has completed
+ * @return 0 if all requests transferred all their blocks, -1 otherwise
+ */
+int asyncWait(aio_batch_st* batch) {
+    pthread_mutex_lock(&queueLock);
+    while (batch->pending > 0) pthread_cond_wait(&completed, &queueLock);
+    int failed = batch->failed;
+    pthread_mutex_unlock(&queueLock);
+    return (failed > 0) ? -1 : 0;
+}
+
+/** Vectored LBAread: reads every segment in a single submission
+ * @return total number of blocks read over all segments */
+uint64_t LBAreadv(lba_seg_st* segs, int nSegs) {
+    return transferv(AIO_READ, segs, nSegs);
+}
+
+/** Vectored LBAwrite: writes every segment in a single submission
+ * @return total number of blocks written over all segments */
+uint64_t LBAwritev(lba_seg_st* segs, int nSegs) {
+    return transferv(AIO_WRITE, segs, nSegs);
+}
+
+/** Synchronous LBAread that can safely run while workers are busy
+ * @return number of blocks read */
+uint64_t lockedLBAread(void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    aio_req_st req = { AIO_READ, buffer, lbaCount, lbaPosition, 0, 0, NULL, ioGetClass() };
+    runRequest(&req);
+    return req.result;
+}
+
+/** Synchronous LBAread that also tells which state of the disk it saw: the
+ * write generation in *gen. The data is current as long as lbaWriteGeneration()
+ * still returns it.
+ * @return number of blocks read, 0 if a write ran meanwhile (the data may be torn)
+ */
+uint64_t snapshotLBAread(void* buffer, uint64_t lbaCount, uint64_t lbaPosition, uint64_t* gen) {
+    pthread_mutex_lock(&genLock);
+    int busy = writesActive;
+    *gen = writeGen;
+    pthread_mutex_unlock(&genLock);
+    if (busy) return 0;
+
+    uint64_t result = lockedLBAread(buffer, lbaCount, lbaPosition);
+    return (lbaWriteGeneration() == *gen) ? result : 0;
+}
+
+// @return the write generation: it changes whenever a block write starts or ends
+uint64_t lbaWriteGeneration() {
+    pthread_mutex_lock(&genLock);
+    uint64_t gen = writeGen;
+    pthread_mutex_unlock(&genLock);
+    return gen;
+}
+
+/** Synchronous LBAwrite that can safely run while workers are busy
+ * @return number of blocks written */
+uint64_t lockedLBAwrite(void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    aio_req_st req = { AIO_WRITE, buffer, lbaCount, lbaPosition, 0, 0, NULL, ioGetClass() };
+    runRequest(&req);
+    return req.result;
+}
+
+// Worker loop: take the oldest request, run it, report its completion
+static void* workerMain(void* arg) {
+    while (1) {
+        pthread_mutex_lock(&queueLock);
+        while (qCount == 0 && !stopping) pthread_cond_wait(&notEmpty, &queueLock);
+
+        if (qCount == 0 && stopping) {
+            pthread_mutex_unlock(&queueLock);
+            return NULL;
+        }
+        aio_req_st* req = queue[qHead];
+        qHead = (qHead + 1) % AIO_QUEUE_DEPTH;
+        qCount--;
+
+        pthread_cond_signal(&notFull);
+        pthread_mutex_unlock(&queueLock);
+
+        runRequest(req);
+        completeRequest(req);
+    }
+}
+
+// Issue the I/O of a request and charge it to the request's I/O class
+static void runRequest(aio_req_st* req) {
+    if (req->op == AIO_WRITE) bumpWriteGen(1);
+    uint64_t start = ioClockNanos();
+
+    if (volumeFd != -1) {
+        req->result = fdTransfer(req->op, req->buffer, req->lbaCount, req->lbaPosition);
+    } else {
+#ifndef FSLOW_MMAP
+        pthread_mutex_lock(&lbaLock);
+#endif
+        if (req->op == AIO_READ) {
+            req->result = LBAread(req->buffer, req->lbaCount, req->lbaPosition);
+        } else {
+            req->result = LBAwrite(req->buffer, req->lbaCount, req->lbaPosition);
+        }
+#ifndef FSLOW_MMAP
+        pthread_mutex_unlock(&lbaLock);
+#endif
+    }
+    uint64_t elapsed = ioClockNanos() - start;
+    if (req->op == AIO_WRITE) bumpWriteGen(0);
+    ioRecord(req->ioClass, req->op, req->result, elapsed);
+}
+
+// A write changes the generation before it reaches the disk and after it is done
+static void bumpWriteGen(int started) {
+    pthread_mutex_lock(&genLock);
+    writeGen++;
+    writesActive += started ? 1 : -1;
+    pthread_mutex_unlock(&genLock);
+}
+
+// Mark a request done and wake up anyone waiting on its batch
+static void completeRequest(aio_req_st* req) {
+    pthread_mutex_lock(&queueLock);
+    req->done = 1;
+    if (req->result < req->lbaCount) req->batch->failed++;
+    req->batch->pending--;
+    pthread_cond_broadcast(&completed);
+    pthread_mutex_unlock(&queueLock);
+}
+
+// Turn the segments into one batch, submit it and wait for all of it
+static uint64_t transferv(int op, lba_seg_st* segs, int nSegs) {
+    if (!segs || nSegs < 1) return 0;
+
+    aio_req_st* reqs = malloc(nSegs * sizeof(aio_req_st));
+    if (!reqs) return 0;
+
+    aio_batch_st batch = { reqs, nSegs, 0, 0 };
+    for (int i = 0; i < nSegs; i++) {
+        reqs[i] = (aio_req_st) { op, segs[i].buffer, segs[i].lbaCount, segs[i].lbaPosition };
+    }
+
+    // Requests left unsubmitted by a failure keep a result of 0
+    asyncSubmitAll(&batch);
+    asyncWait(&batch);
+
+    uint64_t total = 0;
+    for (int i = 0; i < nSegs; i++) total += reqs[i].result;
+    free(reqs);
+    return total;
+}
+
+// @return the part of lbaCount blocks at lbaPosition that lies on the volume
+static uint64_t clampCount(uint64_t lbaCount, uint64_t lbaPosition) {
+    if (lbaPosition >= volBlocks) return 0;
+    return (lbaCount > volBlocks - lbaPosition) ? volBlocks - lbaPosition : lbaCount;
+}
+
+/** pread/pwrite of whole blocks on the private descriptor. The first block of
+ * the volume file is the partition header, as with fsLow.o.
+ * @return number of blocks transferred
+ */
+static uint64_t fdTransfer(int op, void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    lbaCount = clampCount(lbaCount, lbaPosition);
+    if (lbaCount == 0 || buffer == NULL) return 0;
+
+    size_t length = lbaCount * volBlockSize;
+    off_t offset = (off_t) (lbaPosition + 1) * volBlockSize;
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t n = (op == AIO_READ) ? pread(volumeFd, (char*) buffer + done, length - done, offset + done)
+                                     : pwrite(volumeFd, (char*) buffer + done, length - done, offset + done);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    return done / volBlockSize;
+}
+
+/** Sets up an io_uring ring of AIO_QUEUE_DEPTH entries
+ * @return 0 on success, -1 if the kernel has no io_uring (the workers are used)
+ */
+static int setupRing() {
+#ifdef __NR_io_uring_setup
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring.fd = syscall(__NR_io_uring_setup, AIO_QUEUE_DEPTH, &params);
+    if (ring.fd < 0) {
+        ring.fd = -1;
+        return -1;
+    }
+
+    ring.sqMapLen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cqMapLen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && ring.cqMapLen > ring.sqMapLen) ring.sqMapLen = ring.cqMapLen;
+
+    ring.sqMap = mmap(NULL, ring.sqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring.fd, IORING_OFF_SQ_RING);
+    ring.cqMap = single ? ring.sqMap : mmap(NULL, ring.cqMapLen, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+    ring.sqeMapLen = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqeMap = mmap(NULL, ring.sqeMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring.fd, IORING_OFF_SQES);
+    if (ring.sqMap == MAP_FAILED || ring.cqMap == MAP_FAILED || ring.sqeMap == MAP_FAILED) {
+        closeRing();
+        return -1;
+    }
+
+    char* sq = ring.sqMap;
+    char* cq = ring.cqMap;
+    ring.sqHead = (unsigned*) (sq + params.sq_off.head);
+    ring.sqTail = (unsigned*) (sq + params.sq_off.tail);
+    ring.sqMask = (unsigned*) (sq + params.sq_off.ring_mask);
+    ring.sqArray = (unsigned*) (sq + params.sq_off.array);
+    ring.cqHead = (unsigned*) (cq + params.cq_off.head);
+    ring.cqTail = (unsigned*) (cq + params.cq_off.tail);
+    ring.cqMask = (unsigned*) (cq + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+    ring.sqes = ring.sqeMap;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+// Unmap and close the ring
+static void closeRing() {
+    if (ring.fd == -1) return;
+
+    if (ring.sqeMap && ring.sqeMap != MAP_FAILED) munmap(ring.sqeMap, ring.sqeMapLen);
+    if (ring.cqMap && ring.cqMap != MAP_FAILED && ring.cqMap != ring.sqMap) munmap(ring.cqMap, ring.cqMapLen);
+    if (ring.sqMap && ring.sqMap != MAP_FAILED) munmap(ring.sqMap, ring.sqMapLen);
+    close(ring.fd);
+    ring = (aio_ring_st) { -1 };
+}
+
+/** Puts one request in the submission ring and submits it. NULL submits the
+ * no-op that stops the reaper.
+ * @return 0 on success, -1 if the ring did not take the request
+ */
+static int ringSubmit(aio_req_st* req) {
+    uint64_t count = req ? clampCount(req->lbaCount, req->lbaPosition) : 0;
+    if (req && (count == 0 || req->buffer == NULL)) return -1;
+
+    pthread_mutex_lock(&sqLock);
+    unsigned tail = *ring.sqTail;
+    unsigned index = tail & *ring.sqMask;
+
+    struct io_uring_sqe* sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    if (req) {
+        if (req->op == AIO_WRITE) bumpWriteGen(1);
+        req->started = ioClockNanos();
+
+        sqe->opcode = (req->op == AIO_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe->fd = volumeFd;
+        sqe->addr = (uint64_t) (uintptr_t) req->buffer;
+        sqe->len = count * volBlockSize;
+        sqe->off = (req->lbaPosition + 1) * volBlockSize;
+    } else {
+        sqe->opcode = IORING_OP_NOP;
+    }
+    sqe->user_data = (uint64_t) (uintptr_t) req;
+    ring.sqArray[index] = index;
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    int submitted;
+    do {
+        submitted = syscall(__NR_io_uring_enter, ring.fd, 1, 0, 0, NULL, 0);
+    } while (submitted == -1 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+
+    // Not consumed by the kernel: take it back
+    if (submitted != 1) {
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+        if (req && req->op == AIO_WRITE) bumpWriteGen(0);
+        if (req) req->started = 0;
+    }
+    pthread_mutex_unlock(&sqLock);
+    return (submitted == 1) ? 0 : -1;
+}
+
+// Reaper loop: wait for completions and finish their requests
+static void* reaperMain(void* arg) {
+    int stopSeen = 0;
+
+    while (1) {
+        pthread_mutex_lock(&queueLock);
+        int idle = (ringInFlight == 0);
+        pthread_mutex_unlock(&queueLock);
+        if (stopSeen && idle) return NULL;
+
+        syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+            aio_req_st* req = (aio_req_st*) (uintptr_t) cqe->user_data;
+            int res = cqe->res;
+            __atomic_store_n(ring.cqHead, ++head, __ATOMIC_RELEASE);
+
+            if (req) ringComplete(req, res);
+            else stopSeen = 1;
+        }
+    }
+}
+
+/** Finishes a request of the ring given the bytes transferred (res < 0 when it
+ * failed or was not submitted). A short transfer is completed synchronously.
+ */
+static void ringComplete(aio_req_st* req, int res) {
+    if (res < 0) {
+        // Not run by the ring, or failed there: run it here
+        if (req->started && req->op == AIO_WRITE) bumpWriteGen(0);
+        runRequest(req);
+    } else {
+        uint64_t done = res / volBlockSize;
+        if (done < req->lbaCount) {
+            done += fdTransfer(req->op, (char*) req->buffer + done * volBlockSize,
+                               req->lbaCount - done, req->lbaPosition + done);
+        }
+        req->result = done;
+        if (req->op == AIO_WRITE) bumpWriteGen(0);
+        ioRecord(req->ioClass, req->op, req->result, ioClockNanos() - req->started);
+    }
+
+    pthread_mutex_lock(&queueLock);
+    ringInFlight--;
+    pthread_cond_signal(&notFull);
+    pthread_mutex_unlock(&queueLock);
+    completeRequest(req);
+}
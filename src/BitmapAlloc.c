@@ -0,0 +1,361 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: BitmapAlloc.c
+*
+* Description:: Hierarchical bitmap allocator. A request is first served
+* by a single free run, searched next-fit from the end of the previous
+* allocation; when no run is long enough it takes runs of at least
+* minContinuous blocks in address order. Release checks that every
+* block of the range is in use before freeing it.
+*
+**************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "structs/BitmapAlloc.h"
+#include "structs/fs_utils.h"
+
+static uint64_t* words = NULL;          // level 0, owned by the caller
+static uint16_t* chunkFree = NULL;      // level 1, free blocks per chunk
+static int nBits = 0;
+static int nWords = 0;
+static int nChunks = 0;
+static int totalFree = 0;
+static int rotor = 0;                   // where the next single-run search starts
+
+// Number of leading words of an array equal to a pattern (0 or ~0)
+static size_t (*countEqual)(const uint64_t* w, size_t n, uint64_t pattern) = NULL;
+
+static int findRun(int from, int minLen, int want, int* runLength);
+static int rangeIs(int start, int count, int isFree);
+static void setRange(int start, int count, int isFree);
+static int allocChunks();
+static void selectScanner();
+
+static size_t countEqualScalar(const uint64_t* w, size_t n, uint64_t pattern);
+#if defined(__x86_64__) || defined(__i386__)
+static size_t countEqualSSE2(const uint64_t* w, size_t n, uint64_t pattern);
+static size_t countEqualAVX2(const uint64_t* w, size_t n, uint64_t pattern);
+#endif
+
+/** Starts a bitmap for a new volume: blocks below firstFree are in use and
+ * the rest of the volume is free. bitmap must hold bitmapBytes(numberOfBits) bytes.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int bitmapInit(uint64_t* bitmap, int numberOfBits, int firstFree) {
+    bitmapDestroy();
+    words = bitmap;
+    nBits = numberOfBits;
+    if (allocChunks() == -1) return -1;
+
+    memset(words, 0, bitmapBytes(nBits));
+    setRange(firstFree, nBits - firstFree, 1);
+    return 0;
+}
+
+/** Builds the chunk counters of a bitmap read from disk
+ * @return number of free blocks, -1 on failure
+ * @author Danish Nguyen
+ */
+int bitmapLoad(uint64_t* bitmap, int numberOfBits) {
+    bitmapDestroy();
+    words = bitmap;
+    nBits = numberOfBits;
+    if (allocChunks() == -1) return -1;
+
+    // Bits past the end of the volume never describe free blocks
+    if (nBits % BITMAP_WORD_BITS) words[nWords - 1] &= (1ULL << (nBits % BITMAP_WORD_BITS)) - 1;
+
+    for (int w = 0; w < nWords; w++) {
+        int freeBits = __builtin_popcountll(words[w]);
+        chunkFree[w / BITMAP_CHUNK_WORDS] += freeBits;
+        totalFree += freeBits;
+    }
+    return totalFree;
+}
+
+/** Releases the chunk counters; the bitmap itself belongs to the caller */
+void bitmapDestroy() {
+    free(chunkFree);
+    chunkFree = NULL;
+    words = NULL;
+    nBits = nWords = nChunks = 0;
+    totalFree = 0;
+    rotor = 0;
+}
+
+/** Allocates nBlocks, as one run when possible, otherwise as several runs of
+ * at least minContinuous blocks (the last one may be shorter). The search for 
+ * a single run starts at goal, or at the rotor when there is no goal (-1).
+ * @return extents allocated, { NULL, 0 } on failure
+ * @author Danish Nguyen
+ */
+extents_st bitmapAllocate(int nBlocks, int minContinuous, int goal) {
+    extents_st reqBlocks = { NULL, 0 };
+    if (nBlocks < 1 || nBlocks > totalFree || nBlocks < minContinuous) return reqBlocks;
+
+    int from = (goal >= 0 && goal < nBits) ? goal : rotor;
+
+    int runLength;
+    int start = findRun(from, nBlocks, nBlocks, &runLength);
+    if (start == -1 && from > 0) start = findRun(0, nBlocks, nBlocks, &runLength);
+
+    if (start != -1) {
+        reqBlocks.extents = malloc(sizeof(extent_st));
+        if (!reqBlocks.extents) return reqBlocks;
+
+        reqBlocks.extents[reqBlocks.size++] = (extent_st) { start, nBlocks };
+        setRange(start, nBlocks, 0);
+        rotor = (start + nBlocks < nBits) ? start + nBlocks : 0;
+        return reqBlocks;
+    }
+
+    // No single run is long enough: collect runs in address order
+    int capacity = 4;
+    reqBlocks.extents = malloc(capacity * sizeof(extent_st));
+    if (!reqBlocks.extents) return reqBlocks;
+
+    int remain = nBlocks;
+    int pos = 0;
+    while (remain > 0) {
+        start = findRun(pos, max(minContinuous, 1), remain, &runLength);
+        if (start == -1) break;
+
+        if (reqBlocks.size == capacity) {
+            capacity *= 2;
+            extent_st* grown = realloc(reqBlocks.extents, capacity * sizeof(extent_st));
+            if (!grown) break;
+            reqBlocks.extents = grown;
+        }
+        reqBlocks.extents[reqBlocks.size++] = (extent_st) { start, runLength };
+        setRange(start, runLength, 0);
+
+        remain -= runLength;
+        pos = start + runLength;
+    }
+
+    if (remain > 0) {
+        for (int i = 0; i < reqBlocks.size; i++) {
+            setRange(reqBlocks.extents[i].startLoc, reqBlocks.extents[i].countBlock, 1);
+        }
+        free(reqBlocks.extents);
+        return (extents_st) { NULL, 0 };
+    }
+    return reqBlocks;
+}
+
+/** Marks a run of blocks free
+ * @return 0 on success, -1 if the range is outside the volume or overlaps free space
+ * @author Danish Nguyen
+ */
+int bitmapRelease(int startLoc, int countBlock) {
+    if (countBlock < 1 || startLoc < 0 || startLoc + countBlock > nBits) return -1;
+
+    if (!rangeIs(startLoc, countBlock, 0)) {
+        printf("--- WARNING: Extent is overlap, check your system ---\n");
+        return -1;
+    }
+    setRange(startLoc, countBlock, 1);
+    return 0;
+}
+
+int bitmapFreeBlocks() {
+    return totalFree;
+}
+
+/** Counts the runs of free blocks: a run starts at every free bit whose 
+ * previous bit (the top bit of the previous word for bit 0) is used
+ * @return number of free extents
+ */
+int bitmapExtentCount() {
+    int runs = 0;
+    uint64_t carry = 0;
+
+    for (int w = 0; w < nWords; w++) {
+        if (chunkFree[w / BITMAP_CHUNK_WORDS] == 0) {
+            w = (w / BITMAP_CHUNK_WORDS + 1) * BITMAP_CHUNK_WORDS - 1;
+            carry = 0;
+            continue;
+        }
+        runs += __builtin_popcountll(words[w] & ~((words[w] << 1) | carry));
+        carry = words[w] >> (BITMAP_WORD_BITS - 1);
+    }
+    return runs;
+}
+
+// @return bytes of the level 0 bitmap for nBits blocks (whole words)
+int bitmapBytes(int numberOfBits) {
+    return ((numberOfBits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS) * sizeof(uint64_t);
+}
+
+/** Finds the first run of at least minLen free blocks starting at or after
+ * block from. Counting stops once the run reaches want blocks.
+ * @return start of the run and its length (at most want) in runLength, -1 if none
+ */
+static int findRun(int from, int minLen, int want, int* runLength) {
+    int runStart = -1;
+    int runLen = 0;
+    int firstWord = from / BITMAP_WORD_BITS;
+
+    for (int w = firstWord; w < nWords; ) {
+        int chunk = w / BITMAP_CHUNK_WORDS;
+        int chunkEnd = min((chunk + 1) * BITMAP_CHUNK_WORDS, nWords);
+
+        // Level 1: a chunk without free blocks ends the run and is skipped whole
+        if (chunkFree[chunk] == 0) {
+            if (runLen >= minLen) break;
+            runLen = 0;
+            w = chunkEnd;
+            continue;
+        }
+
+        uint64_t word = words[w];
+        if (w == firstWord) word &= ~0ULL << (from % BITMAP_WORD_BITS);
+
+        if (word == 0) {
+            if (runLen >= minLen) break;
+            runLen = 0;
+            w += 1 + countEqual(words + w + 1, chunkEnd - w - 1, 0);
+            continue;
+        }
+
+        if (word == ~0ULL) {
+            if (runLen == 0) runStart = w * BITMAP_WORD_BITS;
+            int fullWords = 1 + countEqual(words + w + 1, chunkEnd - w - 1, ~0ULL);
+            runLen += fullWords * BITMAP_WORD_BITS;
+            w += fullWords;
+            if (runLen >= want) break;
+            continue;
+        }
+
+        // Mixed word: walk its runs of free (1) and used (0) bits
+        for (int pos = 0; pos < BITMAP_WORD_BITS; ) {
+            uint64_t rest = word >> pos;
+            if (rest & 1) {
+                int ones = __builtin_ctzll(~rest);
+                if (runLen == 0) runStart = w * BITMAP_WORD_BITS + pos;
+                runLen += ones;
+                pos += ones;
+                if (runLen >= want) goto found;
+            } else {
+                if (runLen >= minLen) goto found;
+                runLen = 0;
+                pos += rest ? __builtin_ctzll(rest) : BITMAP_WORD_BITS - pos;
+            }
+        }
+        w++;
+    }
+
+found:
+    if (runLen < minLen) return -1;
+    *runLength = min(runLen, want);
+    return runStart;
+}
+
+// Mask of bits [lo, hi) of a word
+static uint64_t bitMask(int lo, int hi) {
+    uint64_t bits = (hi - lo == BITMAP_WORD_BITS) ? ~0ULL : (1ULL << (hi - lo)) - 1;
+    return bits << lo;
+}
+
+// @return 1 if every block of the range is free (isFree = 1) or used (isFree = 0)
+static int rangeIs(int start, int count, int isFree) {
+    for (int bit = start, end = start + count; bit < end; ) {
+        int w = bit / BITMAP_WORD_BITS;
+        int lo = bit % BITMAP_WORD_BITS;
+        int hi = min(BITMAP_WORD_BITS, lo + (end - bit));
+        uint64_t mask = bitMask(lo, hi);
+
+        if ((words[w] & mask) != (isFree ? mask : 0)) return 0;
+        bit += hi - lo;
+    }
+    return 1;
+}
+
+// Flag a range free (1) or used (0) and keep the chunk counters in step
+static void setRange(int start, int count, int isFree) {
+    for (int bit = start, end = start + count; bit < end; ) {
+        int w = bit / BITMAP_WORD_BITS;
+        int lo = bit % BITMAP_WORD_BITS;
+        int hi = min(BITMAP_WORD_BITS, lo + (end - bit));
+        uint64_t mask = bitMask(lo, hi);
+
+        uint64_t changed = isFree ? (~words[w] & mask) : (words[w] & mask);
+        int delta = __builtin_popcountll(changed);
+
+        words[w] = isFree ? (words[w] | mask) : (words[w] & ~mask);
+        chunkFree[w / BITMAP_CHUNK_WORDS] += isFree ? delta : -delta;
+        totalFree += isFree ? delta : -delta;
+        bit += hi - lo;
+    }
+}
+
+static int allocChunks() {
+    nWords = (nBits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+    nChunks = (nWords + BITMAP_CHUNK_WORDS - 1) / BITMAP_CHUNK_WORDS;
+
+    chunkFree = calloc(nChunks, sizeof(uint16_t));
+    if (!chunkFree) {
+        printf("ERROR - Unable to allocate bitmap chunk counters\n");
+        return -1;
+    }
+    selectScanner();
+    return 0;
+}
+
+// Pick the widest compare the CPU supports
+static void selectScanner() {
+    if (countEqual) return;
+    countEqual = countEqualScalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) countEqual = countEqualAVX2;
+    else if (__builtin_cpu_supports("sse2")) countEqual = countEqualSSE2;
+#endif
+}
+
+static size_t countEqualScalar(const uint64_t* w, size_t n, uint64_t pattern) {
+    size_t i = 0;
+    while (i < n && w[i] == pattern) i++;
+    return i;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Two words per compare
+__attribute__((target("sse2")))
+static size_t countEqualSSE2(const uint64_t* w, size_t n, uint64_t pattern) {
+    __m128i p = _mm_set1_epi64x((long long) pattern);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (w + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, p)) != 0xFFFF) break;
+    }
+    return i + countEqualScalar(w + i, n - i, pattern);
+}
+
+// Four words per compare
+__attribute__((target("avx2")))
+static size_t countEqualAVX2(const uint64_t* w, size_t n, uint64_t pattern) {
+    __m256i p = _mm256_set1_epi64x((long long) pattern);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (w + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(v, p)) != -1) break;
+    }
+    return i + countEqualScalar(w + i, n - i, pattern);
+}
+#endif
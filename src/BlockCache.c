@@ -0,0 +1,902 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: BlockCache.c
+*
+* Description:: Write-back block cache that sits between the file system
+* and LBAread/LBAwrite. Every layer (directories, free space map, VCB and
+* file data) reads and writes blocks through cacheRead/cacheWrite, so the
+* same metadata blocks are served from memory instead of the volume file.
+* Dirty blocks are written back on eviction or by cacheFlush, and runs of
+* adjacent dirty blocks are coalesced into a single LBAwrite. Batches of
+* requests can be submitted through cacheSubmit/cacheWait, which serve what
+* they can from memory and hand the rest to the async I/O engine; the
+* vectored cacheReadv/cacheWritev hand it to LBAreadv/LBAwritev.
+*
+* When a journal is attached (cacheSetJournal) dirty metadata blocks are
+* pinned until the journal has committed them: they are never written
+* to their home location while pending, and a committed block is
+* written home before it is modified again, so every committed version
+* that is not home yet is held by the cache.
+*
+* Threads share the cache under one recursive lock. The journal hook is
+* called with it held, except JOURNAL_HINT which waits until the lock is
+* released: a commit brings in the free space map, whose lock is always
+* taken before the cache's. The readahead thread does not take it: the
+* blocks it reads are handed over through the readahead hook
+* (cacheSetReadahead), called at the start of every read, and only
+* installed if the disk was not written since they were read.
+*
+**************************************************************/
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+
+#include "structs/BlockCache.h"
+#include "structs/fs_utils.h"
+
+#define CACHE_WRITEBACK_RUN 64 // Max blocks coalesced into one LBAwrite
+
+static block_cache_st cache;
+static char* writeBackBuf = NULL; // scratch buffer to coalesce dirty runs
+static int cacheReady = 0;
+
+static int (*journalHook)(int request) = NULL; // commit callback of the journal
+static int journalMask = 0;                    // I/O classes logged by the journal
+
+static void (*readaheadHook)() = NULL;         // installs the blocks read ahead so far
+
+// Every entry point below runs under this lock, taken again by the nested calls
+// (a journal commit writes through the cache) and by the readahead hook
+static pthread_mutex_t cacheLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static int lockDepth = 0;   // times the thread holding cacheLock took it
+static int hintDue = 0;     // a journal hint waits for the lock to be released
+
+static int lookupSlot(int lba);
+static void hashInsert(int slot);
+static void hashRemove(int slot);
+static void lruUnlink(int slot);
+static void lruPushFront(int slot);
+static void lruPushBack(int slot);
+static int claimSlot(int lba);
+static void dropSlot(int slot);
+static int writeBackRun(int slot);
+static int gatherRun(int slot, int* first, char* dest);
+static void markRun(int first, int count, int dirty);
+static int isRangeCached(uint64_t lbaCount, uint64_t lbaPosition);
+static void refreshRange(void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+static uint64_t cacheTransferv(int op, lba_seg_st* segs, int nSegs);
+static int serveOrPrepare(int op, void* buffer, uint64_t lbaCount, uint64_t lbaPosition, uint64_t* result);
+static void keepRead(void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+static int isJournaled(int ioClass);
+static int pendingCount();
+static void lockCache();
+static void unlockCache();
+
+static uint64_t cacheReadHeld(void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+static uint64_t cacheWriteHeld(void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+static int cacheFlushHeld();
+static int cacheSubmitHeld(aio_batch_st* batch);
+static int cacheWaitHeld(aio_batch_st* batch);
+static int cacheFlushRangeHeld(uint64_t lbaCount, uint64_t lbaPosition);
+static void cacheDropRangeHeld(uint64_t lbaCount, uint64_t lbaPosition);
+static int cacheUnloggedHeld(int* lbas, const char** data, int max);
+static void cacheMarkLoggedHeld(const int* lbas, int count);
+static int cacheFlushClassesHeld(int classMask);
+static int cacheWriteBackLoggedHeld();
+static int cacheInstallHeld(const void* buffer, uint64_t lbaCount, uint64_t lbaPosition, uint64_t gen);
+
+/** Allocates the slot pool, the hash table and the LRU list. All slots start
+ * empty and are linked into the LRU list so the first misses use them in order.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int initBlockCache(int nBlocks, int blockSize) {
+    if (cacheReady) freeBlockCache();
+    if (nBlocks < 1 || blockSize < 1) return -1;
+
+    cache.capacity = nBlocks;
+    cache.blockSize = blockSize;
+    cache.nBuckets = nBlocks * 2 + 1; // keep chains short
+
+    cache.slots = malloc(nBlocks * sizeof(cache_block_st));
+    cache.pool = malloc((size_t) nBlocks * blockSize);
+    cache.buckets = malloc(cache.nBuckets * sizeof(int));
+    writeBackBuf = malloc((size_t) CACHE_WRITEBACK_RUN * blockSize);
+
+    if (!cache.slots || !cache.pool || !cache.buckets || !writeBackBuf) {
+        printf("Unable to allocate memory -- initBlockCache --\n");
+        freeBlockCache();
+        return -1;
+    }
+
+    for (int i = 0; i < cache.nBuckets; i++) cache.buckets[i] = -1;
+
+    // Link every empty slot into the LRU list: slot 0 is head, last is tail
+    for (int i = 0; i < nBlocks; i++) {
+        cache.slots[i] = (cache_block_st) { CACHE_EMPTY_SLOT, 0, i - 1, i + 1, -1,
+                                            IO_CLASS_OTHER, CACHE_JNONE, cache.pool + (size_t) i * blockSize };
+    }
+    cache.slots[nBlocks - 1].next = -1;
+    cache.lruHead = 0;
+    cache.lruTail = nBlocks - 1;
+
+    cacheReady = 1;
+    return 0;
+}
+
+/** Releases all memory owned by the cache. Dirty blocks are NOT written,
+ * call cacheFlush first. */
+void freeBlockCache() {
+    freePtr((void**) &cache.slots, "Cache slots");
+    freePtr((void**) &cache.pool, "Cache pool");
+    freePtr((void**) &cache.buckets, "Cache buckets");
+    freePtr((void**) &writeBackBuf, "Cache write back buffer");
+    cacheReady = 0;
+}
+
+// Entry points: the work is done by the ...Held functions below, with the lock held
+
+/** Holds the cache lock across several cache calls, until cacheLeave. The
+ * journal commits this way; the free space lock must not be taken inside.
+ */
+void cacheEnter() {
+    lockCache();
+}
+
+void cacheLeave() {
+    unlockCache();
+}
+
+uint64_t cacheRead(void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    lockCache();
+    uint64_t result = cacheReadHeld(buffer, lbaCount, lbaPosition);
+    unlockCache();
+    return result;
+}
+
+uint64_t cacheWrite(void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    lockCache();
+    uint64_t result = cacheWriteHeld(buffer, lbaCount, lbaPosition);
+    unlockCache();
+    return result;
+}
+
+int cacheFlush() {
+    lockCache();
+    int result = cacheFlushHeld();
+    unlockCache();
+    return result;
+}
+
+int cacheSubmit(aio_batch_st* batch) {
+    lockCache();
+    int result = cacheSubmitHeld(batch);
+    unlockCache();
+    return result;
+}
+
+int cacheWait(aio_batch_st* batch) {
+    lockCache();
+    int result = cacheWaitHeld(batch);
+    unlockCache();
+    return result;
+}
+
+int cacheFlushRange(uint64_t lbaCount, uint64_t lbaPosition) {
+    lockCache();
+    int result = cacheFlushRangeHeld(lbaCount, lbaPosition);
+    unlockCache();
+    return result;
+}
+
+void cacheDropRange(uint64_t lbaCount, uint64_t lbaPosition) {
+    lockCache();
+    cacheDropRangeHeld(lbaCount, lbaPosition);
+    unlockCache();
+}
+
+int cacheUnlogged(int* lbas, const char** data, int max) {
+    lockCache();
+    int result = cacheUnloggedHeld(lbas, data, max);
+    unlockCache();
+    return result;
+}
+
+void cacheMarkLogged(const int* lbas, int count) {
+    lockCache();
+    cacheMarkLoggedHeld(lbas, count);
+    unlockCache();
+}
+
+int cacheFlushClasses(int classMask) {
+    lockCache();
+    int result = cacheFlushClassesHeld(classMask);
+    unlockCache();
+    return result;
+}
+
+int cacheWriteBackLogged() {
+    lockCache();
+    int result = cacheWriteBackLoggedHeld();
+    unlockCache();
+    return result;
+}
+
+int cacheInstall(const void* buffer, uint64_t lbaCount, uint64_t lbaPosition, uint64_t gen) {
+    lockCache();
+    int result = cacheInstallHeld(buffer, lbaCount, lbaPosition, gen);
+    unlockCache();
+    return result;
+}
+
+/** Reads lbaCount blocks starting at lbaPosition into buffer. Cached blocks are
+ * copied from memory; each run of missing blocks is read from disk with one
+ * LBAread and then kept in the cache. Large reads bypass the cache.
+ * @return number of blocks read, same contract as LBAread
+ * @author Danish Nguyen
+ */
+static uint64_t cacheReadHeld(void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    if (!cacheReady) return lockedLBAread(buffer, lbaCount, lbaPosition);
+    if (readaheadHook) readaheadHook();
+
+    // Large transfer: make sure the disk holds the newest copy, then read direct
+    if (lbaCount > cache.capacity / CACHE_BYPASS_DIVISOR) {
+        if (cacheFlushRange(lbaCount, lbaPosition) == -1) return 0;
+        ioRecordCache(0, lbaCount);
+        return lockedLBAread(buffer, lbaCount, lbaPosition);
+    }
+
+    char* dest = (char*) buffer;
+    uint64_t i = 0;
+    uint64_t hits = 0;
+
+    while (i < lbaCount) {
+        int slot = lookupSlot(lbaPosition + i);
+
+        // Hit - copy from memory and mark as most recently used
+        if (slot != -1) {
+            memcpy(dest + i * cache.blockSize, cache.slots[slot].data, cache.blockSize);
+            lruUnlink(slot);
+            lruPushFront(slot);
+            hits++;
+            i++;
+            continue;
+        }
+
+        // Miss - find how many consecutive blocks are missing and read them at once
+        uint64_t runEnd = i + 1;
+        while (runEnd < lbaCount && lookupSlot(lbaPosition + runEnd) == -1) runEnd++;
+
+        uint64_t runCount = runEnd - i;
+        ioRecordCache(0, runCount);
+        uint64_t readCount = lockedLBAread(dest + i * cache.blockSize, runCount, lbaPosition + i);
+
+        for (uint64_t j = 0; j < readCount; j++) {
+            int newSlot = claimSlot(lbaPosition + i + j);
+            if (newSlot == -1) {
+                ioRecordCache(hits, 0);
+                return i + j;
+            }
+            memcpy(cache.slots[newSlot].data, dest + (i + j) * cache.blockSize, cache.blockSize);
+        }
+        if (readCount < runCount) {
+            ioRecordCache(hits, 0);
+            return i + readCount;
+        }
+        i = runEnd;
+    }
+    ioRecordCache(hits, 0);
+    return lbaCount;
+}
+
+/** Copies lbaCount blocks from buffer into the cache and marks them dirty. The
+ * data reaches the disk on eviction or flush. Large writes go straight to disk
+ * and only refresh blocks that are already cached.
+ * @return number of blocks written, same contract as LBAwrite
+ * @author Danish Nguyen
+ */
+static uint64_t cacheWriteHeld(void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    if (!cacheReady) return lockedLBAwrite(buffer, lbaCount, lbaPosition);
+
+    char* src = (char*) buffer;
+
+    if (lbaCount > cache.capacity / CACHE_BYPASS_DIVISOR) {
+        // Metadata written in place must not be overtaken by an older copy in the journal
+        if (isJournaled(ioGetClass())) journalHook(JOURNAL_BARRIER);
+
+        uint64_t written = lockedLBAwrite(buffer, lbaCount, lbaPosition);
+
+        // Cached copies in the range now match the disk
+        refreshRange(buffer, written, lbaPosition);
+        return written;
+    }
+
+    for (uint64_t i = 0; i < lbaCount; i++) {
+        int slot = lookupSlot(lbaPosition + i);
+
+        // Whole block is overwritten, no need to read it from disk first
+        if (slot == -1) {
+            slot = claimSlot(lbaPosition + i);
+            if (slot == -1) return i;
+        } else {
+            // The committed version goes home before it is replaced
+            if (cache.slots[slot].jstate == CACHE_JLOGGED && writeBackRun(slot) == -1) return i;
+            lruUnlink(slot);
+            lruPushFront(slot);
+        }
+        memcpy(cache.slots[slot].data, src + i * cache.blockSize, cache.blockSize);
+        cache.slots[slot].dirty = 1;
+        cache.slots[slot].ioClass = ioGetClass();
+        cache.slots[slot].jstate = isJournaled(ioGetClass()) ? CACHE_JPENDING : CACHE_JNONE;
+    }
+
+    // Let the journal decide whether enough metadata is waiting for a group commit,
+    // once the lock is released (a commit takes the free space lock first)
+    if (isJournaled(ioGetClass())) hintDue = 1;
+    return lbaCount;
+}
+
+/** Writes every dirty block back to disk. Each run of adjacent dirty blocks
+ * becomes one write request, and all runs are submitted to the async engine
+ * as a single batch so they are written concurrently.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+static int cacheFlushHeld() {
+    if (!cacheReady) return 0;
+
+    // Pending metadata must be in the journal before it goes home
+    if (journalHook && pendingCount() > 0) journalHook(JOURNAL_COMMIT);
+
+    aio_req_st* reqs = malloc(cache.capacity * sizeof(aio_req_st));
+
+    // Not enough memory to batch the runs, write them one at a time
+    if (reqs == NULL) {
+        for (int i = 0; i < cache.capacity; i++) {
+            if (cache.slots[i].dirty && writeBackRun(i) == -1) return -1;
+        }
+        return 0;
+    }
+
+    aio_batch_st batch = { reqs, 0, 0, 0 };
+    int status = 0;
+
+    for (int i = 0; i < cache.capacity; i++) {
+        if (!cache.slots[i].dirty) continue;
+
+        char* runBuf = malloc((size_t) CACHE_WRITEBACK_RUN * cache.blockSize);
+        if (runBuf == NULL) {
+            status = -1;
+            break;
+        }
+        int first;
+        int count = gatherRun(i, &first, runBuf);
+        markRun(first, count, 0);
+
+        // Charge the run to the subsystem that dirtied it
+        int prevClass = ioSetClass(cache.slots[i].ioClass);
+        reqs[batch.count] = (aio_req_st) { AIO_WRITE, runBuf, count, first };
+        asyncSubmit(&batch, &reqs[batch.count++]);
+        ioSetClass(prevClass);
+    }
+    asyncWait(&batch);
+
+    // Blocks of a failed run stay dirty so a later flush can retry them
+    for (int i = 0; i < batch.count; i++) {
+        if (reqs[i].result < reqs[i].lbaCount) {
+            printf("ERROR - cacheFlush @ %d - count: %d\n", (int) reqs[i].lbaPosition, 
+                                                            (int) reqs[i].lbaCount);
+            markRun(reqs[i].lbaPosition, reqs[i].lbaCount, 1);
+            status = -1;
+        }
+        free(reqs[i].buffer);
+    }
+    free(reqs);
+    return status;
+}
+
+/** Cache aware submission of a batch of block requests. Reads that are fully
+ * cached and writes small enough to be absorbed by the cache complete right
+ * away; the other requests are handed to the async engine after the cache is
+ * made coherent with the disk for their range. The caller must call cacheWait
+ * before touching the same blocks again.
+ * @return 0 on success, -1 on invalid request
+ * @author Danish Nguyen
+ */
+static int cacheSubmitHeld(aio_batch_st* batch) {
+    batch->pending = 0;
+    batch->failed = 0;
+    if (cacheReady && readaheadHook) readaheadHook();
+
+    for (int i = 0; i < batch->count; i++) {
+        aio_req_st* req = &batch->reqs[i];
+        req->batch = batch;
+        req->ioClass = ioGetClass();
+
+        int served = serveOrPrepare(req->op, req->buffer, req->lbaCount, req->lbaPosition, &req->result);
+        if (served == -1) return -1;
+        if (served == 1) {
+            req->done = 1;
+            continue;
+        }
+        if (asyncSubmit(batch, req) == -1) return -1;
+    }
+    return 0;
+}
+
+/** Waits for a batch submitted with cacheSubmit. Blocks read by small requests
+ * are kept in the cache.
+ * @return 0 if every request transferred all of its blocks, -1 otherwise
+ */
+static int cacheWaitHeld(aio_batch_st* batch) {
+    asyncWait(batch);
+
+    int status = 0;
+    for (int i = 0; i < batch->count; i++) {
+        aio_req_st* req = &batch->reqs[i];
+        if (req->result < req->lbaCount) status = -1;
+
+        if (req->op != AIO_READ) continue;
+
+        // Blocks installed below belong to the class that submitted the read
+        int prevClass = ioSetClass(req->ioClass);
+        keepRead(req->buffer, req->result, req->lbaPosition);
+        ioSetClass(prevClass);
+    }
+    return status;
+}
+
+/** Vectored cacheRead: the segments the cache does not serve are read with one LBAreadv
+ * @return total number of blocks read, same contract as LBAreadv
+ * @author Danish Nguyen
+ */
+uint64_t cacheReadv(lba_seg_st* segs, int nSegs) {
+    return cacheTransferv(AIO_READ, segs, nSegs);
+}
+
+/** Vectored cacheWrite: the segments the cache does not absorb are written with one LBAwritev
+ * @return total number of blocks written, same contract as LBAwritev
+ */
+uint64_t cacheWritev(lba_seg_st* segs, int nSegs) {
+    return cacheTransferv(AIO_WRITE, segs, nSegs);
+}
+
+/** Writes back dirty cached blocks that fall in [lbaPosition, lbaPosition + lbaCount)
+ * @return 0 on success, -1 on failure
+ */
+static int cacheFlushRangeHeld(uint64_t lbaCount, uint64_t lbaPosition) {
+    if (!cacheReady) return 0;
+
+    for (uint64_t i = 0; i < lbaCount; i++) {
+        int slot = lookupSlot(lbaPosition + i);
+        if (slot != -1 && cache.slots[slot].dirty && writeBackRun(slot) == -1) return -1;
+    }
+    return 0;
+}
+
+/** Forgets the cached blocks that fall in [lbaPosition, lbaPosition + lbaCount)
+ * without writing them, dirty or not. Used when blocks are released: their
+ * content is garbage and must not be written back over a discarded range.
+ */
+static void cacheDropRangeHeld(uint64_t lbaCount, uint64_t lbaPosition) {
+    if (!cacheReady) return;
+
+    // A range larger than the cache is cheaper to match slot by slot
+    if (lbaCount > (uint64_t) cache.capacity) {
+        for (int i = 0; i < cache.capacity; i++) {
+            uint64_t lba = cache.slots[i].lba;
+            if (cache.slots[i].lba != CACHE_EMPTY_SLOT && lba >= lbaPosition && 
+                lba < lbaPosition + lbaCount) dropSlot(i);
+        }
+        return;
+    }
+    for (uint64_t i = 0; i < lbaCount; i++) {
+        int slot = lookupSlot(lbaPosition + i);
+        if (slot != -1) dropSlot(slot);
+    }
+}
+
+/** Attaches a journal to the cache. Dirty blocks of the I/O classes in
+ * classMask (bit 1 << class) stay pending until the journal marks them logged;
+ * hook is called with a JOURNAL_* request whenever the cache needs a commit.
+ * A NULL hook detaches the journal.
+ * @author Danish Nguyen
+ */
+void cacheSetJournal(int (*hook)(int request), int classMask) {
+    journalHook = hook;
+    journalMask = hook ? classMask : 0;
+}
+
+/** Attaches the readahead: hook is called at the start of every read, with the
+ * cache locked, so that the blocks read ahead by another thread are installed
+ * (cacheInstall). A NULL hook detaches it.
+ */
+void cacheSetReadahead(void (*hook)()) {
+    readaheadHook = hook;
+}
+
+/** Adds clean blocks read outside of the cache (snapshotLBAread). Nothing is
+ * added if the disk was written since they were read; blocks already cached
+ * are newer and kept. Readahead never forces a write back: it stops at the
+ * first dirty victim.
+ * @return number of blocks installed
+ */
+static int cacheInstallHeld(const void* buffer, uint64_t lbaCount, uint64_t lbaPosition, uint64_t gen) {
+    if (!cacheReady || gen != lbaWriteGeneration()) return 0;
+
+    int installed = 0;
+    for (uint64_t i = 0; i < lbaCount; i++) {
+        if (lookupSlot(lbaPosition + i) != -1) continue;
+        if (cache.slots[cache.lruTail].dirty) break;
+
+        int slot = claimSlot(lbaPosition + i);
+        if (slot == -1) break;
+        memcpy(cache.slots[slot].data, (const char*) buffer + i * cache.blockSize, cache.blockSize);
+        installed++;
+    }
+    return installed;
+}
+
+/** Lists the dirty blocks waiting for the journal. Up to max LBAs and pointers
+ * to their cached data are stored; the pointers stay valid until the next
+ * call that can claim a slot (cacheRead/cacheWrite).
+ * @return total number of pending blocks
+ */
+static int cacheUnloggedHeld(int* lbas, const char** data, int max) {
+    if (!cacheReady) return 0;
+
+    int count = 0;
+    for (int i = 0; i < cache.capacity; i++) {
+        if (cache.slots[i].jstate != CACHE_JPENDING) continue;
+
+        if (count < max) {
+            lbas[count] = cache.slots[i].lba;
+            data[count] = cache.slots[i].data;
+        }
+        count++;
+    }
+    return count;
+}
+
+/** Marks pending blocks as committed to the journal, they may now go home */
+static void cacheMarkLoggedHeld(const int* lbas, int count) {
+    if (!cacheReady) return;
+
+    for (int i = 0; i < count; i++) {
+        int slot = lookupSlot(lbas[i]);
+        if (slot != -1 && cache.slots[slot].jstate == CACHE_JPENDING) {
+            cache.slots[slot].jstate = CACHE_JLOGGED;
+        }
+    }
+}
+
+/** Writes back the dirty blocks of the I/O classes in classMask that are
+ * allowed home (not pending). Used for ordered data writes before a journal
+ * commit and for checkpoints.
+ * @return 0 on success, -1 on failure
+ */
+static int cacheFlushClassesHeld(int classMask) {
+    if (!cacheReady) return 0;
+
+    for (int i = 0; i < cache.capacity; i++) {
+        cache_block_st* s = &cache.slots[i];
+        if (!s->dirty || s->jstate == CACHE_JPENDING || !(classMask & (1 << s->ioClass))) continue;
+        if (writeBackRun(i) == -1) return -1;
+    }
+    return 0;
+}
+
+/** Writes one run of committed metadata home, so a checkpoint can bring the
+ * journaled blocks home a run at a time without holding the cache meanwhile.
+ * @return 1 if a run was written, 0 if no committed block is left, -1 on failure
+ */
+static int cacheWriteBackLoggedHeld() {
+    if (!cacheReady) return 0;
+
+    for (int i = 0; i < cache.capacity; i++) {
+        if (cache.slots[i].dirty && cache.slots[i].jstate == CACHE_JLOGGED) {
+            return (writeBackRun(i) == -1) ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/** Find the slot holding lba
+ * @return slot index or -1 if the block is not cached */
+static int lookupSlot(int lba) {
+    for (int s = cache.buckets[lba % cache.nBuckets]; s != -1; s = cache.slots[s].hashNext) {
+        if (cache.slots[s].lba == lba) return s;
+    }
+    return -1;
+}
+
+static void hashInsert(int slot) {
+    int bucket = cache.slots[slot].lba % cache.nBuckets;
+    cache.slots[slot].hashNext = cache.buckets[bucket];
+    cache.buckets[bucket] = slot;
+}
+
+static void hashRemove(int slot) {
+    int* link = &cache.buckets[cache.slots[slot].lba % cache.nBuckets];
+    while (*link != -1) {
+        if (*link == slot) {
+            *link = cache.slots[slot].hashNext;
+            break;
+        }
+        link = &cache.slots[*link].hashNext;
+    }
+    cache.slots[slot].hashNext = -1;
+}
+
+static void lruUnlink(int slot) {
+    cache_block_st* s = &cache.slots[slot];
+
+    if (s->prev != -1) cache.slots[s->prev].next = s->next;
+    else cache.lruHead = s->next;
+
+    if (s->next != -1) cache.slots[s->next].prev = s->prev;
+    else cache.lruTail = s->prev;
+
+    s->prev = s->next = -1;
+}
+
+static void lruPushFront(int slot) {
+    cache.slots[slot].prev = -1;
+    cache.slots[slot].next = cache.lruHead;
+
+    if (cache.lruHead != -1) cache.slots[cache.lruHead].prev = slot;
+    cache.lruHead = slot;
+    if (cache.lruTail == -1) cache.lruTail = slot;
+}
+
+static void lruPushBack(int slot) {
+    cache.slots[slot].next = -1;
+    cache.slots[slot].prev = cache.lruTail;
+
+    if (cache.lruTail != -1) cache.slots[cache.lruTail].next = slot;
+    cache.lruTail = slot;
+    if (cache.lruHead == -1) cache.lruHead = slot;
+}
+
+/** Take the least recently used slot for a new block. A dirty victim is
+ * written back (with its dirty neighbours) before it is reused.
+ * @return slot index now holding lba, or -1 if the victim can not be saved
+ */
+static int claimSlot(int lba) {
+    int victim = cache.lruTail;
+
+    if (cache.slots[victim].lba != CACHE_EMPTY_SLOT) {
+        if (cache.slots[victim].dirty && writeBackRun(victim) == -1) return -1;
+        hashRemove(victim);
+    }
+
+    cache.slots[victim].lba = lba;
+    cache.slots[victim].dirty = 0;
+    cache.slots[victim].jstate = CACHE_JNONE;
+    cache.slots[victim].ioClass = ioGetClass();
+    hashInsert(victim);
+
+    lruUnlink(victim);
+    lruPushFront(victim);
+    return victim;
+}
+
+// Empty a slot and make it the next victim
+static void dropSlot(int slot) {
+    hashRemove(slot);
+    cache.slots[slot].lba = CACHE_EMPTY_SLOT;
+    cache.slots[slot].dirty = 0;
+    cache.slots[slot].jstate = CACHE_JNONE;
+
+    lruUnlink(slot);
+    lruPushBack(slot);
+}
+
+/** Writes the dirty block in slot together with the dirty blocks cached right
+ * before and after it, so that a run of neighbours costs one LBAwrite.
+ * @return 0 on success, -1 on failure
+ */
+static int writeBackRun(int slot) {
+    // Pending metadata has to be committed before it is written in place
+    if (cache.slots[slot].jstate == CACHE_JPENDING && journalHook) journalHook(JOURNAL_COMMIT);
+
+    int first;
+    int count = gatherRun(slot, &first, writeBackBuf);
+
+    // Charge the write to the subsystem that dirtied the run, not to the caller
+    int prevClass = ioSetClass(cache.slots[slot].ioClass);
+    uint64_t written = lockedLBAwrite(writeBackBuf, count, first);
+    ioSetClass(prevClass);
+
+    if (written < count) {
+        printf("ERROR - writeBackRun @ %d - count: %d\n", first, count);
+        return -1;
+    }
+    markRun(first, count, 0);
+    return 0;
+}
+
+/** Copies the run of dirty blocks around slot (at most CACHE_WRITEBACK_RUN
+ * blocks) into dest. A run only spans blocks of the same I/O class and
+ * journal state.
+ * @return number of blocks in the run; the LBA of its first block goes to first
+ */
+static int gatherRun(int slot, int* first, char* dest) {
+    int lba = cache.slots[slot].lba;
+    int ioClass = cache.slots[slot].ioClass;
+    int jstate = cache.slots[slot].jstate;
+    *first = lba;
+
+    // Walk back to the beginning of the dirty run
+    while (*first > 0 && (lba - *first + 1) < CACHE_WRITEBACK_RUN) {
+        int prev = lookupSlot(*first - 1);
+        if (prev == -1 || !cache.slots[prev].dirty || cache.slots[prev].ioClass != ioClass ||
+                                            cache.slots[prev].jstate != jstate) break;
+        (*first)--;
+    }
+
+    int count = 0;
+    while (count < CACHE_WRITEBACK_RUN) {
+        int s = lookupSlot(*first + count);
+        if (s == -1 || !cache.slots[s].dirty || cache.slots[s].ioClass != ioClass ||
+                                            cache.slots[s].jstate != jstate) break;
+        memcpy(dest + (size_t) count * cache.blockSize, cache.slots[s].data, cache.blockSize);
+        count++;
+    }
+    return count;
+}
+
+// Set the dirty flag of every cached block in [first, first + count). Blocks
+// made dirty again after a failed write back were already committed.
+static void markRun(int first, int count, int dirty) {
+    for (int i = 0; i < count; i++) {
+        int s = lookupSlot(first + i);
+        if (s == -1) continue;
+
+        cache.slots[s].dirty = dirty;
+        cache.slots[s].jstate = (dirty && isJournaled(cache.slots[s].ioClass)) ? 
+                                                        CACHE_JLOGGED : CACHE_JNONE;
+    }
+}
+
+// @return 1 if every block in the range is cached, 0 otherwise
+static int isRangeCached(uint64_t lbaCount, uint64_t lbaPosition) {
+    for (uint64_t i = 0; i < lbaCount; i++) {
+        if (lookupSlot(lbaPosition + i) == -1) return 0;
+    }
+    return 1;
+}
+
+// Copy new data over the cached blocks of a range that is written to disk directly
+static void refreshRange(void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    for (uint64_t i = 0; i < lbaCount; i++) {
+        int slot = lookupSlot(lbaPosition + i);
+        if (slot == -1) continue;
+        memcpy(cache.slots[slot].data, (char*) buffer + i * cache.blockSize, cache.blockSize);
+        cache.slots[slot].dirty = 0;
+        cache.slots[slot].jstate = CACHE_JNONE;
+    }
+}
+
+/** Runs the segments through the cache: the ones it serves complete at once,
+ * the others go to the disk together with one LBAreadv/LBAwritev
+ * @return total number of blocks transferred */
+static uint64_t cacheTransferv(int op, lba_seg_st* segs, int nSegs) {
+    if (!segs || nSegs < 1) return 0;
+    if (nSegs == 1) {
+        return (op == AIO_READ) ? cacheRead(segs->buffer, segs->lbaCount, segs->lbaPosition)
+                                : cacheWrite(segs->buffer, segs->lbaCount, segs->lbaPosition);
+    }
+
+    lba_seg_st* direct = malloc(nSegs * sizeof(lba_seg_st));
+    if (!direct) return 0;
+
+    lockCache();
+    if (cacheReady && readaheadHook) readaheadHook();
+
+    uint64_t total = 0;
+    uint64_t directBlocks = 0;
+    int nDirect = 0;
+
+    for (int i = 0; i < nSegs; i++) {
+        uint64_t result = 0;
+        int served = serveOrPrepare(op, segs[i].buffer, segs[i].lbaCount, segs[i].lbaPosition, &result);
+        if (served == -1) break;
+
+        if (served == 1) {
+            total += result;
+        } else {
+            direct[nDirect++] = segs[i];
+            directBlocks += segs[i].lbaCount;
+        }
+    }
+
+    if (nDirect > 0) {
+        uint64_t done = (op == AIO_READ) ? LBAreadv(direct, nDirect) : LBAwritev(direct, nDirect);
+        total += done;
+
+        // LBAreadv only tells the total: the blocks are kept when every segment is whole
+        for (int i = 0; op == AIO_READ && done == directBlocks && i < nDirect; i++) {
+            keepRead(direct[i].buffer, direct[i].lbaCount, direct[i].lbaPosition);
+        }
+    }
+    unlockCache();
+
+    free(direct);
+    return total;
+}
+
+/** Serves a request from memory when the cache can: a read of cached blocks,
+ * or a write small enough to be absorbed. Otherwise the cache is made coherent
+ * with the disk for the range and the request is left to the disk.
+ * @return 1 if served (*result set), 0 if the disk must do it, -1 on failure
+ */
+static int serveOrPrepare(int op, void* buffer, uint64_t lbaCount, uint64_t lbaPosition, uint64_t* result) {
+    if (!cacheReady) return 0;
+
+    if (op == AIO_READ && isRangeCached(lbaCount, lbaPosition)) {
+        *result = cacheReadHeld(buffer, lbaCount, lbaPosition);
+        return 1;
+    }
+    if (op == AIO_WRITE && lbaCount <= cache.capacity / CACHE_BYPASS_DIVISOR) {
+        *result = cacheWriteHeld(buffer, lbaCount, lbaPosition);
+        return 1;
+    }
+    if (op == AIO_WRITE && isJournaled(ioGetClass())) journalHook(JOURNAL_BARRIER);
+
+    // The disk must hold the newest copy before it is read directly
+    if (op == AIO_READ) {
+        if (cacheFlushRangeHeld(lbaCount, lbaPosition) == -1) return -1;
+        ioRecordCache(0, lbaCount);
+    }
+    // Cached copies of blocks being overwritten take the new data
+    if (op == AIO_WRITE) refreshRange(buffer, lbaCount, lbaPosition);
+    return 0;
+}
+
+// Keep the blocks of a small read done by the disk in the cache
+static void keepRead(void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    if (!cacheReady || lbaCount > cache.capacity / CACHE_BYPASS_DIVISOR) return;
+
+    for (uint64_t j = 0; j < lbaCount; j++) {
+        if (lookupSlot(lbaPosition + j) != -1) continue;
+
+        int slot = claimSlot(lbaPosition + j);
+        if (slot == -1) break;
+        memcpy(cache.slots[slot].data, (char*) buffer + j * cache.blockSize, cache.blockSize);
+    }
+}
+
+// @return 1 if dirty blocks of this I/O class are logged by the attached journal
+static int isJournaled(int ioClass) {
+    return journalHook && (journalMask & (1 << ioClass));
+}
+
+// @return number of blocks waiting for the journal
+static int pendingCount() {
+    return cacheUnlogged(NULL, NULL, 0);
+}
+
+static void lockCache() {
+    pthread_mutex_lock(&cacheLock);
+    lockDepth++;
+}
+
+// Release the lock, then raise the journal hint a write asked for
+static void unlockCache() {
+    int (*hook)(int request) = NULL;
+    if (--lockDepth == 0 && hintDue) {
+        hintDue = 0;
+        hook = journalHook;
+    }
+    pthread_mutex_unlock(&cacheLock);
+
+    if (hook) hook(JOURNAL_HINT);
+}
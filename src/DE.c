@@ -8,16 +8,34 @@
 *
 * File:: DE.c
 *
-* Description:: Directory Entry is a data structure that stores metadata for 
-* a file or directory in the filesystem. It includes information such as creation, 
-* modification, and access timestamps; file size; entry type (file or directory); 
-* usage status; file name; and an array of extents that specify the locations of 
-* data blocks on disk (For now, only an extent in a DE)
+* Description:: Directory Entry names a file or directory in the filesystem:
+* its file name, usage status, entry type (file or directory) and the number
+* of its inode. A directory's own size and extents are in its inode, which
+* the loaded directory holds in the page in front of its entries
 *
 **************************************************************/
 
+#include <unistd.h>
+#include <sys/mman.h>
+
 #include "structs/DE.h"
 #include "structs/VCB.h"
+#include "structs/DirCache.h"
+#include "structs/DirIndex.h"
+
+// Kept in front of the entries of a directory buffer
+typedef struct dir_header_st {
+    inode_st* inode;
+} dir_header_st;
+
+static int resizeDir(directory_entry* dir, int nEntries);
+static void compactDir(directory_entry* dir, int nEntries);
+static int extendExtents(const extent_st* old, int n, int more, extent_st* exts);
+static void setDirInode(directory_entry* dir, inode_st* inode);
+static int dirBlocks(directory_entry* dir);
+static int fitEntries(int nEntries);
+static size_t dirReserve();
+static size_t pageRound(size_t bytes);
 
 /** Initializes a new directory structure in memory with a specified number of entries 
  * as a subdirectory of a given parent directory. It calculates required space, allocates 
@@ -34,198 +52,545 @@ directory_entry *createDirectory(int numEntries, directory_entry *parent) {
     int actualBytes = blocksNeeded * vcb->block_size;
     int actualEntries = actualBytes / sizeof(directory_entry);
 
-    // Retrieve available blocks on disk from fs map for this directory entry
+    // The hashed name index is kept in the blocks right after the entries
+    int totalBlocks = blocksNeeded + dirIndexBlocks(actualEntries, vcb->block_size);
+
+    // The metadata of the directory goes to a new inode
+    inode_st* inode = inodeAlloc(1);
+    if (inode == NULL) return NULL;
+
+    // Retrieve available blocks on disk from fs map for this directory entry,
+    // close to its parent when there is one
+    int goal = parent ? dirInode(parent)->extents[0].startLoc : -1;
     extents_st blocksLoc = (blocksLoc.extents == NULL) ? \
-        allocateBlocks(blocksNeeded, blocksNeeded) : allocateBlocks(blocksNeeded, 2);
+        allocateBlocks(totalBlocks, totalBlocks, goal) : allocateBlocks(totalBlocks, 2, goal);
 
     // Our system does not support full disk fragmentation. If the number of extents exceeds 
     // MAX_EXTENTS by more than twice, it means the disk is full and no space available
     if ( blocksLoc.extents == NULL || blocksLoc.size > MAX_EXTENTS) {
         printf(" --- ERROR: Failed to allocate blocks for DE --- \n");
         
-        // Return Blocks to Freespace on error
+        // Return Blocks to Freespace and the inode to the table on error
         returnExtents(blocksLoc);
+        inode->nlink = 0;
+        inodePut(inode);
         return NULL;
     }
 
     // Allocate memory for new directory entries and set all to NULL
-    directory_entry *newDir = (directory_entry *)calloc(actualEntries, sizeof(directory_entry));
-    if (newDir == NULL) return NULL;
-
-    time_t currentTime = time(NULL);
+    directory_entry *newDir = allocDirBuffer(totalBlocks * vcb->block_size);
+    if (newDir == NULL) {
+        returnExtents(blocksLoc);
+        inode->nlink = 0;
+        inodePut(inode);
+        return NULL;
+    }
 
-    // Initialize root directory entry "."
-    strcpy(newDir[0].file_name, ".");
+    // The buffer holds the inode from now on, freeing it on failure frees both
+    setDirInode(newDir, inode);
     
     // Updated this to handle an array of extents
-    memcpy(newDir[0].extents, blocksLoc.extents, blocksLoc.size * sizeof(extent_st));
-    newDir[0].ext_length = blocksLoc.size;
+    memcpy(inode->extents, blocksLoc.extents, blocksLoc.size * sizeof(extent_st));
+    inode->ext_length = blocksLoc.size;
+    inode->file_size = actualEntries * sizeof(directory_entry);
 
     freeExtents(&blocksLoc); // release memory extent when done
 
-    newDir[0].file_size = actualEntries * sizeof(directory_entry);
+    // Initialize root directory entry "."
+    strcpy(newDir[0].file_name, ".");
+    newDir[0].inode = inode->ino;
     newDir[0].is_directory = 1;
     newDir[0].is_used = 1;
-    newDir[0].creation_time = currentTime;
-    newDir[0].access_time = currentTime;
-    newDir[0].modification_time = currentTime;
 
     // Initialize parent directory entry ".." - If no parent, point to self
-    if (parent == NULL) parent = newDir;
-
     strcpy(newDir[1].file_name, "..");
-
-    memcpy(newDir[1].extents, parent[0].extents, parent[0].ext_length * sizeof(extent_st));
-    newDir[1].ext_length = parent[0].ext_length;
-
-    newDir[1].file_size = parent[0].file_size;
-    newDir[1].is_directory = parent[0].is_directory;
+    newDir[1].inode = parent ? dirInode(parent)->ino : inode->ino;
+    newDir[1].is_directory = 1;
     newDir[1].is_used = 1;
-    newDir[1].creation_time = parent[0].creation_time;
-    newDir[1].access_time = parent[0].access_time;
-    newDir[1].modification_time = parent[0].modification_time;
+
+    dirIndexBuild(newDir);
     
-    // Write created directory structure to disk
+    // Write created directory structure to disk, then the inode pointing to it
     int writeStatus = writeDirHelper(newDir);
+    if (writeStatus == 0) writeStatus = writeInode(inode);
     if (writeStatus == -1) {
-        freePtr((void**) &newDir, "DE DE.c");
+        inode->nlink = 0;
+        freeDirBuffer(newDir);
         return NULL;
     }
-    printf(" *** Successfully created DE - LBA @ %d *** \n", newDir->extents[0].startLoc);
+    printf(" *** Successfully created DE - LBA @ %d *** \n", inode->extents[0].startLoc);
 
     return newDir;
 }
 
-/** Writes a directory to disk at the specified location. 
+/** Writes a directory to disk at the specified location, its entries and
+ * the index that follows them
  * @return 0 on success or -1 on failure
  * @author Danish Nguyen, Atharva Walawalkar
  */
 int writeDirHelper(directory_entry *newDir) {
+    inode_st* inode = dirInode(newDir);
     
     // if directory entries have continuous blocks
-    if (newDir[0].ext_length == 1) {
+    if (inode->ext_length == 1) {
         
-        int blocks = computeBlockNeeded(newDir[0].file_size, vcb->block_size);
+        int blocks = inode->extents[0].countBlock;
 
-        if (LBAwrite(newDir, blocks, newDir[0].extents[0].startLoc) < blocks) {
-            return -1;
-        } return 0;
+        int prevClass = ioSetClass(IO_CLASS_DIR);
+        int written = cacheWrite(newDir, blocks, inode->extents[0].startLoc);
+        ioSetClass(prevClass);
+
+        return (written < blocks) ? -1 : 0;
     }
 
     // If the block is not continuous, convert DE into a buffer and then write 
-    // DEs to disk according to the number of blocks in each extent
+    // DEs to disk according to the number of blocks in each extent. All extents 
+    // go out in a single vectored write
 
     // create a buffer to fill all DEs on mem to disk
     char* newDirBlod = (char*) newDir;
 
+    lba_seg_st segs[MAX_EXTENTS];
+    int blocks = 0;
+
     // Integrate through each extent in 'newDir' to full fill DEs
-    for (int i = 0; i < newDir->ext_length; i++) {
-        int startLoc = newDir[0].extents[i].startLoc;
-        int countBlock = newDir[0].extents[i].countBlock;
+    for (int i = 0; i < inode->ext_length; i++) {
+        int startLoc = inode->extents[i].startLoc;
+        int countBlock = inode->extents[i].countBlock;
+
+        segs[i] = (lba_seg_st) { newDirBlod, countBlock, startLoc };
+        blocks += countBlock;
 
-        // write each extent block by block. Return -1 on failure
-        if (LBAwrite(newDirBlod, countBlock, startLoc) < countBlock) {
-            return -1;
-        }
         // move cursor forward based on number of blocks written
         newDirBlod += (countBlock * vcb->block_size);
-    } return 0;
+    }
+    
+    // Return -1 if any extent fails to be written
+    int prevClass = ioSetClass(IO_CLASS_DIR);
+    int written = cacheWritev(segs, inode->ext_length);
+    ioSetClass(prevClass);
+
+    return (written < blocks) ? -1 : 0;
 }
 
-/** Load root a directory to memory. 
+/** Writes back only the blocks of a directory holding the bytes
+ * [offset, offset + length) of its buffer
  * @return 0 on success or -1 on failure
  * @author Danish Nguyen
  */
-directory_entry* readDirHelper(int startLoc) {
+int writeDirRange(directory_entry *dir, int offset, int length) {
+    inode_st* inode = dirInode(dir);
+    int first = offset / vcb->block_size;
+    int last = (offset + length - 1) / vcb->block_size;
+
+    lba_seg_st segs[MAX_EXTENTS];
+    int nSegs = 0, blocks = 0;
+
+    // base: index of the first block of extent i within the directory
+    for (int i = 0, base = 0; i < inode->ext_length && base <= last; i++) {
+        int count = inode->extents[i].countBlock;
+        int from = max(first, base);
+        int to = min(last, base + count - 1);
+
+        if (from <= to) {
+            segs[nSegs++] = (lba_seg_st) { (char*) dir + from * vcb->block_size, 
+                            to - from + 1, inode->extents[i].startLoc + from - base };
+            blocks += to - from + 1;
+        }
+        base += count;
+    }
+    if (blocks < last - first + 1) return -1; // past the end of the directory
 
-    int blocks = computeBlockNeeded(DIRECTORY_ENTRIES * sizeof(directory_entry), vcb->block_size);
-    
-    // Allocate memory for the directory entries
-    directory_entry* de = (directory_entry*)calloc(blocks, vcb->block_size);
-    if (!de) return NULL;
+    int prevClass = ioSetClass(IO_CLASS_DIR);
+    int written = cacheWritev(segs, nSegs);
+    ioSetClass(prevClass);
+
+    return (written < blocks) ? -1 : 0;
+}
+
+// Write back the block(s) of a single entry of a directory
+int writeDirEntry(directory_entry *dir, int idx) {
+    return writeDirRange(dir, idx * sizeof(directory_entry), sizeof(directory_entry));
+}
 
-    // Read the first time to retrive the DE structure
-    if (LBAread(de, blocks, startLoc) < blocks) {
-        freePtr((void**) &de, "DE DE.c");
+/** Reads the directory of inode ino: every extent listed in the inode, in a
+ * single vectored call into a buffer sized from the extents. No block is read
+ * twice and nothing is guessed from a fixed directory size. This includes the
+ * name index after the entries, so a load costs O(directory size) reads; the
+ * lookups made while the directory stays in the dir cache then read nothing.
+ * @return the loaded directory, holding the inode, or NULL on failure
+ */
+directory_entry* readDirHelper(uint32_t ino) {
+    inode_st* inode = inodeGet(ino);
+    if (!inode || !inode->is_directory || inode->ext_length < 1 || inode->ext_length > MAX_EXTENTS) {
+        inodePut(inode);
         return NULL;
     }
 
-    if (de->ext_length == 1) return de; // Successfully loaded all DEs into memory
-    
-    /** Couldn't load all DEs into memory due to discontiguous, meaning 
-    the extent length is greater than one. Filling the DE buffer by looping 
-    through the extents */ 
+    int blocks = 0;
+    for (int i = 0; i < inode->ext_length; i++) blocks += inode->extents[i].countBlock;
+
+    // The entries ("." and ".." at least) must fit in the blocks that are read
+    if (inode->file_size < 2 * (int) sizeof(directory_entry) ||
+        inode->file_size > blocks * vcb->block_size) {
+        inodePut(inode);
+        return NULL;
+    }
 
-    // create a buffer to fill all DEs on disk to mem
+    // Allocate memory for the directory entries, room to grow included
+    directory_entry* de = allocDirBuffer(blocks * vcb->block_size);
+    if (!de) {
+        inodePut(inode);
+        return NULL;
+    }
+    setDirInode(de, inode);
+
+    // create a buffer to fill all DEs on disk to mem, one segment per extent
     char* dePtr = (char*) de; 
+    lba_seg_st segs[MAX_EXTENTS];
     
-    for (int i = 0; i < de->ext_length; i++) {
-        int startLoc = de->extents[i].startLoc;
-        int countBlock = de->extents[i].countBlock;
+    for (int i = 0; i < inode->ext_length; i++) {
+        segs[i] = (lba_seg_st) { dePtr, inode->extents[i].countBlock, inode->extents[i].startLoc };
 
-        if (LBAread(dePtr, countBlock, startLoc) < countBlock) {
-            freePtr((void**) &de, "DE DE.c");
-            return NULL;
-        }
         // move pointer to the next position in the buffer
-        dePtr += (countBlock * vcb->block_size);
+        dePtr += (inode->extents[i].countBlock * vcb->block_size);
     }
+
+    // Every extent is read in a single vectored call
+    int prevClass = ioSetClass(IO_CLASS_DIR);
+    int readBlocks = cacheReadv(segs, inode->ext_length);
+    ioSetClass(prevClass);
+
+    if (readBlocks < blocks) {
+        freeDirBuffer(de);
+        return NULL;
+    }
+    dirIndexRecount(de);
     return de;
 }
 
-/** Loads a directory from disk based on parent directory and its index
+/** Loads a directory from disk based on parent directory and its index. The
+ * directory comes from the directory cache, shared with every other holder
+ * (the root and the cwd included), and must be given back with releaseDir.
  * @return directory entry that loaded on disk to memory
  * @anchor Danish Nguyen
  */
 directory_entry* loadDir(directory_entry *de) {
     if (de == NULL || de->is_directory != 1) return NULL; // Invalid DE
-    
-    // Prevent multiple reads of the same LBA on disk
-    // if the new directory entry to load has the same location as root, point to root
-    if (vcb->root_dir_ptr && vcb->root_dir_ptr->extents->startLoc == de->extents->startLoc) {
-        return vcb->root_dir_ptr;
+
+    return dirCacheGet(de->inode);
+}
+
+// Give back a directory returned by loadDir (or held through the directory cache)
+void releaseDir(directory_entry* dir) {
+    dirCacheRelease(dir);
+}
+
+/** Doubles the entries of a full directory. The new blocks are added after
+ * its last extent when they fit in its extents, otherwise the directory
+ * moves to a new allocation. Its entries keep their index and its buffer
+ * keeps its address, so holders of the directory are not affected. The
+ * index is rebuilt and the inode updated; the entries naming the directory
+ * hold only its inode number and do not change.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int growDir(directory_entry* dir) {
+    int nEntries = sizeOfDE(dir);
+    if (nEntries >= DIRECTORY_MAX_ENTRIES) {
+        printf("Error - directory is full: %d entries\n", nEntries);
+        return -1;
     }
-    // if the new directory entry to load has the same location as cwd, point to cwd
-    if (vcb->cwdLoadDE && vcb->cwdLoadDE->extents->startLoc == de->extents->startLoc) {
-        return vcb->cwdLoadDE;
+    return resizeDir(dir, fitEntries(min(nEntries * 2, DIRECTORY_MAX_ENTRIES)));
+}
+
+/** Halves a directory, as many times as possible, once deletes leave no more
+ * than 1 in DIRECTORY_SHRINK_RATIO of its entries used. The used entries are
+ * first moved down over the free ones, in order, so that the cut tail is
+ * free; the names cached for the directory are forgotten since their index
+ * changed. While a directory stream (fs_opendir) walks it by index, entries
+ * are not moved and only a free tail is cut off. A new directory's size is
+ * the minimum.
+ * @return 0 on success or when nothing was cut, -1 on failure
+ * @author Danish Nguyen
+ */
+int shrinkDir(directory_entry* dir) {
+    dir_index_st* index = dirIndexOf(dir);
+    int nEntries = sizeOfDE(dir);
+    int minEntries = fitEntries(DIRECTORY_ENTRIES);
+
+    if (!index || nEntries <= minEntries || 
+        index->nUsed * DIRECTORY_SHRINK_RATIO > nEntries) return 0;
+
+    // The highest entry to keep: the last used one unless entries can move
+    int canMove = dirCacheStreams(dir, 0) == 0;
+    int highest = canMove ? index->nUsed - 1 : index->lastUsed;
+
+    // Keep the result no more than half used, and every used entry in it
+    int target = nEntries;
+    while (target / 2 >= minEntries && target / 2 > highest &&
+            index->nUsed * 2 <= target / 2) {
+        target /= 2;
     }
+    target = fitEntries(target);
+    if (target >= nEntries || target <= highest) return 0;
 
-    return readDirHelper(de->extents->startLoc);
+    // Entries past the new end move down; resizeDir rebuilds the index
+    if (target <= index->lastUsed) {
+        compactDir(dir, nEntries);
+        dirCacheForgetAll(dirInode(dir)->ino);
+    }
+    return resizeDir(dir, target);
 }
 
-/** Remove directory entry and release all blocks associate with it
+/** Moves a loaded directory to new extents: its inode is set to them and it is
+ * written there, then the inode. Entries naming the directory (its own "."
+ * and the ".." of its subdirectories included) hold its inode number and do
+ * not change. The caller releases the old blocks.
  * @return 0 on success, -1 on failure
  * @author Danish Nguyen
  */
-int removeDE(directory_entry *de, int idx, int isUsed) {
-    de[idx].is_used = isUsed;
-    de[idx].file_size = 0;
-    
-    // Remove file name if it's a directory
-    if (de[idx].is_directory) de[idx].file_name[0] = '\0';
-    
-    // The DE holds any blocks remove it. Otherwise, return success
-    if (de[idx].ext_length == 0) return 0;
-    
-    for (size_t i = 0; i < de[idx].ext_length ; i++) {
-        int start = de[idx].extents[i].startLoc;
-        int count = de[idx].extents[i].countBlock;
-
-        // Release all blocks associated with the target file or directory to FreeSpace
-        int status = releaseBlocks(start, count);
-        if (status == -1) {
-            printf("Error - Failed to delete the data of %s\n", de[idx].file_name);
+int moveDir(directory_entry* dir, const extent_st* extents, int nExtents) {
+    inode_st* inode = dirInode(dir);
+
+    memcpy(inode->extents, extents, nExtents * sizeof(extent_st));
+    inode->ext_length = nExtents;
+
+    int status = writeDirHelper(dir);
+    if (status == 0) status = writeInode(inode);
+    return status;
+}
+
+/** Allocates the memory of a directory of the given size. The address space
+ * for DIRECTORY_MAX_ENTRIES entries is reserved up front, so a directory that
+ * grows never changes address; only the pages in use are committed. One more
+ * page in front of the entries holds the inode of the directory.
+ * @return the zeroed buffer, NULL on failure
+ * @author Danish Nguyen
+ */
+directory_entry* allocDirBuffer(int bytes) {
+    size_t reserve = dirReserve();
+    size_t page = pageRound(1);
+    if (bytes <= 0 || bytes > reserve) return NULL;
+
+    void* buffer = mmap(NULL, page + reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (buffer == MAP_FAILED) return NULL;
+
+    if (mprotect(buffer, page + pageRound(bytes), PROT_READ | PROT_WRITE) == -1) {
+        munmap(buffer, page + reserve);
+        return NULL;
+    }
+    return (directory_entry*) ((char*) buffer + page);
+}
+
+/** Commits or gives back the pages of a directory buffer that grows from
+ * oldBytes to newBytes or shrinks. New pages read as zeros.
+ * @return 0 on success, -1 on failure
+ */
+int resizeDirBuffer(directory_entry* dir, int oldBytes, int newBytes) {
+    if (newBytes <= 0 || newBytes > dirReserve()) return -1;
+
+    size_t oldLen = pageRound(oldBytes);
+    size_t newLen = pageRound(newBytes);
+    char* buffer = (char*) dir;
+
+    if (newLen > oldLen) return mprotect(buffer + oldLen, newLen - oldLen, PROT_READ | PROT_WRITE);
+
+    if (newLen < oldLen) {
+        madvise(buffer + newLen, oldLen - newLen, MADV_DONTNEED);
+        mprotect(buffer + newLen, oldLen - newLen, PROT_NONE);
+    }
+    return 0;
+}
+
+// Free a buffer from allocDirBuffer and put back the inode it holds
+void freeDirBuffer(directory_entry* dir) {
+    if (!dir) return;
+
+    size_t page = pageRound(1);
+    inodePut(dirInode(dir));
+    munmap((char*) dir - page, page + dirReserve());
+}
+
+// @return the inode of a directory buffer, NULL if none was set
+inode_st* dirInode(directory_entry* dir) {
+    return ((dir_header_st*) dir)[-1].inode;
+}
+
+// The buffer takes over the caller's reference on the inode
+static void setDirInode(directory_entry* dir, inode_st* inode) {
+    ((dir_header_st*) dir)[-1].inode = inode;
+}
+
+/** Resizes a directory to nEntries entries (a free tail is cut off when it
+ * shrinks), rebuilds its index, writes it and then its inode. The blocks no
+ * longer used are released last.
+ * @return 0 on success, -1 on failure
+ */
+static int resizeDir(directory_entry* dir, int nEntries) {
+    inode_st* inode = dirInode(dir);
+    int blockSize = vcb->block_size;
+    int oldEntries = sizeOfDE(dir);
+    int oldBlocks = dirBlocks(dir);
+    int blocks = computeBlockNeeded(nEntries * sizeof(directory_entry), blockSize) + 
+                 dirIndexBlocks(nEntries, blockSize);
+    int oldLoc = inode->extents[0].startLoc;
+
+    extent_st old[MAX_EXTENTS];
+    int oldLength = inode->ext_length;
+    memcpy(old, inode->extents, oldLength * sizeof(extent_st));
+
+    if (blocks > oldBlocks && resizeDirBuffer(dir, oldBlocks * blockSize, blocks * blockSize) == -1) {
+        return -1;
+    }
+
+    extent_st exts[MAX_EXTENTS];
+    int nExts = 0;
+    int moved = 0;
+
+    if (blocks > oldBlocks) {
+        nExts = extendExtents(old, oldLength, blocks - oldBlocks, exts);
+
+        // No room left in the extents: the whole directory moves
+        if (nExts == -1) {
+            extents_st newLoc = allocateBlocks(blocks, 0, oldLoc);
+            if (!newLoc.extents || newLoc.size > MAX_EXTENTS) {
+                printf("Error - no space to grow the directory @ %d\n", oldLoc);
+                returnExtents(newLoc);
+                return -1;
+            }
+            nExts = newLoc.size;
+            memcpy(exts, newLoc.extents, nExts * sizeof(extent_st));
+            freeExtents(&newLoc);
+            moved = 1;
+        }
+    } else {
+        // Keep the first blocks of the extents
+        for (int i = 0, kept = 0; kept < blocks; i++) {
+            exts[nExts] = old[i];
+            exts[nExts].countBlock = min(old[i].countBlock, blocks - kept);
+            kept += exts[nExts++].countBlock;
+        }
+    }
+
+    // The old index (and the cut tail) becomes free entries
+    int keep = min(oldEntries, nEntries) * sizeof(directory_entry);
+    memset((char*) dir + keep, 0, max(blocks, oldBlocks) * blockSize - keep);
+
+    // The index is sized by the extents: built once the inode holds the new ones
+    inode->file_size = nEntries * sizeof(directory_entry);
+    memcpy(inode->extents, exts, nExts * sizeof(extent_st));
+    inode->ext_length = nExts;
+    dirIndexBuild(dir);
+
+    // The directory goes to its blocks before the inode points to them
+    int status = writeDirHelper(dir);
+    if (status == 0) status = writeInode(inode);
+    if (status == -1) return -1;
+
+    // Release what the directory does not hold anymore
+    if (moved) {
+        for (int i = 0; i < oldLength; i++) releaseBlocks(old[i].startLoc, old[i].countBlock);
+    } else if (blocks < oldBlocks) {
+        for (int i = 0, pos = 0; i < oldLength; pos += old[i++].countBlock) {
+            int from = max(pos, blocks);
+            int to = pos + old[i].countBlock;
+            if (from < to) releaseBlocks(old[i].startLoc + from - pos, to - from);
+        }
+        resizeDirBuffer(dir, oldBlocks * blockSize, blocks * blockSize);
+    }
+    return 0;
+}
+
+// Move the used entries of a directory down over its free ones, keeping their order
+static void compactDir(directory_entry* dir, int nEntries) {
+    int to = 0;
+    for (int i = 0; i < nEntries; i++) {
+        if (!dir[i].is_used) continue;
+        if (i != to) {
+            dir[to] = dir[i];
+            memset(&dir[i], 0, sizeof(directory_entry));
+        }
+        to++;
+    }
+}
+
+/** Appends more blocks to a list of extents, next to its last extent when
+ * possible. The list is copied to exts with the new blocks.
+ * @return the length of exts, -1 if the blocks do not fit in MAX_EXTENTS
+ */
+static int extendExtents(const extent_st* old, int n, int more, extent_st* exts) {
+    memcpy(exts, old, n * sizeof(extent_st));
+
+    extent_st last = old[n - 1];
+    extents_st added = allocateBlocks(more, 0, last.startLoc + last.countBlock);
+    if (!added.extents) return -1;
+
+    for (int i = 0; i < added.size; i++) {
+        if (exts[n - 1].startLoc + exts[n - 1].countBlock == added.extents[i].startLoc) {
+            exts[n - 1].countBlock += added.extents[i].countBlock;
+        } else if (n < MAX_EXTENTS) {
+            exts[n++] = added.extents[i];
+        } else {
+            returnExtents(added);
             return -1;
         }
     }
-    de[idx].ext_length = 0;
+    freeExtents(&added);
+    return n;
+}
+
+// @return the blocks held by a directory: its entries and its index
+static int dirBlocks(directory_entry* dir) {
+    inode_st* inode = dirInode(dir);
+    int blocks = 0;
+    for (int i = 0; i < inode->ext_length; i++) blocks += inode->extents[i].countBlock;
+    return blocks;
+}
+
+// @return the entries that fill the blocks needed by nEntries entries
+static int fitEntries(int nEntries) {
+    int blocks = computeBlockNeeded(nEntries * sizeof(directory_entry), vcb->block_size);
+    return min(blocks * vcb->block_size / (int) sizeof(directory_entry), DIRECTORY_MAX_ENTRIES);
+}
+
+// @return the address space reserved for a directory buffer
+static size_t dirReserve() {
+    int blocks = computeBlockNeeded(DIRECTORY_MAX_ENTRIES * sizeof(directory_entry), vcb->block_size) +
+                 dirIndexBlocks(DIRECTORY_MAX_ENTRIES, vcb->block_size);
+    return pageRound((size_t) blocks * vcb->block_size);
+}
+
+static size_t pageRound(size_t bytes) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (bytes + page - 1) / page * page;
+}
+
+/** Remove directory entry: it is marked unused and its inode loses a name.
+ * An inode left without names is released, blocks included, once nobody
+ * holds it anymore (see inodePut).
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int removeDE(directory_entry *de, int idx) {
+    inode_st* inode = inodeGet(de[idx].inode);
+
+    de[idx].is_used = 0;
+    de[idx].inode = INODE_NONE;
+    de[idx].file_name[0] = '\0';
     
-    return 0;
+    // The entry named no inode: nothing else to remove
+    if (inode == NULL) return 0;
+
+    inode->nlink--;
+    int status = writeInode(inode);
+    inodePut(inode);
+    
+    return status;
 }
 
 
 // Calculates number of directory entries.
 int sizeOfDE (directory_entry* de) {
-    return de[0].file_size / sizeof(directory_entry);
+    return dirInode(de)->file_size / sizeof(directory_entry);
 }
-
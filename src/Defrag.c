@@ -0,0 +1,209 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Defrag.c
+*
+* Description:: Online defragmenter. Entries are visited depth first,
+* a directory after its content, so a run stopped by its budget can
+* resume by skipping the entries already done. An entry is moved only
+* when the new allocation has fewer extents than it has now. The new
+* copy and the inode pointing to it are written before the old blocks
+* are released.
+*
+**************************************************************/
+
+#include <stdio.h>
+
+#include "structs/Defrag.h"
+#include "structs/DirCache.h"
+
+static uint64_t deadline = 0;   // ioClockNanos() at which the run stops, 0 for no limit
+static int cursor = 0;          // entries done by the previous runs of this pass
+static int visited = 0;         // entries done by the current walk
+
+static int walkDir(directory_entry* dir, defrag_stats_st* stats);
+static int visitEntry(directory_entry* de, defrag_stats_st* stats);
+static int visitInode(inode_st* inode, defrag_stats_st* stats);
+static int relocateInode(inode_st* inode);
+static int moveDirectory(inode_st* inode, extents_st moved);
+static int copyBlocks(const extent_st* from, int nFrom, const extent_st* to, int nTo, int nBlocks);
+static int lbaAt(const extent_st* exts, int n, int idx, int* remain);
+
+/** Defragments the files and directories of the volume, then the free space.
+ * A run ends when budgetMs milliseconds are spent (0 or less: no limit); the
+ * next run continues the same pass.
+ * @return 0 on success, -1 on failure; the numbers of the run are in stats
+ * @author Danish Nguyen
+ */
+int defragVolume(int budgetMs, defrag_stats_st* stats) {
+    memset(stats, 0, sizeof(defrag_stats_st));
+    deadline = (budgetMs > 0) ? ioClockNanos() + (uint64_t) budgetMs * 1000000ULL : 0;
+    visited = 0;
+
+    stats->freeExtentsBefore = freeExtentCount();
+
+    // The root is done last, like every directory after its content
+    int status = walkDir(vcb->root_dir_ptr, stats);
+    if (status == 0) status = visitInode(dirInode(vcb->root_dir_ptr), stats);
+
+    cursor = (status == 1) ? visited : 0;
+    stats->complete = (status == 0);
+
+    // Merge the extents the moves gave back, then persist the map
+    if (compactFreeSpace() == -1 || writeFSToDisk() == -1) status = -1;
+    stats->freeExtentsAfter = freeExtentCount();
+
+    return (status == -1) ? -1 : 0;
+}
+
+/** Visits the entries of a loaded directory, subdirectories first
+ * @return 0 when done, 1 if the budget ran out, -1 on failure
+ */
+static int walkDir(directory_entry* dir, defrag_stats_st* stats) {
+    for (int i = 2; i < sizeOfDE(dir); i++) {
+        if (!dir[i].is_used) continue;
+        if (deadline && ioClockNanos() >= deadline) return 1;
+
+        if (dir[i].is_directory) {
+            directory_entry* child = loadDir(&dir[i]);
+            if (!child) return -1;
+
+            int status = walkDir(child, stats);
+            releaseDir(child);
+            if (status != 0) return status;
+        }
+        if (visitEntry(&dir[i], stats) == -1) return -1;
+    }
+    return 0;
+}
+
+// Visit the inode named by an entry of a directory
+static int visitEntry(directory_entry* de, defrag_stats_st* stats) {
+    inode_st* inode = inodeGet(de->inode);
+    if (!inode) return -1;
+
+    int status = visitInode(inode, stats);
+    inodePut(inode);
+    return status;
+}
+
+// Count an inode and move it if it is fragmented, unless a previous run did
+static int visitInode(inode_st* inode, defrag_stats_st* stats) {
+    if (visited++ < cursor) return 0;
+
+    if (inode->is_directory) stats->dirs++;
+    else stats->files++;
+
+    stats->extentsBefore += inode->ext_length;
+    stats->fragmentedBefore += (inode->ext_length > 1);
+
+    int status = (inode->ext_length > 1) ? relocateInode(inode) : 0;
+    if (status == -1) return -1;
+
+    stats->moved += status;
+    stats->extentsAfter += inode->ext_length;
+    stats->fragmentedAfter += (inode->ext_length > 1);
+    return 0;
+}
+
+/** Moves the blocks of an inode to a new allocation with fewer extents, then
+ * writes the inode pointing to them
+ * @return 1 if moved, 0 if no better allocation was found, -1 on failure
+ */
+static int relocateInode(inode_st* inode) {
+    int blocks = 0;
+    for (int i = 0; i < inode->ext_length; i++) blocks += inode->extents[i].countBlock;
+
+    extents_st moved = allocateBlocks(blocks, 0, inode->extents[0].startLoc);
+
+    if (!moved.extents) return 0;
+    if (moved.size >= inode->ext_length) {
+        returnExtents(moved);
+        return 0;
+    }
+
+    extent_st old[MAX_EXTENTS];
+    int oldLength = inode->ext_length;
+    memcpy(old, inode->extents, oldLength * sizeof(extent_st));
+
+    // Unwritten blocks hold nothing, only the written ones are copied
+    int status = (inode->is_directory) ? moveDirectory(inode, moved)
+                : copyBlocks(old, oldLength, moved.extents, moved.size, blocks - inode->unwritten_blocks);
+    if (status == -1) {
+        returnExtents(moved);
+        return -1;
+    }
+
+    // A directory is written with its inode by moveDir
+    if (!inode->is_directory) {
+        memcpy(inode->extents, moved.extents, moved.size * sizeof(extent_st));
+        inode->ext_length = moved.size;
+        status = writeInode(inode);
+    }
+    freeExtents(&moved);
+    if (status == -1) return -1;
+
+    // Nothing points to the old blocks anymore
+    for (int i = 0; i < oldLength; i++) {
+        if (releaseBlocks(old[i].startLoc, old[i].countBlock) == -1) return -1;
+    }
+    return 1;
+}
+
+// Write a directory to its new extents (see moveDir)
+static int moveDirectory(inode_st* inode, extents_st moved) {
+    directory_entry* dir = dirCacheGet(inode->ino);
+    if (!dir) return -1;
+
+    int status = moveDir(dir, moved.extents, moved.size);
+    releaseDir(dir);
+    return status;
+}
+
+/** Copies the first nBlocks blocks of a file from one list of extents to another
+ * @return 0 on success, -1 on failure
+ */
+static int copyBlocks(const extent_st* from, int nFrom, const extent_st* to, int nTo, int nBlocks) {
+    char* buffer = malloc(DEFRAG_CHUNK_BLOCKS * vcb->block_size);
+    if (!buffer) return -1;
+
+    int status = 0;
+    int prevClass = ioSetClass(IO_CLASS_DATA);
+
+    for (int pos = 0; pos < nBlocks && status == 0; ) {
+        int srcRemain, dstRemain;
+        int src = lbaAt(from, nFrom, pos, &srcRemain);
+        int dst = lbaAt(to, nTo, pos, &dstRemain);
+        if (src == -1 || dst == -1) {
+            status = -1;
+            break;
+        }
+
+        int count = min(min(srcRemain, dstRemain), min(DEFRAG_CHUNK_BLOCKS, nBlocks - pos));
+        if (cacheRead(buffer, count, src) < count || cacheWrite(buffer, count, dst) < count) {
+            status = -1;
+        }
+        pos += count;
+    }
+    ioSetClass(prevClass);
+
+    free(buffer);
+    return status;
+}
+
+// @return the LBA of block idx of a list of extents and the blocks left in its extent, -1 if past the end
+static int lbaAt(const extent_st* exts, int n, int idx, int* remain) {
+    for (int i = 0; i < n; i++) {
+        if (idx < exts[i].countBlock) {
+            *remain = exts[i].countBlock - idx;
+            return exts[i].startLoc + idx;
+        }
+        idx -= exts[i].countBlock;
+    }
+    return -1;
+}
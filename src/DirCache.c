@@ -0,0 +1,379 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: DirCache.c
+*
+* Description:: Shared, reference counted directories and cached name
+* lookups. A directory that is invalidated (removed) while someone
+* still holds it is taken out of the table and freed with its last
+* reference. Directories are read outside of the lock, so threads
+* loading different directories do not wait for each other.
+*
+**************************************************************/
+
+#include <stdio.h>
+
+#include "structs/VCB.h"
+#include "structs/DirCache.h"
+
+static dir_node_st* buckets[DIR_CACHE_BUCKETS];
+static dir_node_st* staleList = NULL;  // invalidated directories still referenced
+static int nDirs = 0;                  // directories in the buckets
+static unsigned long dirClock = 0;     // stamps lastUse of directories and names
+
+static dir_name_st names[DIR_CACHE_NAMES];
+static int nameBuckets[DIR_CACHE_BUCKETS];
+static int nNames = 0;                 // slots of names[] used so far
+static int namesReady = 0;
+
+static pthread_mutex_t dirLock = PTHREAD_MUTEX_INITIALIZER;
+
+static dir_node_st* findDir(uint32_t ino);
+static dir_node_st* findHolder(directory_entry* dir);
+static dir_node_st* insertDir(directory_entry* dir, uint32_t ino);
+static void unlinkDir(dir_node_st* node);
+static void trimDirs();
+static int findName(int parentIno, const char* name);
+static int nameBucket(int parentIno, const char* name);
+static void dropName(int slot);
+static void forgetNames(int parentIno);
+static void initNames();
+
+/** Gets the directory of inode ino, read from disk only when it is not
+ * cached. The caller holds a reference until dirCacheRelease.
+ * @return the shared directory or NULL if it can not be loaded
+ * @author Danish Nguyen
+ */
+directory_entry* dirCacheGet(uint32_t ino) {
+    pthread_mutex_lock(&dirLock);
+    dir_node_st* node = findDir(ino);
+    if (node) {
+        node->refs++;
+        node->lastUse = ++dirClock;
+        pthread_mutex_unlock(&dirLock);
+        return node->dir;
+    }
+    pthread_mutex_unlock(&dirLock);
+
+    directory_entry* dir = readDirHelper(ino);
+    if (!dir) return NULL;
+
+    pthread_mutex_lock(&dirLock);
+
+    // Another thread may have loaded it meanwhile, its copy wins
+    node = findDir(ino);
+    if (node) {
+        freeDirBuffer(dir);
+    } else {
+        node = insertDir(dir, ino);
+    }
+    if (!node) {
+        pthread_mutex_unlock(&dirLock);
+        freeDirBuffer(dir);
+        return NULL;
+    }
+    node->refs++;
+    node->lastUse = ++dirClock;
+    dir = node->dir;
+
+    trimDirs();
+    pthread_mutex_unlock(&dirLock);
+    return dir;
+}
+
+/** Adds a directory built in memory (a newly formatted root). The cache owns
+ * it from now on and the caller holds one reference.
+ * @return 0 on success, -1 on failure
+ */
+int dirCacheAdd(directory_entry* dir) {
+    pthread_mutex_lock(&dirLock);
+    dir_node_st* node = insertDir(dir, dirInode(dir)->ino);
+    if (node) {
+        node->refs = 1;
+        node->lastUse = ++dirClock;
+    }
+    pthread_mutex_unlock(&dirLock);
+    return node ? 0 : -1;
+}
+
+// Take one more reference on a cached directory (no effect on other pointers)
+void dirCacheHold(directory_entry* dir) {
+    if (!dir) return;
+
+    pthread_mutex_lock(&dirLock);
+    dir_node_st* node = findHolder(dir);
+    if (node) node->refs++;
+    pthread_mutex_unlock(&dirLock);
+}
+
+/** Drops a reference taken by dirCacheGet/dirCacheHold. An unreferenced
+ * directory stays cached unless it was invalidated or the cache is full.
+ * Pointers the cache does not know are left alone.
+ */
+void dirCacheRelease(directory_entry* dir) {
+    if (!dir) return;
+
+    pthread_mutex_lock(&dirLock);
+    dir_node_st* node = findHolder(dir);
+    if (!node || node->refs == 0) {
+        pthread_mutex_unlock(&dirLock);
+        return;
+    }
+    node->refs--;
+    node->lastUse = ++dirClock;
+
+    if (node->refs == 0 && node->stale) {
+        dir_node_st** link = &staleList;
+        while (*link != node) link = &(*link)->next;
+        *link = node->next;
+
+        freeDirBuffer(node->dir);
+        free(node);
+    }
+    trimDirs();
+    pthread_mutex_unlock(&dirLock);
+}
+
+/** Forgets a removed directory, and every name looked up in it. Holders keep
+ * a valid copy until they release it.
+ */
+void dirCacheInvalidate(uint32_t ino) {
+    pthread_mutex_lock(&dirLock);
+    dir_node_st* node = findDir(ino);
+    if (node) {
+        unlinkDir(node);
+        if (node->refs == 0) {
+            freeDirBuffer(node->dir);
+            free(node);
+        } else {
+            node->stale = 1;
+            node->next = staleList;
+            staleList = node;
+        }
+    }
+    forgetNames(ino);
+    pthread_mutex_unlock(&dirLock);
+}
+
+/** Counts the directory streams open on a cached directory: delta is +1 when
+ * one opens, -1 when it closes, 0 to only ask. Entries of a directory are
+ * moved only while no stream walks them by index.
+ * @return the streams open on dir after the change, 0 if it is not cached
+ */
+int dirCacheStreams(directory_entry* dir, int delta) {
+    if (!dir) return 0;
+
+    pthread_mutex_lock(&dirLock);
+    dir_node_st* node = findHolder(dir);
+    int streams = 0;
+    if (node) {
+        node->streams += delta;
+        streams = node->streams;
+    }
+    pthread_mutex_unlock(&dirLock);
+    return streams;
+}
+
+// Free every cached directory, referenced or not, and every name (unmount)
+void freeDirCache() {
+    pthread_mutex_lock(&dirLock);
+    for (int b = 0; b < DIR_CACHE_BUCKETS; b++) {
+        while (buckets[b]) {
+            dir_node_st* node = buckets[b];
+            buckets[b] = node->next;
+            freeDirBuffer(node->dir);
+            free(node);
+        }
+    }
+    while (staleList) {
+        dir_node_st* node = staleList;
+        staleList = node->next;
+        freeDirBuffer(node->dir);
+        free(node);
+    }
+    nDirs = 0;
+    namesReady = 0;
+    pthread_mutex_unlock(&dirLock);
+}
+
+/** Looks up a name in the directory of inode parentIno
+ * @return the index of the entry, DIR_NAME_ABSENT if the name is known not to
+ * exist, DIR_NAME_UNKNOWN if the directory has to be searched
+ */
+int dirCacheLookup(int parentIno, const char* name) {
+    pthread_mutex_lock(&dirLock);
+    int slot = findName(parentIno, name);
+    int index = DIR_NAME_UNKNOWN;
+    if (slot != -1) {
+        names[slot].lastUse = ++dirClock;
+        index = names[slot].index;
+    }
+    pthread_mutex_unlock(&dirLock);
+    return index;
+}
+
+/** Records the result of a directory search: the index of the entry or
+ * DIR_NAME_ABSENT. The least recently used name makes room when full.
+ */
+void dirCacheRemember(int parentIno, const char* name, int index) {
+    if (strlen(name) >= MAX_FILENAME) return;
+
+    pthread_mutex_lock(&dirLock);
+    int slot = findName(parentIno, name);
+
+    if (slot == -1) {
+        if (nNames < DIR_CACHE_NAMES) {
+            slot = nNames++;
+        } else {
+            slot = 0;
+            for (int i = 0; i < DIR_CACHE_NAMES; i++) {
+                if (names[i].parentIno == -1) {
+                    slot = i;
+                    break;
+                }
+                if (names[i].lastUse < names[slot].lastUse) slot = i;
+            }
+            if (names[slot].parentIno != -1) dropName(slot);
+        }
+        names[slot].parentIno = parentIno;
+        strcpy(names[slot].name, name);
+
+        int b = nameBucket(parentIno, name);
+        names[slot].hashNext = nameBuckets[b];
+        nameBuckets[b] = slot;
+    }
+    names[slot].index = index;
+    names[slot].lastUse = ++dirClock;
+    pthread_mutex_unlock(&dirLock);
+}
+
+// Forget a name whose entry was created or removed in the directory of inode parentIno
+void dirCacheForget(int parentIno, const char* name) {
+    pthread_mutex_lock(&dirLock);
+    int slot = findName(parentIno, name);
+    if (slot != -1) dropName(slot);
+    pthread_mutex_unlock(&dirLock);
+}
+
+// Forget every name looked up in the directory of inode parentIno (its entries moved)
+void dirCacheForgetAll(int parentIno) {
+    pthread_mutex_lock(&dirLock);
+    forgetNames(parentIno);
+    pthread_mutex_unlock(&dirLock);
+}
+
+// @return the cached directory of inode ino, NULL if not cached
+static dir_node_st* findDir(uint32_t ino) {
+    for (dir_node_st* node = buckets[ino % DIR_CACHE_BUCKETS]; node; node = node->next) {
+        if (node->ino == ino) return node;
+    }
+    return NULL;
+}
+
+// @return the node holding dir, searched by its inode first, NULL if not cached
+static dir_node_st* findHolder(directory_entry* dir) {
+    dir_node_st* node = findDir(dirInode(dir)->ino);
+    if (node && node->dir == dir) return node;
+
+    for (int b = 0; b < DIR_CACHE_BUCKETS; b++) {
+        for (node = buckets[b]; node; node = node->next) {
+            if (node->dir == dir) return node;
+        }
+    }
+    for (node = staleList; node; node = node->next) {
+        if (node->dir == dir) return node;
+    }
+    return NULL;
+}
+
+static dir_node_st* insertDir(directory_entry* dir, uint32_t ino) {
+    dir_node_st* node = malloc(sizeof(dir_node_st));
+    if (!node) return NULL;
+
+    int b = ino % DIR_CACHE_BUCKETS;
+    *node = (dir_node_st) { ino, dir, 0, 0, 0, 0, buckets[b] };
+    buckets[b] = node;
+    nDirs++;
+    return node;
+}
+
+static void unlinkDir(dir_node_st* node) {
+    dir_node_st** link = &buckets[node->ino % DIR_CACHE_BUCKETS];
+    while (*link && *link != node) link = &(*link)->next;
+    if (*link) {
+        *link = node->next;
+        nDirs--;
+    }
+    node->next = NULL;
+}
+
+// Evict unreferenced directories, least recently used first, down to DIR_CACHE_DIRS
+static void trimDirs() {
+    while (nDirs > DIR_CACHE_DIRS) {
+        dir_node_st* victim = NULL;
+        for (int b = 0; b < DIR_CACHE_BUCKETS; b++) {
+            for (dir_node_st* node = buckets[b]; node; node = node->next) {
+                if (node->refs == 0 && (!victim || node->lastUse < victim->lastUse)) victim = node;
+            }
+        }
+        if (!victim) return; // every directory is in use
+
+        unlinkDir(victim);
+        forgetNames(victim->ino);
+        freeDirBuffer(victim->dir);
+        free(victim);
+    }
+}
+
+// @return the slot caching name in the directory of inode parentIno, -1 if none
+static int findName(int parentIno, const char* name) {
+    if (!namesReady) initNames();
+
+    for (int s = nameBuckets[nameBucket(parentIno, name)]; s != -1; s = names[s].hashNext) {
+        if (names[s].parentIno == parentIno && strcmp(names[s].name, name) == 0) return s;
+    }
+    return -1;
+}
+
+// FNV-1a of the name mixed with the directory inode
+static int nameBucket(int parentIno, const char* name) {
+    unsigned int hash = 2166136261u ^ (unsigned int) parentIno;
+    for (const char* c = name; *c; c++) hash = (hash ^ (unsigned char) *c) * 16777619u;
+    return hash % DIR_CACHE_BUCKETS;
+}
+
+static void dropName(int slot) {
+    int* link = &nameBuckets[nameBucket(names[slot].parentIno, names[slot].name)];
+    while (*link != -1) {
+        if (*link == slot) {
+            *link = names[slot].hashNext;
+            break;
+        }
+        link = &names[*link].hashNext;
+    }
+    names[slot].parentIno = -1;
+    names[slot].hashNext = -1;
+}
+
+static void forgetNames(int parentIno) {
+    if (!namesReady) return;
+
+    for (int i = 0; i < nNames; i++) {
+        if (names[i].parentIno == parentIno) dropName(i);
+    }
+}
+
+static void initNames() {
+    for (int b = 0; b < DIR_CACHE_BUCKETS; b++) nameBuckets[b] = -1;
+    for (int i = 0; i < DIR_CACHE_NAMES; i++) {
+        names[i].parentIno = -1;
+        names[i].hashNext = -1;
+    }
+    nNames = 0;
+    namesReady = 1;
+}
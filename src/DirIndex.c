@@ -0,0 +1,246 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: DirIndex.c
+*
+* Description:: Hashed name index of a directory. Slots are probed
+* linearly from the hash of the name; a removed slot is filled by
+* shifting back the slots that follow it, so the table never holds
+* tombstones and a probe always ends at an empty slot. Every change
+* writes back only the blocks of the slots it touched.
+*
+**************************************************************/
+
+#include <stdio.h>
+
+#include "structs/VCB.h"
+#include "structs/DirIndex.h"
+
+#define SLOT_TAG_MASK 0xFF000000u   // bits of the hash kept in a slot
+#define SLOT_IDX_MASK 0x00FFFFFFu   // entry index + 1
+
+static uint32_t nameHash(const char* name);
+static void putSlot(dir_index_st* index, uint32_t hash, int idx);
+static int writeSlots(directory_entry* dir, dir_index_st* index, uint32_t first, uint32_t count);
+
+// @return the blocks of an index with DIR_INDEX_LOAD slots per entry for nEntries entries
+int dirIndexBlocks(int nEntries, int blockSize) {
+    int bytes = sizeof(dir_index_st) + nEntries * DIR_INDEX_LOAD * sizeof(uint32_t);
+    return computeBlockNeeded(bytes, blockSize);
+}
+
+/** Builds the index of a directory in memory from its used entries, with as
+ * many slots as its index blocks hold. The caller writes the directory.
+ * @return 0 on success, -1 if the directory has no room for an index
+ * @author Danish Nguyen
+ */
+int dirIndexBuild(directory_entry* dir) {
+    inode_st* inode = dirInode(dir);
+    int nEntries = sizeOfDE(dir);
+    int entryBlocks = computeBlockNeeded(inode->file_size, vcb->block_size);
+
+    int blocks = 0;
+    for (int i = 0; i < inode->ext_length; i++) blocks += inode->extents[i].countBlock;
+
+    if (nEntries > SLOT_IDX_MASK - 1 ||
+        blocks - entryBlocks < dirIndexBlocks(nEntries, vcb->block_size)) return -1;
+
+    dir_index_st* index = (dir_index_st*) ((char*) dir + entryBlocks * vcb->block_size);
+    int bytes = (blocks - entryBlocks) * vcb->block_size;
+    memset(index, 0, bytes);
+
+    index->magic = DIR_INDEX_MAGIC;
+    index->nSlots = (bytes - sizeof(dir_index_st)) / sizeof(uint32_t);
+    index->nEntries = nEntries;
+
+    for (int i = 0; i < nEntries; i++) {
+        if (dir[i].is_used) putSlot(index, nameHash(dir[i].file_name), i);
+    }
+    dirIndexRecount(dir);
+    return 0;
+}
+
+// Count the used entries of a directory into its index header, after a load or a build
+void dirIndexRecount(directory_entry* dir) {
+    dir_index_st* index = dirIndexOf(dir);
+    if (!index) return;
+
+    index->nUsed = 0;
+    index->lastUsed = 0;
+    index->freeHint = index->nEntries;
+
+    for (int i = 0; i < index->nEntries; i++) {
+        if (dir[i].is_used) {
+            index->nUsed++;
+            index->lastUsed = i;
+        } else if (index->freeHint == index->nEntries) {
+            index->freeHint = i;
+        }
+    }
+}
+
+/** Looks up a name through the index of a directory
+ * @return the index of the entry, -1 if there is none, DIR_INDEX_NONE if
+ * the directory has no index and must be searched entry by entry
+ * @author Danish Nguyen
+ */
+int dirIndexFind(directory_entry* dir, const char* name) {
+    dir_index_st* index = dirIndexOf(dir);
+    if (!index) return DIR_INDEX_NONE;
+
+    uint32_t hash = nameHash(name);
+    uint32_t s = hash % index->nSlots;
+
+    for (uint32_t n = 0; n < index->nSlots; n++, s = (s + 1) % index->nSlots) {
+        uint32_t slot = index->slots[s];
+        if (slot == 0) break;
+        if ((slot & SLOT_TAG_MASK) != (hash & SLOT_TAG_MASK)) continue;
+
+        // A slot left by an entry that was never written is skipped
+        int idx = (slot & SLOT_IDX_MASK) - 1;
+        if (idx < index->nEntries && dir[idx].is_used && strcmp(dir[idx].file_name, name) == 0) {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+/** Finds a free entry in a directory, from the free slot hint of its index
+ * (from the start for a directory without index)
+ * @return the index of the free entry, -1 if the directory is full
+ */
+int dirIndexFreeEntry(directory_entry* dir) {
+    dir_index_st* index = dirIndexOf(dir);
+    int nEntries = sizeOfDE(dir);
+
+    for (int i = index ? index->freeHint : 0; i < nEntries; i++) {
+        if (!dir[i].is_used) {
+            if (index) index->freeHint = i;
+            return i;
+        }
+    }
+    if (index) index->freeHint = nEntries;
+    return -1;
+}
+
+/** Adds the (used) entry idx to the index of its directory and writes the
+ * slot back. Nothing is done for a directory without index.
+ * @return 0 on success, -1 on failure
+ */
+int dirIndexAdd(directory_entry* dir, int idx) {
+    dir_index_st* index = dirIndexOf(dir);
+    if (!index) return 0;
+
+    index->nUsed++;
+    index->lastUsed = max(index->lastUsed, idx);
+    if (index->freeHint == idx) index->freeHint = idx + 1;
+
+    uint32_t hash = nameHash(dir[idx].file_name);
+    uint32_t value = (hash & SLOT_TAG_MASK) | (uint32_t) (idx + 1);
+    uint32_t s = hash % index->nSlots;
+
+    for (uint32_t n = 0; n < index->nSlots; n++, s = (s + 1) % index->nSlots) {
+        if (index->slots[s] == value) return 0; // already indexed
+        if (index->slots[s] == 0) {
+            index->slots[s] = value;
+            return writeSlots(dir, index, s, 1);
+        }
+    }
+    return -1;
+}
+
+/** Takes the entry idx out of the index of its directory, before its name is
+ * cleared, and writes back the slots shifted to fill the hole
+ * @return 0 on success, -1 on failure
+ */
+int dirIndexRemove(directory_entry* dir, int idx) {
+    dir_index_st* index = dirIndexOf(dir);
+    if (!index) return 0;
+
+    index->nUsed--;
+    index->freeHint = min(index->freeHint, idx);
+    if (index->lastUsed == idx) {
+        // "." is always used, the search stops there at the latest
+        int last = idx - 1;
+        while (last > 0 && !dir[last].is_used) last--;
+        index->lastUsed = last;
+    }
+
+    uint32_t nSlots = index->nSlots;
+    uint32_t hash = nameHash(dir[idx].file_name);
+    uint32_t value = (hash & SLOT_TAG_MASK) | (uint32_t) (idx + 1);
+    uint32_t hole = hash % nSlots;
+
+    uint32_t n = 0;
+    while (n < nSlots && index->slots[hole] != value) {
+        if (index->slots[hole] == 0) return 0; // not indexed
+        hole = (hole + 1) % nSlots;
+        n++;
+    }
+    if (n == nSlots) return 0;
+
+    // Shift back every following slot whose probe starts at or before the hole
+    uint32_t first = hole;
+    for (uint32_t next = (hole + 1) % nSlots; index->slots[next] != 0; next = (next + 1) % nSlots) {
+        int nextIdx = (index->slots[next] & SLOT_IDX_MASK) - 1;
+        uint32_t home = (nextIdx < index->nEntries) ? nameHash(dir[nextIdx].file_name) % nSlots : next;
+
+        // Distance from its home to the hole and to where it is now
+        if ((hole - home + nSlots) % nSlots < (next - home + nSlots) % nSlots) {
+            index->slots[hole] = index->slots[next];
+            hole = next;
+        }
+        if (next == first) break;
+    }
+    index->slots[hole] = 0;
+
+    return writeSlots(dir, index, first, (hole - first + nSlots) % nSlots + 1);
+}
+
+// @return the index of a directory, NULL if it has none or it does not match the directory
+dir_index_st* dirIndexOf(directory_entry* dir) {
+    inode_st* inode = dirInode(dir);
+    int entryBlocks = computeBlockNeeded(inode->file_size, vcb->block_size);
+
+    int blocks = 0;
+    for (int i = 0; i < inode->ext_length; i++) blocks += inode->extents[i].countBlock;
+    if (blocks <= entryBlocks) return NULL;
+
+    dir_index_st* index = (dir_index_st*) ((char*) dir + entryBlocks * vcb->block_size);
+    uint64_t room = (uint64_t) (blocks - entryBlocks) * vcb->block_size - sizeof(dir_index_st);
+
+    if (index->magic != DIR_INDEX_MAGIC || index->nEntries != sizeOfDE(dir) ||
+        index->nSlots == 0 || (uint64_t) index->nSlots * sizeof(uint32_t) > room) return NULL;
+    return index;
+}
+
+// FNV-1a of a name
+static uint32_t nameHash(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c; c++) hash = (hash ^ (unsigned char) *c) * 16777619u;
+    return hash;
+}
+
+// Put an entry in the first empty slot of its probe (building only, nothing is written)
+static void putSlot(dir_index_st* index, uint32_t hash, int idx) {
+    uint32_t s = hash % index->nSlots;
+    while (index->slots[s] != 0) s = (s + 1) % index->nSlots;
+    index->slots[s] = (hash & SLOT_TAG_MASK) | (uint32_t) (idx + 1);
+}
+
+// Write back count slots from first, wrapping around the end of the table
+static int writeSlots(directory_entry* dir, dir_index_st* index, uint32_t first, uint32_t count) {
+    uint32_t head = min(count, index->nSlots - first);
+    int offset = (char*) &index->slots[first] - (char*) dir;
+
+    if (writeDirRange(dir, offset, head * sizeof(uint32_t)) == -1) return -1;
+    if (head == count) return 0;
+
+    offset = (char*) &index->slots[0] - (char*) dir;
+    return writeDirRange(dir, offset, (count - head) * sizeof(uint32_t));
+}
@@ -0,0 +1,206 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Discard.c
+*
+* Description:: Queue of released ranges punched out of the volume
+* file. The queue is kept sorted by start with no two ranges touching,
+* so a release next to a queued range extends it. The volume file is
+* opened a second time, which works the same under both backends
+* (fsLow.o and the mmap backend share the page cache of the file).
+*
+**************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "structs/Discard.h"
+#include "structs/IOStats.h"
+#include "structs/fs_utils.h"
+
+static int volumeFd = -1;           // descriptor used to punch, -1 while disabled
+static uint64_t volBlockSize = 0;
+
+static extent_st pending[DISCARD_MAX_RANGES]; // sorted by startLoc
+static int nPending = 0;
+static pthread_mutex_t discardLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int firstTouching(int lba);
+static void insertRange(int i, extent_st range);
+static void removeRanges(int i, int count);
+static int punchHole(extent_st range);
+
+/** Opens the volume file for discards. Must be called with the path given to
+ * startPartitionSystem; without it (or without hole punching on the host)
+ * released blocks simply stay allocated in the volume file.
+ * @return 0 on success, -1 if discards are disabled
+ * @author Danish Nguyen
+ */
+int initDiscard(const char* volumePath, uint64_t blockSize) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if (volumeFd != -1) exitDiscard();
+
+    volumeFd = open(volumePath, O_RDWR);
+    if (volumeFd == -1) return -1;
+
+    volBlockSize = blockSize;
+    nPending = 0;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+// Close the volume file, queued ranges are forgotten (see discardFlush)
+void exitDiscard() {
+    pthread_mutex_lock(&discardLock);
+    if (volumeFd != -1) close(volumeFd);
+    volumeFd = -1;
+    nPending = 0;
+    pthread_mutex_unlock(&discardLock);
+}
+
+/** Queues released blocks for the next discardFlush, merged with the queued
+ * ranges they overlap or touch. When the queue is full the range is not
+ * queued: its blocks only stay allocated on the host.
+ * @author Danish Nguyen
+ */
+void discardBlocks(int startLoc, int countBlocks) {
+    if (volumeFd == -1 || countBlocks <= 0) return;
+
+    pthread_mutex_lock(&discardLock);
+    int first = firstTouching(startLoc);
+    int end = startLoc + countBlocks;
+
+    int last = first;
+    while (last < nPending && pending[last].startLoc <= end) {
+        startLoc = min(startLoc, pending[last].startLoc);
+        end = max(end, pending[last].startLoc + pending[last].countBlock);
+        last++;
+    }
+
+    if (last > first) {
+        pending[first] = (extent_st) { startLoc, end - startLoc };
+        removeRanges(first + 1, last - first - 1);
+    } else {
+        insertRange(first, (extent_st) { startLoc, countBlocks });
+    }
+    pthread_mutex_unlock(&discardLock);
+}
+
+/** Takes blocks that are allocated again off the queue. Called by the
+ * allocator before the blocks are handed out, so no new data can be punched.
+ */
+void discardCancel(int startLoc, int countBlocks) {
+    if (volumeFd == -1 || countBlocks <= 0) return;
+
+    pthread_mutex_lock(&discardLock);
+    int end = startLoc + countBlocks;
+
+    for (int i = firstTouching(startLoc); i < nPending && pending[i].startLoc < end; ) {
+        int rangeEnd = pending[i].startLoc + pending[i].countBlock;
+        if (rangeEnd <= startLoc) {
+            i++;
+            continue;
+        }
+        int hasHead = pending[i].startLoc < startLoc;
+        int hasTail = rangeEnd > end;
+
+        if (hasHead && hasTail) {
+            // Split in two; with a full queue the tail is not discarded
+            pending[i].countBlock = startLoc - pending[i].startLoc;
+            insertRange(i + 1, (extent_st) { end, rangeEnd - end });
+            break;
+        }
+        if (hasHead) {
+            pending[i].countBlock = startLoc - pending[i].startLoc;
+            i++;
+        } else if (hasTail) {
+            pending[i] = (extent_st) { end, rangeEnd - end };
+            break;
+        } else {
+            removeRanges(i, 1);
+        }
+    }
+    pthread_mutex_unlock(&discardLock);
+}
+
+/** Punches every queued range out of the volume file and empties the queue.
+ * Call it only once the metadata freeing the ranges is home. The queue stays
+ * locked meanwhile, so an allocation waits until the punching is over.
+ * @return 0 on success, -1 if a range could not be punched
+ * @author Danish Nguyen
+ */
+int discardFlush() {
+    pthread_mutex_lock(&discardLock);
+    int status = 0;
+
+    for (int i = 0; i < nPending && volumeFd != -1; i++) {
+        if (punchHole(pending[i]) == -1) status = -1;
+    }
+    nPending = 0;
+
+    pthread_mutex_unlock(&discardLock);
+    return status;
+}
+
+// @return index of the first queued range that ends at or after lba
+static int firstTouching(int lba) {
+    int low = 0, high = nPending;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (pending[mid].startLoc + pending[mid].countBlock < lba) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// Insert a range at index i, dropped when the queue is full
+static void insertRange(int i, extent_st range) {
+    if (nPending == DISCARD_MAX_RANGES) return;
+
+    memmove(&pending[i + 1], &pending[i], (nPending - i) * sizeof(extent_st));
+    pending[i] = range;
+    nPending++;
+}
+
+static void removeRanges(int i, int count) {
+    memmove(&pending[i], &pending[i + count], (nPending - i - count) * sizeof(extent_st));
+    nPending -= count;
+}
+
+/** Deallocates the blocks of a range in the volume file, they read back as
+ * zeros. A host that can not punch holes disables discards.
+ * @return 0 on success, -1 on failure
+ */
+static int punchHole(extent_st range) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+    // The first block of the volume file is the partition header
+    off_t offset = (off_t) (range.startLoc + 1) * volBlockSize;
+    off_t length = (off_t) range.countBlock * volBlockSize;
+
+    if (fallocate(volumeFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0) {
+        ioRecordDiscard(range.countBlock);
+        return 0;
+    }
+    if (errno == EOPNOTSUPP || errno == ENOSYS) {
+        printf("Hole punching is not supported by the host, discards are disabled\n");
+        close(volumeFd);
+        volumeFd = -1;
+        return 0;
+    }
+    printf("ERROR - punchHole @ %d - count: %d - errno: %d\n", range.startLoc,
+                                                    range.countBlock, errno);
+#endif
+    return -1;
+}
@@ -0,0 +1,474 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: ExtentTree.c
+*
+* Description:: Free-extent tree. Allocation takes the smallest extent
+* that holds the request (best fit) and, when none does, the fewest
+* extents that add up to it. Release merges the freed run with the
+* extents right before and after it. Keys are unique (start LBA, or
+* length then start LBA), so a node is removed from both trees before
+* its extent changes and inserted again afterwards.
+*
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "structs/ExtentTree.h"
+#include "structs/fs_utils.h"
+
+static int compareNodes(int t, const ext_node_st* a, const ext_node_st* b);
+static ext_node_st* avlInsert(int t, ext_node_st* root, ext_node_st* node);
+static ext_node_st* avlRemove(int t, ext_node_st* root, ext_node_st* node);
+static ext_node_st* removeMin(int t, ext_node_st* root);
+static ext_node_st* rebalance(int t, ext_node_st* n);
+static ext_node_st* rotate(int t, ext_node_st* n, int dir);
+static int height(int t, const ext_node_st* n);
+
+static ext_node_st* bestFit(extent_tree_st* tree, int nBlocks);
+static ext_node_st* largest(extent_tree_st* tree);
+static ext_node_st* floorStart(extent_tree_st* tree, int startLoc);
+static ext_node_st* ceilStart(extent_tree_st* tree, int startLoc);
+static ext_node_st* nearGoal(extent_tree_st* tree, int goal, int nBlocks, int* takeFrom);
+static int carve(extent_tree_st* tree, ext_node_st* node, int startLoc, int countBlock);
+
+static void linkNode(extent_tree_st* tree, ext_node_st* node);
+static void unlinkNode(extent_tree_st* tree, ext_node_st* node);
+static int addFree(extent_tree_st* tree, int startLoc, int countBlock);
+static void freeNodes(ext_node_st* root);
+
+static int putVarint(char* buf, int pos, int maxBytes, uint32_t value);
+static int getVarint(const char* buf, int pos, int maxBytes, uint32_t* value);
+
+/** Starts a new tree holding one free extent (formatting a volume)
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int treeInit(extent_tree_st* tree, int startLoc, int countBlock) {
+    treeDestroy(tree);
+    return addFree(tree, startLoc, countBlock);
+}
+
+/** Rebuilds the tree from its on-disk image
+ * @return 0 on success, -1 if the image is not valid
+ * @author Danish Nguyen
+ */
+int treeLoad(extent_tree_st* tree, const char* image, int maxBytes) {
+    treeDestroy(tree);
+
+    const tree_image_st* header = (const tree_image_st*) image;
+    if (maxBytes < (int) sizeof(tree_image_st) || header->magic != TREE_IMAGE_MAGIC ||
+                                                header->nBytes > (uint32_t) maxBytes) {
+        printf("ERROR - treeLoad - free extent tree image is not valid\n");
+        return -1;
+    }
+
+    int pos = sizeof(tree_image_st);
+    uint32_t prevEnd = 0;
+
+    for (uint32_t i = 0; i < header->nExtents; i++) {
+        uint32_t gap, length;
+        pos = getVarint(image, pos, header->nBytes, &gap);
+        if (pos != -1) pos = getVarint(image, pos, header->nBytes, &length);
+
+        if (pos == -1 || addFree(tree, prevEnd + gap, length) == -1) {
+            printf("ERROR - treeLoad - free extent %u is not valid\n", i);
+            treeDestroy(tree);
+            return -1;
+        }
+        prevEnd += gap + length;
+    }
+
+    if (tree->totalFree != (int) header->totalFree) {
+        printf("ERROR - treeLoad - free blocks %d do not match %u\n", tree->totalFree, header->totalFree);
+        treeDestroy(tree);
+        return -1;
+    }
+    return 0;
+}
+
+/** Writes the tree in start order: header, then for every extent the gap
+ * since the end of the previous one and its length, both as varints.
+ * @return number of bytes used, -1 if the image does not fit in maxBytes
+ * @author Danish Nguyen
+ */
+int treeSerialize(extent_tree_st* tree, char* image, int maxBytes) {
+    if (maxBytes < (int) sizeof(tree_image_st)) return -1;
+
+    int pos = sizeof(tree_image_st);
+    uint32_t prevEnd = 0;
+
+    // In-order walk of the start tree with an explicit stack (height <= 1.44 log n)
+    ext_node_st* stack[64];
+    int top = 0;
+    ext_node_st* n = tree->roots[TREE_BY_START];
+
+    while (n || top > 0) {
+        while (n) {
+            stack[top++] = n;
+            n = n->child[TREE_BY_START][0];
+        }
+        n = stack[--top];
+
+        pos = putVarint(image, pos, maxBytes, n->ext.startLoc - prevEnd);
+        if (pos != -1) pos = putVarint(image, pos, maxBytes, n->ext.countBlock);
+        if (pos == -1) return -1;
+
+        prevEnd = n->ext.startLoc + n->ext.countBlock;
+        n = n->child[TREE_BY_START][1];
+    }
+
+    *(tree_image_st*) image = (tree_image_st) { TREE_IMAGE_MAGIC, tree->nExtents, pos, tree->totalFree };
+    return pos;
+}
+
+/** Releases every node of the tree */
+void treeDestroy(extent_tree_st* tree) {
+    freeNodes(tree->roots[TREE_BY_START]);
+    tree->roots[TREE_BY_START] = tree->roots[TREE_BY_SIZE] = NULL;
+    tree->nExtents = 0;
+    tree->totalFree = 0;
+}
+
+/** Allocates nBlocks as close as possible after goal: from goal itself when the
+ * free extent holding it is long enough, else from one of the next free 
+ * extents that holds the whole request. Without a goal (-1) or a fit near it,
+ * the smallest extent that holds the whole request is used. When no extent 
+ * does, the remainder is repeatedly served by best fit or by the largest 
+ * extent, so the request is split into as few extents as possible.
+ * Every extent handed out has at least minContinuous blocks, except the last
+ * piece of a split request.
+ * @return extents allocated, { NULL, 0 } on failure
+ * @author Danish Nguyen
+ */
+extents_st treeAllocate(extent_tree_st* tree, int nBlocks, int minContinuous, int goal) {
+    extents_st reqBlocks = { NULL, 0 };
+    if (nBlocks < 1 || nBlocks > tree->totalFree || nBlocks < minContinuous) return reqBlocks;
+
+    int capacity = 4;
+    reqBlocks.extents = malloc(capacity * sizeof(extent_st));
+    if (!reqBlocks.extents) return reqBlocks;
+
+    int takeFrom;
+    ext_node_st* near = (goal >= 0) ? nearGoal(tree, goal, nBlocks, &takeFrom) : NULL;
+
+    if (near) {
+        reqBlocks.extents[reqBlocks.size++] = (extent_st) { takeFrom, nBlocks };
+        if (carve(tree, near, takeFrom, nBlocks) == 0) return reqBlocks;
+
+        free(reqBlocks.extents);
+        return (extents_st) { NULL, 0 };
+    }
+
+    int remain = nBlocks;
+    while (remain > 0) {
+        ext_node_st* node = bestFit(tree, remain);
+        if (!node) node = largest(tree);
+
+        if (!node || node->ext.countBlock < minContinuous) break;
+
+        if (reqBlocks.size == capacity) {
+            capacity *= 2;
+            extent_st* grown = realloc(reqBlocks.extents, capacity * sizeof(extent_st));
+            if (!grown) break;
+            reqBlocks.extents = grown;
+        }
+
+        // Carve the blocks from the front of the free extent
+        int take = min(node->ext.countBlock, remain);
+        reqBlocks.extents[reqBlocks.size++] = (extent_st) { node->ext.startLoc, take };
+
+        if (carve(tree, node, node->ext.startLoc, take) == -1) break;
+        remain -= take;
+    }
+
+    // Not enough space with the continuity asked for: give everything back
+    if (remain > 0) {
+        for (int i = 0; i < reqBlocks.size; i++) {
+            treeRelease(tree, reqBlocks.extents[i].startLoc, reqBlocks.extents[i].countBlock);
+        }
+        free(reqBlocks.extents);
+        return (extents_st) { NULL, 0 };
+    }
+    return reqBlocks;
+}
+
+/** Returns a run of blocks to the tree, merged with the free extents that end
+ * right before it and start right after it.
+ * @return 0 on success, -1 if the run overlaps free space
+ * @author Danish Nguyen
+ */
+int treeRelease(extent_tree_st* tree, int startLoc, int countBlock) {
+    if (countBlock < 1 || startLoc < 0) return -1;
+
+    ext_node_st* prev = floorStart(tree, startLoc);
+    ext_node_st* next = ceilStart(tree, startLoc);
+
+    if ((prev && prev->ext.startLoc + prev->ext.countBlock > startLoc) ||
+                        (next && startLoc + countBlock > next->ext.startLoc)) {
+        printf("--- WARNING: Extent is overlap, check your system ---\n");
+        return -1;
+    }
+
+    int mergedStart = startLoc;
+    int mergedCount = countBlock;
+
+    if (prev && prev->ext.startLoc + prev->ext.countBlock == startLoc) {
+        unlinkNode(tree, prev);
+        mergedStart = prev->ext.startLoc;
+        mergedCount += prev->ext.countBlock;
+        free(prev);
+        tree->nExtents--;
+    }
+    if (next && startLoc + countBlock == next->ext.startLoc) {
+        unlinkNode(tree, next);
+        mergedCount += next->ext.countBlock;
+        free(next);
+        tree->nExtents--;
+    }
+
+    // The merged neighbours are already counted as free
+    tree->totalFree -= mergedCount - countBlock;
+    return addFree(tree, mergedStart, mergedCount);
+}
+
+/** Removes [startLoc, startLoc + countBlock) from the free extent node holding
+ * it. What is left before the range stays in node, what is left after it 
+ * becomes a new free extent.
+ * @return 0 on success, -1 if the extent after the range cannot be stored
+ */
+static int carve(extent_tree_st* tree, ext_node_st* node, int startLoc, int countBlock) {
+    int end = node->ext.startLoc + node->ext.countBlock;
+    int head = startLoc - node->ext.startLoc;
+    int tail = end - (startLoc + countBlock);
+
+    unlinkNode(tree, node);
+    tree->totalFree -= countBlock;
+
+    // The node keeps the part before the range, or else the part after it
+    if (head > 0 || tail > 0) {
+        node->ext = (head > 0) ? (extent_st) { node->ext.startLoc, head } 
+                               : (extent_st) { startLoc + countBlock, tail };
+        linkNode(tree, node);
+    } else {
+        free(node);
+        tree->nExtents--;
+    }
+    if (head == 0 || tail == 0) return 0;
+
+    tree->totalFree -= tail;
+    return addFree(tree, startLoc + countBlock, tail);
+}
+
+/** Looks for nBlocks free blocks at or after goal: the free extent holding goal
+ * is used from goal on, else the first of the next TREE_GOAL_SCAN free 
+ * extents that is long enough, from its start
+ * @return the free extent and in takeFrom the first block to take, NULL if none
+ */
+static ext_node_st* nearGoal(extent_tree_st* tree, int goal, int nBlocks, int* takeFrom) {
+    ext_node_st* node = floorStart(tree, goal);
+    if (node && node->ext.startLoc + node->ext.countBlock >= goal + nBlocks) {
+        *takeFrom = goal;
+        return node;
+    }
+
+    node = ceilStart(tree, goal);
+    for (int i = 0; node && i < TREE_GOAL_SCAN; i++) {
+        if (node->ext.countBlock >= nBlocks) {
+            *takeFrom = node->ext.startLoc;
+            return node;
+        }
+        node = ceilStart(tree, node->ext.startLoc);
+    }
+    return NULL;
+}
+
+// Insert a new free extent that does not touch any other one
+static int addFree(extent_tree_st* tree, int startLoc, int countBlock) {
+    if (countBlock < 1) return (countBlock == 0) ? 0 : -1;
+
+    ext_node_st* node = malloc(sizeof(ext_node_st));
+    if (!node) return -1;
+
+    node->ext = (extent_st) { startLoc, countBlock };
+    linkNode(tree, node);
+    tree->nExtents++;
+    tree->totalFree += countBlock;
+    return 0;
+}
+
+static void linkNode(extent_tree_st* tree, ext_node_st* node) {
+    tree->roots[TREE_BY_START] = avlInsert(TREE_BY_START, tree->roots[TREE_BY_START], node);
+    tree->roots[TREE_BY_SIZE] = avlInsert(TREE_BY_SIZE, tree->roots[TREE_BY_SIZE], node);
+}
+
+static void unlinkNode(extent_tree_st* tree, ext_node_st* node) {
+    tree->roots[TREE_BY_START] = avlRemove(TREE_BY_START, tree->roots[TREE_BY_START], node);
+    tree->roots[TREE_BY_SIZE] = avlRemove(TREE_BY_SIZE, tree->roots[TREE_BY_SIZE], node);
+}
+
+static void freeNodes(ext_node_st* root) {
+    if (!root) return;
+    freeNodes(root->child[TREE_BY_START][0]);
+    freeNodes(root->child[TREE_BY_START][1]);
+    free(root);
+}
+
+// @return the smallest extent with at least nBlocks blocks, NULL if none
+static ext_node_st* bestFit(extent_tree_st* tree, int nBlocks) {
+    ext_node_st* found = NULL;
+    for (ext_node_st* n = tree->roots[TREE_BY_SIZE]; n; ) {
+        if (n->ext.countBlock >= nBlocks) {
+            found = n;
+            n = n->child[TREE_BY_SIZE][0];
+        } else {
+            n = n->child[TREE_BY_SIZE][1];
+        }
+    }
+    return found;
+}
+
+static ext_node_st* largest(extent_tree_st* tree) {
+    ext_node_st* n = tree->roots[TREE_BY_SIZE];
+    while (n && n->child[TREE_BY_SIZE][1]) n = n->child[TREE_BY_SIZE][1];
+    return n;
+}
+
+// @return the extent with the largest start <= startLoc, NULL if none
+static ext_node_st* floorStart(extent_tree_st* tree, int startLoc) {
+    ext_node_st* found = NULL;
+    for (ext_node_st* n = tree->roots[TREE_BY_START]; n; ) {
+        if (n->ext.startLoc <= startLoc) {
+            found = n;
+            n = n->child[TREE_BY_START][1];
+        } else {
+            n = n->child[TREE_BY_START][0];
+        }
+    }
+    return found;
+}
+
+// @return the extent with the smallest start > startLoc, NULL if none
+static ext_node_st* ceilStart(extent_tree_st* tree, int startLoc) {
+    ext_node_st* found = NULL;
+    for (ext_node_st* n = tree->roots[TREE_BY_START]; n; ) {
+        if (n->ext.startLoc > startLoc) {
+            found = n;
+            n = n->child[TREE_BY_START][0];
+        } else {
+            n = n->child[TREE_BY_START][1];
+        }
+    }
+    return found;
+}
+
+// Order of two nodes in tree t: by start, or by length then start
+static int compareNodes(int t, const ext_node_st* a, const ext_node_st* b) {
+    if (t == TREE_BY_SIZE && a->ext.countBlock != b->ext.countBlock) {
+        return (a->ext.countBlock < b->ext.countBlock) ? -1 : 1;
+    }
+    if (a->ext.startLoc != b->ext.startLoc) return (a->ext.startLoc < b->ext.startLoc) ? -1 : 1;
+    return 0;
+}
+
+static ext_node_st* avlInsert(int t, ext_node_st* root, ext_node_st* node) {
+    if (!root) {
+        node->child[t][0] = node->child[t][1] = NULL;
+        node->height[t] = 1;
+        return node;
+    }
+    int dir = compareNodes(t, node, root) > 0;
+    root->child[t][dir] = avlInsert(t, root->child[t][dir], node);
+    return rebalance(t, root);
+}
+
+static ext_node_st* avlRemove(int t, ext_node_st* root, ext_node_st* node) {
+    if (!root) return NULL;
+
+    int cmp = compareNodes(t, node, root);
+    if (cmp != 0) {
+        int dir = cmp > 0;
+        root->child[t][dir] = avlRemove(t, root->child[t][dir], node);
+        return rebalance(t, root);
+    }
+
+    // root is the node: replace it by the smallest node of its right subtree
+    if (!root->child[t][0]) return root->child[t][1];
+    if (!root->child[t][1]) return root->child[t][0];
+
+    ext_node_st* successor = root->child[t][1];
+    while (successor->child[t][0]) successor = successor->child[t][0];
+
+    successor->child[t][1] = removeMin(t, root->child[t][1]);
+    successor->child[t][0] = root->child[t][0];
+    return rebalance(t, successor);
+}
+
+static ext_node_st* removeMin(int t, ext_node_st* root) {
+    if (!root->child[t][0]) return root->child[t][1];
+    root->child[t][0] = removeMin(t, root->child[t][0]);
+    return rebalance(t, root);
+}
+
+static int height(int t, const ext_node_st* n) {
+    return n ? n->height[t] : 0;
+}
+
+// Rotate n toward dir (1: right rotation, 0: left rotation)
+static ext_node_st* rotate(int t, ext_node_st* n, int dir) {
+    ext_node_st* up = n->child[t][!dir];
+    n->child[t][!dir] = up->child[t][dir];
+    up->child[t][dir] = n;
+
+    n->height[t] = 1 + max(height(t, n->child[t][0]), height(t, n->child[t][1]));
+    up->height[t] = 1 + max(height(t, up->child[t][0]), height(t, up->child[t][1]));
+    return up;
+}
+
+static ext_node_st* rebalance(int t, ext_node_st* n) {
+    n->height[t] = 1 + max(height(t, n->child[t][0]), height(t, n->child[t][1]));
+    int balance = height(t, n->child[t][0]) - height(t, n->child[t][1]);
+
+    if (balance > 1) {
+        ext_node_st* l = n->child[t][0];
+        if (height(t, l->child[t][0]) < height(t, l->child[t][1])) n->child[t][0] = rotate(t, l, 0);
+        return rotate(t, n, 1);
+    }
+    if (balance < -1) {
+        ext_node_st* r = n->child[t][1];
+        if (height(t, r->child[t][1]) < height(t, r->child[t][0])) n->child[t][1] = rotate(t, r, 1);
+        return rotate(t, n, 0);
+    }
+    return n;
+}
+
+// LEB128: 7 bits per byte, high bit set when more bytes follow
+// @return position after the value, -1 if it does not fit
+static int putVarint(char* buf, int pos, int maxBytes, uint32_t value) {
+    do {
+        if (pos >= maxBytes) return -1;
+        unsigned char byte = value & 0x7F;
+        value >>= 7;
+        buf[pos++] = (char) (value ? (byte | 0x80) : byte);
+    } while (value);
+    return pos;
+}
+
+// @return position after the value, -1 if the image ends first
+static int getVarint(const char* buf, int pos, int maxBytes, uint32_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos >= maxBytes) return -1;
+        unsigned char byte = (unsigned char) buf[pos++];
+        *value |= (uint32_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return pos;
+    }
+    return -1;
+}
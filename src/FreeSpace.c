@@ -15,8 +15,68 @@
 * secondary and tertiary extents
 *
 **************************************************************/
+#include <time.h>
+#include <pthread.h>
+
 #include "structs/VCB.h"
 #include "structs/FreeSpace.h"
+#include "structs/ExtentTree.h"
+#include "structs/BitmapAlloc.h"
+#include "structs/Discard.h"
+
+// Extent tables resident in memory. vcb->free_space_map is the table of
+// curTable; moving to another resident table only switches the pointer and 
+// the least recently used table is written back when a slot is needed.
+static fs_table_st fsTables[FS_TABLE_CACHE];
+static fs_table_st* curTable = NULL;
+static unsigned long fsTableClock = 0; // stamps fs_table_st.lastUse
+static time_t fsLastFlush = 0;  // time of the last writeFSToDisk
+
+static fs_table_st* findTable(int startLoc);
+static fs_table_st* claimTable(int startLoc);
+static void useTable(fs_table_st* t);
+static void dropTable(fs_table_st* t);
+static int writeTables(fs_table_st* only);
+static void setAllFSDirty(int dirty);
+static void markFSBlockDirty(int block);
+
+static int fsTombstones = -1;   // empty [-1:0] slots in the tables, -1 until counted
+static int fsNesting = 0;       // > 0 while addExtent creates tables: no compaction
+
+static void maybeCompact();
+static int countTombstones();
+static int findNearGoal(int nBlocks, int goal);
+static extents_st allocateFromTables(int nBlocks, int minContinuous, int goal);
+static int releaseToTables(int startLoc, int countBlocks);
+static int mergeExtents(extent_st* exts, int n);
+static int countWithExtent(const extent_st* exts, int n, extent_st add);
+static int secondariesNeeded(int nExtents);
+
+// FS_ENGINE_TREE: one tree per allocation group. vcb->free_space_map holds 
+// the serialized trees as last written, each in its group's part of the
+// region; groupImageUsed is the number of bytes a group's image occupies and
+// groupChanged tells that its tree changed since. A group's tree, counters 
+// and flags are guarded by its lock; fsSyncLock serializes the image writes.
+static extent_tree_st groupTree[FS_MAX_GROUPS];
+static pthread_mutex_t groupLock[FS_MAX_GROUPS];
+static int groupImageUsed[FS_MAX_GROUPS];
+static int groupChanged[FS_MAX_GROUPS];
+static pthread_mutex_t fsSyncLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void initGroups(int startFree, int numberOfBlocks);
+static void singleGroup();
+static int groupOf(int lba);
+static int pickGroup(int goal);
+static void updateTreeTotals();
+static int syncTreeImage();
+static extents_st allocateFromTree(int nBlocks, int minContinuous, int goal);
+static extents_st allocateAcrossGroups(int nBlocks, int minContinuous, int first);
+static int releaseToTree(int startLoc, int countBlocks);
+
+// FS_ENGINE_BITMAP: vcb->free_space_map is the level 0 bitmap itself
+static extents_st allocateFromBitmap(int nBlocks, int minContinuous, int goal);
+static int releaseToBitmap(int startLoc, int countBlocks);
+static void markFSBitsDirty(int startLoc, int countBlocks);
 
 /**
  * Initializes the free space map on the first time. Set location and reserving blocks.
@@ -27,8 +87,14 @@
 extent_st* initFreeSpace(int numberOfBlocks, int blockSize) {
     vcb->free_space_loc = FREESPACE_START_LOC;
     vcb->fs_st.curExtentLBA = FREESPACE_START_LOC;
+
+    vcb->fs_engine = FS_ENGINE_DEFAULT;
+    vcb->fs_engine_chk = FS_ENGINE_MAGIC ^ vcb->fs_engine;
   
-    vcb->fs_st.reservedBlocks = calBlocksNeededFS( numberOfBlocks, blockSize );
+    // The bitmap has a fixed size: one bit per block of the volume
+    vcb->fs_st.reservedBlocks = (vcb->fs_engine == FS_ENGINE_BITMAP)
+                        ? computeBlockNeeded(bitmapBytes(numberOfBlocks), blockSize)
+                        : calBlocksNeededFS( numberOfBlocks, blockSize );
     vcb->fs_st.maxExtent = vcb->fs_st.reservedBlocks * PRIMARY_EXTENT_TB;
 
     // this is the index of the free space map
@@ -40,48 +106,160 @@ extent_st* initFreeSpace(int numberOfBlocks, int blockSize) {
     vcb->fs_st.totalBlocksFree = numberOfBlocks - startFreeBlockLoc; // all available blocks
     
     // Init primary extent map for fspace
-    extent_st* extentTable = (extent_st*) allocateMemFS(vcb->fs_st.reservedBlocks);
+    fs_table_st* primary = claimTable(FREESPACE_START_LOC);
+    if (!primary) return NULL;
+    useTable(primary);
+    extent_st* extentTable = primary->table;
     
     extentTable[0] = (extent_st) { startFreeBlockLoc, vcb->fs_st.totalBlocksFree };
     vcb->fs_st.extentLength++;
 
+    // Nothing of the new table is on disk yet
+    setAllFSDirty(1);
+
     vcb->fs_st.terExtLength = 0; 
     vcb->fs_st.terExtTBLoc = -1; // Indicate tertiary table is not exist
 
+    // The tree engine keeps the same reserved region for the images of its groups
+    if (vcb->fs_engine == FS_ENGINE_TREE) {
+        memset(extentTable, 0, vcb->fs_st.reservedBlocks * vcb->block_size);
+        initGroups(startFreeBlockLoc, numberOfBlocks);
+
+        for (int g = 0; g < vcb->fs_groups; g++) {
+            fs_group_st* group = &vcb->fs_group[g];
+            if (treeInit(&groupTree[g], group->startLoc, group->nBlocks) == -1) return NULL;
+        }
+    }
+    if (vcb->fs_engine == FS_ENGINE_BITMAP) {
+        memset(extentTable, 0, vcb->fs_st.reservedBlocks * vcb->block_size);
+        if (bitmapInit((uint64_t*) extentTable, numberOfBlocks, startFreeBlockLoc) == -1) {
+            return NULL;
+        }
+        vcb->fs_st.extentLength = 0;
+    }
     return extentTable;
 }
 
-/** Loads the fs map from disk into memory and retain the map in memory until the 
- * program terminates.
+/** Check the free space engine recorded in the VCB at mount. Volumes formatted
+ * before the engine was recorded fail the check and use the extent tables.
+ * @return the engine of the mounted volume
+ */
+int validateFSEngine() {
+    if (vcb->fs_engine_chk != (FS_ENGINE_MAGIC ^ vcb->fs_engine) || vcb->fs_engine > FS_ENGINE_BITMAP) {
+        vcb->fs_engine = FS_ENGINE_EXTENT;
+        vcb->fs_engine_chk = FS_ENGINE_MAGIC ^ FS_ENGINE_EXTENT;
+    }
+
+    // Tree volumes formatted before allocation groups hold one tree for the volume
+    if (vcb->fs_engine == FS_ENGINE_TREE && (vcb->fs_groups_chk != (FS_GROUP_MAGIC ^ vcb->fs_groups) 
+                                || vcb->fs_groups < 1 || vcb->fs_groups > FS_MAX_GROUPS)) {
+        singleGroup();
+    }
+    return vcb->fs_engine;
+}
+
+/** Makes the extent table at startLoc the current one. A table already resident
+ * in memory is switched to without I/O; otherwise it is read into a free slot 
+ * or the slot of the least recently used table, which is written back first.
  * @return extent_st* on success or NULL on error
  */
 extent_st* loadFreeSpaceMap(int startLoc) {
     // Prevent multiple reads of the same free space map from disk
-    if (vcb->free_space_map && startLoc == vcb->fs_st.curExtentLBA) {
+    if (vcb->free_space_map && curTable && startLoc == curTable->startLoc) {
         return vcb->free_space_map;
     }
-    
-    // Allocate memory for the free space map
-    extent_st* extentTable = (extent_st*) allocateMemFS(vcb->fs_st.reservedBlocks);
 
-    // Read blocks into memory; release FS Map on failure
-    int readStatus = LBAread(extentTable, vcb->fs_st.reservedBlocks, startLoc);
+    fs_table_st* resident = findTable(startLoc);
+    if (resident) {
+        useTable(resident);
+        return resident->table;
+    }
+
+    fs_table_st* slot = claimTable(startLoc);
+    if (!slot) return NULL;
+
+    // Read blocks into memory; release the slot on failure
+    int prevClass = ioSetClass(IO_CLASS_FREESPACE);
+    int readStatus = cacheRead(slot->table, vcb->fs_st.reservedBlocks, startLoc);
+    ioSetClass(prevClass);
     if (readStatus < vcb->fs_st.reservedBlocks) {
-        freePtr((void**) &extentTable, "extentTable");
+        dropTable(slot);
         return NULL;
     }
 
+    // Rebuild the tree of every allocation group from its image
+    if (vcb->fs_engine == FS_ENGINE_TREE) {
+        for (int g = 0; g < vcb->fs_groups; g++) {
+            fs_group_st* group = &vcb->fs_group[g];
+            char* image = (char*) slot->table + group->imageLoc * vcb->block_size;
+
+            pthread_mutex_init(&groupLock[g], NULL);
+            if (treeLoad(&groupTree[g], image, group->imageBlocks * vcb->block_size) == -1) {
+                dropTable(slot);
+                return NULL;
+            }
+            groupImageUsed[g] = ((tree_image_st*) image)->nBytes;
+            groupChanged[g] = 0;
+            group->freeBlocks = groupTree[g].totalFree;
+        }
+        updateTreeTotals();
+    }
+    if (vcb->fs_engine == FS_ENGINE_BITMAP) {
+        int freeBlocks = bitmapLoad((uint64_t*) slot->table, vcb->total_blocks);
+        if (freeBlocks == -1) {
+            dropTable(slot);
+            return NULL;
+        }
+        vcb->fs_st.totalBlocksFree = freeBlocks;
+    }
+
     // Set current opend FreeMap in memory based on its start location LBA location
-    vcb->fs_st.curExtentLBA = startLoc; 
-    return extentTable;
+    useTable(slot);
+    return slot->table;
 }
 
 /** Allocates a specified number of blocks from the free space map with a minimum
- * continuous block size, if available.
+ * continuous block size, if available. Free extents at or near goal (an LBA, 
+ * -1 for no preference) are preferred, so a file grows next to its last extent
+ * and a directory lands close to its parent.
  * @return An extents_st struct with allocated extents, an empty extents_st if failure
  * @note Check extents != NULL before use.
  */
-extents_st allocateBlocks(int nBlocks, int minContinuous) { 
+extents_st allocateBlocks(int nBlocks, int minContinuous, int goal) { 
+    extents_st requestBlocks = (vcb->fs_engine == FS_ENGINE_TREE) ? 
+                                allocateFromTree(nBlocks, minContinuous, goal) :
+                            (vcb->fs_engine == FS_ENGINE_BITMAP) ? 
+                                allocateFromBitmap(nBlocks, minContinuous, goal) :
+                                allocateFromTables(nBlocks, minContinuous, goal);
+
+    // Blocks released earlier may still wait for their discard
+    for (int i = 0; requestBlocks.extents && i < requestBlocks.size; i++) {
+        discardCancel(requestBlocks.extents[i].startLoc, requestBlocks.extents[i].countBlock);
+    }
+    return requestBlocks;
+}
+
+/** Releases blocks to the free space map. Their cached copies are dropped, the
+ * journal revokes their logged metadata and the range is queued to be punched
+ * out of the volume file (see Discard.h).
+ * @return -1 if fail or 0 is sucessed 
+ */
+int releaseBlocks(int startLoc, int countBlocks) {
+    int status = (vcb->fs_engine == FS_ENGINE_TREE) ? releaseToTree(startLoc, countBlocks) :
+                 (vcb->fs_engine == FS_ENGINE_BITMAP) ? releaseToBitmap(startLoc, countBlocks) :
+                                                        releaseToTables(startLoc, countBlocks);
+    if (status == 0) {
+        cacheDropRange(countBlocks, startLoc);
+        journalRevoke(startLoc, countBlocks);
+        discardBlocks(startLoc, countBlocks);
+    }
+    return status;
+}
+
+/** Allocate from the primary/secondary extent tables, see allocateBlocks
+ * @return An extents_st struct with allocated extents, an empty extents_st if failure
+ */
+static extents_st allocateFromTables(int nBlocks, int minContinuous, int goal) {
     extents_st requestBlocks = { NULL, 0 };
     vcb->free_space_map = loadFreeSpaceMap(FREESPACE_START_LOC);
 
@@ -100,6 +278,25 @@ extents_st allocateBlocks(int nBlocks, int minContinuous) {
     if (requestBlocks.extents == NULL) return requestBlocks;
     
     requestBlocks.size = 0;
+
+    // The extent nearest to the goal serves the whole request when one can
+    int near = (goal >= 0) ? findNearGoal(nBlocks, goal) : -1;
+    if (near != -1) {
+        int index = near % vcb->fs_st.maxExtent;
+        pageSwap(near / vcb->fs_st.maxExtent - 1);
+
+        requestBlocks.extents[requestBlocks.size++] = (extent_st) \
+                                {vcb->free_space_map[index].startLoc, numBlockReq};
+        if (vcb->free_space_map[index].countBlock == numBlockReq) {
+            removeExtent(vcb->free_space_map[index].startLoc, index);
+        } else {
+            vcb->free_space_map[index].startLoc += numBlockReq;
+            vcb->free_space_map[index].countBlock -= numBlockReq;
+            markFSDirty(index);
+        }
+        vcb->fs_st.totalBlocksFree -= numBlockReq;
+        numBlockReq = 0;
+    }
     
     // Iterate over free space map extents to allocate blocks
     for (int i = (vcb->fs_st.extentLength - 1); i >= 0 && numBlockReq > 0; i--) {
@@ -107,8 +304,8 @@ extents_st allocateBlocks(int nBlocks, int minContinuous) {
         int index = i % vcb->fs_st.maxExtent;
         int indexTable = i / vcb->fs_st.maxExtent - 1;
         
-        // Load a secondary table when needed.
-        pageSwap(index, indexTable);
+        // Switch to the table holding extent i
+        pageSwap(indexTable);
         
         int startLocation = vcb->free_space_map[index].startLoc;
         int availableBlocks = vcb->free_space_map[index].countBlock; 
@@ -137,6 +334,7 @@ extents_st allocateBlocks(int nBlocks, int minContinuous) {
             // Update the extent in free space map to reduce its count
             vcb->free_space_map[index].startLoc += numBlockReq;
             vcb->free_space_map[index].countBlock -= numBlockReq;
+            markFSDirty(index);
             vcb->fs_st.totalBlocksFree -= numBlockReq;
             
             numBlockReq = 0; // All required blocks have been assigned
@@ -155,7 +353,8 @@ extents_st allocateBlocks(int nBlocks, int minContinuous) {
     if (requestBlocks.extents == NULL) {
         printf("--------- ERROR - Unable to reallocate memory --------- \n");
     }
-    writeFSToDisk(vcb->fs_st.curExtentLBA);
+    maybeCompact();
+    syncFreeSpace();
     return requestBlocks;
 }
 
@@ -164,7 +363,7 @@ extents_st allocateBlocks(int nBlocks, int minContinuous) {
  * NOTE: check for overlapping extents (processing... )
  * @return -1 if fail or 0 is sucessed 
  */
-int releaseBlocks(int startLoc, int countBlocks) {
+static int releaseToTables(int startLoc, int countBlocks) {
     // If the specified range exceeds total blocks, return -1 if error
 	vcb->free_space_map = loadFreeSpaceMap(FREESPACE_START_LOC);
     
@@ -180,15 +379,17 @@ int releaseBlocks(int startLoc, int countBlocks) {
         int index = i % vcb->fs_st.maxExtent;
         int indexTable = i / vcb->fs_st.maxExtent - 1;
         
+        // Switch to the table holding extent i
+        pageSwap(indexTable);
+
         int checkOverlap = isOverlap(vcb->free_space_map[index], startLoc, countBlocks); 
         if (checkOverlap == -1) return -1;
-        // Load a secondary table when needed.
-        pageSwap(index, indexTable);
         
         // Merge if matching extent is found, update location and block count.
         if ( mergeLoc == vcb->free_space_map[index].startLoc ) {
             vcb->free_space_map[index].startLoc -= countBlocks;
             vcb->free_space_map[index].countBlock += countBlocks;
+            markFSDirty(index);
             isNotFound = 0;
             break;
         }
@@ -197,6 +398,8 @@ int releaseBlocks(int startLoc, int countBlocks) {
         if (vcb->free_space_map[index].startLoc == -1) {
             vcb->free_space_map[index].startLoc = startLoc;
             vcb->free_space_map[index].countBlock = countBlocks;
+            markFSDirty(index);
+            if (fsTombstones > 0) fsTombstones--;
             isNotFound = 0;
             break;
         }
@@ -207,16 +410,276 @@ int releaseBlocks(int startLoc, int countBlocks) {
     vcb->fs_st.totalBlocksFree += countBlocks; // Update total free blocks
 
     // printf("====RELEASED [%d: %d] - Status: OK======\n", startLoc, countBlocks);
-    return writeFSToDisk(vcb->fs_st.curExtentLBA);
+    maybeCompact();
+    return syncFreeSpace();
+}
+
+/** Allocate from the allocation groups: the group holding the goal serves 
+ * the whole request when it can, else the next groups in turn are tried, and 
+ * only then is the request spread over several groups. See treeAllocate.
+ * @return An extents_st struct with allocated extents, an empty extents_st if failure
+ */
+static extents_st allocateFromTree(int nBlocks, int minContinuous, int goal) {
+    if (nBlocks > vcb->fs_st.totalBlocksFree || nBlocks < minContinuous) {
+        printf("***************** Full Storage *****************\n");
+        return (extents_st) { NULL, 0 };
+    }
+
+    extents_st requestBlocks = { NULL, 0 };
+    int first = pickGroup(goal);
+
+    for (int i = 0; i < vcb->fs_groups && !requestBlocks.extents; i++) {
+        int g = (first + i) % vcb->fs_groups;
+
+        pthread_mutex_lock(&groupLock[g]);
+        if (groupTree[g].totalFree >= nBlocks) {
+            requestBlocks = treeAllocate(&groupTree[g], nBlocks, minContinuous, goal);
+            vcb->fs_group[g].freeBlocks = groupTree[g].totalFree;
+            groupChanged[g] |= (requestBlocks.extents != NULL);
+        }
+        pthread_mutex_unlock(&groupLock[g]);
+    }
+
+    if (!requestBlocks.extents && vcb->fs_groups > 1) {
+        requestBlocks = allocateAcrossGroups(nBlocks, minContinuous, first);
+    }
+    if (!requestBlocks.extents) {
+        printf("--------- ERROR - Unable to allocate blocks ---------\n");
+        return requestBlocks;
+    }
+
+    updateTreeTotals();
+    syncFreeSpace();
+    return requestBlocks;
+}
+
+// No group can serve the request alone: take what each group has, in turn
+static extents_st allocateAcrossGroups(int nBlocks, int minContinuous, int first) {
+    extents_st requestBlocks = { malloc(nBlocks * sizeof(extent_st)), 0 };
+    if (!requestBlocks.extents) return requestBlocks;
+
+    int remain = nBlocks;
+    for (int i = 0; i < vcb->fs_groups && remain > 0; i++) {
+        int g = (first + i) % vcb->fs_groups;
+
+        pthread_mutex_lock(&groupLock[g]);
+        int take = min(remain, groupTree[g].totalFree);
+        extents_st part = (take > 0 && take >= minContinuous) 
+                        ? treeAllocate(&groupTree[g], take, minContinuous, -1) : (extents_st) { NULL, 0 };
+        vcb->fs_group[g].freeBlocks = groupTree[g].totalFree;
+        groupChanged[g] |= (part.extents != NULL);
+        pthread_mutex_unlock(&groupLock[g]);
+
+        if (!part.extents) continue;
+
+        // At most one extent per block, so nBlocks entries are always enough
+        memcpy(requestBlocks.extents + requestBlocks.size, part.extents, part.size * sizeof(extent_st));
+        requestBlocks.size += part.size;
+        remain -= take;
+        freeExtents(&part);
+    }
+
+    if (remain > 0) {
+        for (int i = 0; i < requestBlocks.size; i++) {
+            releaseToTree(requestBlocks.extents[i].startLoc, requestBlocks.extents[i].countBlock);
+        }
+        freeExtents(&requestBlocks);
+    }
+    return requestBlocks;
+}
+
+/** Return blocks to the trees of their groups, merged with their free
+ * neighbours. A run crossing a group boundary is split between the groups.
+ * @return -1 if fail or 0 is sucessed
+ */
+static int releaseToTree(int startLoc, int countBlocks) {
+    if (startLoc < 0 || startLoc + countBlocks > vcb->total_blocks) return -1;
+
+    while (countBlocks > 0) {
+        int g = groupOf(startLoc);
+        fs_group_st* group = &vcb->fs_group[g];
+        int piece = min(countBlocks, group->startLoc + group->nBlocks - startLoc);
+        if (piece < 1) return -1;
+
+        pthread_mutex_lock(&groupLock[g]);
+        int status = treeRelease(&groupTree[g], startLoc, piece);
+        group->freeBlocks = groupTree[g].totalFree;
+        groupChanged[g] |= (status == 0);
+        pthread_mutex_unlock(&groupLock[g]);
+
+        if (status == -1) return -1;
+        startLoc += piece;
+        countBlocks -= piece;
+    }
+    updateTreeTotals();
+    return syncFreeSpace();
 }
 
+/** Split the free blocks [startFree, numberOfBlocks) into allocation groups of
+ * equal size and the free space region into equal parts for their images */
+static void initGroups(int startFree, int numberOfBlocks) {
+    int freeBlocks = numberOfBlocks - startFree;
+    int groups = min(FS_ALLOC_GROUPS, FS_MAX_GROUPS);
+    groups = min(groups, vcb->fs_st.reservedBlocks);
+    groups = max(1, min(groups, freeBlocks / FS_MIN_GROUP_BLOCKS));
+
+    int groupBlocks = freeBlocks / groups;
+    int imageBlocks = vcb->fs_st.reservedBlocks / groups;
+
+    for (int g = 0; g < groups; g++) {
+        int last = (g == groups - 1);
+        vcb->fs_group[g] = (fs_group_st) {
+            startFree + g * groupBlocks,
+            last ? freeBlocks - g * groupBlocks : groupBlocks,
+            g * imageBlocks,
+            last ? vcb->fs_st.reservedBlocks - g * imageBlocks : imageBlocks,
+            0
+        };
+        vcb->fs_group[g].freeBlocks = vcb->fs_group[g].nBlocks;
+
+        pthread_mutex_init(&groupLock[g], NULL);
+        groupImageUsed[g] = 0;
+        groupChanged[g] = 1;
+    }
+    vcb->fs_groups = groups;
+    vcb->fs_groups_chk = FS_GROUP_MAGIC ^ groups;
+}
+
+// One group spanning the volume, its tree using the whole free space region
+static void singleGroup() {
+    vcb->fs_group[0] = (fs_group_st) { 0, vcb->total_blocks, 0, vcb->fs_st.reservedBlocks, 
+                                                            vcb->fs_st.totalBlocksFree };
+    vcb->fs_groups = 1;
+    vcb->fs_groups_chk = FS_GROUP_MAGIC ^ 1;
+}
+
+// @return the group whose range holds lba (the nearest group outside of them)
+static int groupOf(int lba) {
+    for (int g = vcb->fs_groups - 1; g > 0; g--) {
+        if (lba >= (int) vcb->fs_group[g].startLoc) return g;
+    }
+    return 0;
+}
+
+// @return the group to try first: the goal's group, else one per thread
+static int pickGroup(int goal) {
+    if (goal >= 0) return groupOf(goal);
+    return (int) ((unsigned long) pthread_self() / 64 % vcb->fs_groups);
+}
+
+// Sum the group counters into the volume counters
+static void updateTreeTotals() {
+    int freeBlocks = 0;
+    int extents = 0;
+    for (int g = 0; g < vcb->fs_groups; g++) {
+        pthread_mutex_lock(&groupLock[g]);
+        freeBlocks += groupTree[g].totalFree;
+        extents += groupTree[g].nExtents;
+        pthread_mutex_unlock(&groupLock[g]);
+    }
+    vcb->fs_st.totalBlocksFree = freeBlocks;
+    vcb->fs_st.extentLength = extents;
+}
+
+/** Allocate from the bitmap; see bitmapAllocate
+ * @return An extents_st struct with allocated extents, an empty extents_st if failure
+ */
+static extents_st allocateFromBitmap(int nBlocks, int minContinuous, int goal) {
+    if (nBlocks > vcb->fs_st.totalBlocksFree || nBlocks < minContinuous) {
+        printf("***************** Full Storage *****************\n");
+        return (extents_st) { NULL, 0 };
+    }
+
+    extents_st requestBlocks = bitmapAllocate(nBlocks, minContinuous, goal);
+    if (!requestBlocks.extents) {
+        printf("--------- ERROR - Unable to allocate blocks ---------\n");
+        return requestBlocks;
+    }
+
+    for (int i = 0; i < requestBlocks.size; i++) {
+        markFSBitsDirty(requestBlocks.extents[i].startLoc, requestBlocks.extents[i].countBlock);
+    }
+    vcb->fs_st.totalBlocksFree = bitmapFreeBlocks();
+    syncFreeSpace();
+    return requestBlocks;
+}
+
+/** Clear the blocks in the bitmap; fails when any of them is already free
+ * @return -1 if fail or 0 is sucessed
+ */
+static int releaseToBitmap(int startLoc, int countBlocks) {
+    if (bitmapRelease(startLoc, countBlocks) == -1) return -1;
+
+    markFSBitsDirty(startLoc, countBlocks);
+    vcb->fs_st.totalBlocksFree = bitmapFreeBlocks();
+    return syncFreeSpace();
+}
+
+// Flag the bitmap blocks that hold the bits of a range of blocks
+static void markFSBitsDirty(int startLoc, int countBlocks) {
+    int bitsPerBlock = vcb->block_size * 8;
+    int last = (startLoc + countBlocks - 1) / bitsPerBlock;
+
+    for (int block = startLoc / bitsPerBlock; block <= last; block++) {
+        markFSBlockDirty(block);
+    }
+}
+
+/** Serialize the tree of every group that changed and copy each block of its
+ * image that differs from vcb->free_space_map into it, flagging those blocks
+ * dirty. Only the bytes used by the new or the previous image can differ.
+ * @return 0 on success, -1 if a tree does not fit in its part of the region
+ */
+static int syncTreeImage() {
+    for (int g = 0; g < vcb->fs_groups; g++) {
+        fs_group_st* group = &vcb->fs_group[g];
+        int maxBytes = group->imageBlocks * vcb->block_size;
+
+        pthread_mutex_lock(&groupLock[g]);
+        if (!groupChanged[g]) {
+            pthread_mutex_unlock(&groupLock[g]);
+            continue;
+        }
+
+        char* image = calloc(maxBytes, 1);
+        int used = image ? treeSerialize(&groupTree[g], image, maxBytes) : -1;
+        groupChanged[g] = (used == -1);
+        pthread_mutex_unlock(&groupLock[g]);
+
+        if (used == -1) {
+            printf("ERROR - Free extent tree of group %d does not fit in %d blocks\n", g, group->imageBlocks);
+            free(image);
+            return -1;
+        }
+
+        char* table = (char*) vcb->free_space_map + group->imageLoc * vcb->block_size;
+        int lastBlock = (max(used, groupImageUsed[g]) - 1) / vcb->block_size;
+
+        for (int i = 0; i <= lastBlock; i++) {
+            int offset = i * vcb->block_size;
+            if (memcmp(table + offset, image + offset, vcb->block_size) == 0) continue;
+
+            memcpy(table + offset, image + offset, vcb->block_size);
+            markFSBlockDirty(group->imageLoc + i);
+        }
+
+        groupImageUsed[g] = used;
+        free(image);
+    }
+    updateTreeTotals();
+    return 0;
+}
+
+
 // Adds a new extent to the fs map, specifying starting location and block count.
 int addExtent(int startLoc, int countBlock) {
     int index = indexExtentTB();
     // If only Primary table exist
     if (vcb->fs_st.extentLength < vcb->fs_st.maxExtent) {
+        pageSwap(-1);
         vcb->free_space_map[vcb->fs_st.extentLength].startLoc = startLoc;
         vcb->free_space_map[vcb->fs_st.extentLength].countBlock = countBlock;
+        markFSDirty(vcb->fs_st.extentLength);
         vcb->fs_st.extentLength++;
         return 0;
     }
@@ -224,7 +687,9 @@ int addExtent(int startLoc, int countBlock) {
     // Handle cases when we need secondary extent table 1024 % 1024 == 0
     if ( index == 0 ) {
         /** Create new secondary Extent TB */
+        fsNesting++;
         int status = createSecondaryExtentTB(startLoc, countBlock);
+        fsNesting--;
         if (status == -1) { 
             printf("/** Create new secondary Extent TB */\n");
             return -1;
@@ -245,6 +710,7 @@ int addExtent(int startLoc, int countBlock) {
 
     vcb->free_space_map[index].startLoc = startLoc;
     vcb->free_space_map[index].countBlock = countBlock;
+    markFSDirty(index);
     vcb->fs_st.extentLength++;
     
     return 0;
@@ -275,9 +741,12 @@ int loadTertiaryTB() {
     if (!vcb->fs_st.terExtTBMap) {
         vcb->fs_st.terExtTBMap = (int*) allocateMemFS(1);
 
-        int readStatus = LBAread(vcb->fs_st.terExtTBMap, 1, vcb->fs_st.terExtTBLoc);
+        int prevClass = ioSetClass(IO_CLASS_TERTIARY);
+        int readStatus = cacheRead(vcb->fs_st.terExtTBMap, 1, vcb->fs_st.terExtTBLoc);
+        ioSetClass(prevClass);
         if (readStatus < 1) return -1;
-    } printf("LOADED Tertiary Ext Table to Memory\n");
+        printf("LOADED Tertiary Ext Table to Memory\n");
+    }
     return 0;
 }
 
@@ -306,7 +775,9 @@ int createSecondaryExtentTB() {
     vcb->fs_st.terExtTBMap[vcb->fs_st.terExtLength++] = secondTBLoc;
     
     // Write updated Tertiary extent table to disk 
-    int writeStatus = LBAwrite(vcb->fs_st.terExtTBMap, 1, vcb->fs_st.terExtTBLoc);
+    int prevClass = ioSetClass(IO_CLASS_TERTIARY);
+    int writeStatus = cacheWrite(vcb->fs_st.terExtTBMap, 1, vcb->fs_st.terExtTBLoc);
+    ioSetClass(prevClass);
     if (writeStatus == -1) return -1;
 
     printf("Created secondary extent table - SUCCESS!!!\n");
@@ -317,7 +788,7 @@ int createSecondaryExtentTB() {
  * @return start location; -1 on error 
  */
 int createExtentTables(int nBlocks, int nContiguous) {
-    extents_st aBlocks = allocateBlocks(nBlocks, nContiguous);
+    extents_st aBlocks = allocateBlocks(nBlocks, nContiguous, -1);
 
     if ( aBlocks.extents == NULL || aBlocks.size == 0) {
         printf("Error - Unable to create new Extent Tables with %d blocks and %d blocks are \
@@ -347,17 +818,194 @@ int secondaryTBIndex() {
 void removeExtent( int startLoc, int i ) {
     vcb->free_space_map[i].startLoc = -1;
     vcb->free_space_map[i].countBlock = 0;
+    markFSDirty(i);
+    if (fsTombstones >= 0) fsTombstones++;
 }
 
-/** Check if current index is on the new extent table, change the table */
-void pageSwap(int idx, int idxPage) {
-    // Load a secondary table when needed.
-    if (idx == 0 && idxPage > -1) {
-        writeFSToDisk(vcb->fs_st.curExtentLBA);            
+/** Online compaction of the extent tables: drops the [-1:0] slots, merges
+ * adjacent extents and rewrites the tables from the start, so extentLength
+ * only counts live extents. Secondary tables (and the tertiary table) that
+ * are no longer needed are returned to free space, last table first.
+ * @return number of slots reclaimed, -1 on failure
+ * @author Danish Nguyen
+ */
+int compactFreeSpace() {
+    if (vcb->fs_engine != FS_ENGINE_EXTENT) return 0;
+
+    int before = vcb->fs_st.extentLength;
+    int maxExt = vcb->fs_st.maxExtent;
+
+    // Room for the live extents, the secondary tables and the tertiary table
+    extent_st* exts = malloc((before + vcb->fs_st.terExtLength + 1) * sizeof(extent_st));
+    if (!exts) return -1;
+
+    int n = 0;
+    for (int i = 0; i < before; i++) {
+        pageSwap(i / maxExt - 1);
+        extent_st ext = vcb->free_space_map[i % maxExt];
+        if (ext.startLoc != -1 && ext.countBlock > 0) exts[n++] = ext;
+    }
+    n = mergeExtents(exts, n);
+
+    // A table can go when the extents, including its own blocks, fit without it
+    int secondaries = vcb->fs_st.terExtLength;
+    int freedBlocks = 0;
+    while (secondaries > 0) {
+        extent_st table = { getSecTBLocation(secondaries - 1), vcb->fs_st.reservedBlocks };
+        if (secondariesNeeded(countWithExtent(exts, n, table)) > secondaries - 1) break;
+
+        fs_table_st* resident = findTable(table.startLoc);
+        if (resident) dropTable(resident);
 
-        int secTBLoc = getSecTBLocation(idxPage);
-        vcb->free_space_map = loadFreeSpaceMap(secTBLoc);
+        exts[n] = table;
+        n = mergeExtents(exts, n + 1);
+        freedBlocks += table.countBlock;
+        secondaries--;
     }
+
+    int tertiaryFreed = 0;
+    if (secondaries == 0 && vcb->fs_st.terExtTBLoc != -1) {
+        extent_st tertiary = { vcb->fs_st.terExtTBLoc, 1 };
+        if (secondariesNeeded(countWithExtent(exts, n, tertiary)) == 0) {
+            exts[n] = tertiary;
+            n = mergeExtents(exts, n + 1);
+            freedBlocks += 1;
+            tertiaryFreed = 1;
+        }
+    }
+
+    int tablesChanged = (secondaries != vcb->fs_st.terExtLength);
+    vcb->fs_st.terExtLength = secondaries;
+    vcb->fs_st.extentLength = n;
+    vcb->fs_st.totalBlocksFree += freedBlocks;
+
+    // Rewrite the tables; only the slots that change are flagged dirty
+    for (int i = 0; i < n; i++) {
+        pageSwap(i / maxExt - 1);
+        extent_st* slot = &vcb->free_space_map[i % maxExt];
+        if (slot->startLoc == exts[i].startLoc && slot->countBlock == exts[i].countBlock) continue;
+
+        *slot = exts[i];
+        markFSDirty(i % maxExt);
+    }
+    free(exts);
+    pageSwap(-1);
+
+    if (tertiaryFreed) {
+        vcb->fs_st.terExtTBLoc = -1;
+        freePtr((void**) &vcb->fs_st.terExtTBMap, "Tertiary extent table");
+    } else if (tablesChanged) {
+        int prevClass = ioSetClass(IO_CLASS_TERTIARY);
+        int writeStatus = cacheWrite(vcb->fs_st.terExtTBMap, 1, vcb->fs_st.terExtTBLoc);
+        ioSetClass(prevClass);
+        if (writeStatus < 1) return -1;
+    }
+
+    fsTombstones = 0;
+    return before - n;
+}
+
+/** Number of free extents, a measure of how fragmented the free space is
+ * @return the count for the engine in use
+ */
+int freeExtentCount() {
+    if (vcb->fs_engine == FS_ENGINE_TREE) return vcb->fs_st.extentLength;
+    if (vcb->fs_engine == FS_ENGINE_BITMAP) return bitmapExtentCount();
+
+    if (fsTombstones < 0) fsTombstones = countTombstones();
+    return vcb->fs_st.extentLength - fsTombstones;
+}
+
+// Compact once enough of the table slots are tombstones
+static void maybeCompact() {
+    if (vcb->fs_engine != FS_ENGINE_EXTENT || fsNesting > 0) return;
+    if (vcb->fs_st.extentLength < FS_COMPACT_MIN_EXTENTS) return;
+
+    if (fsTombstones < 0) fsTombstones = countTombstones();
+    if (fsTombstones * 100 < FS_COMPACT_TOMBSTONE_PCT * vcb->fs_st.extentLength) return;
+
+    compactFreeSpace();
+}
+
+/** Finds the extent that holds nBlocks blocks and starts closest to goal,
+ * preferring extents at or after it
+ * @return index of the extent across the tables, -1 if none holds the request
+ */
+static int findNearGoal(int nBlocks, int goal) {
+    int found = -1;
+    long bestDistance = 0;
+
+    for (int i = 0; i < vcb->fs_st.extentLength; i++) {
+        pageSwap(i / vcb->fs_st.maxExtent - 1);
+        extent_st ext = vcb->free_space_map[i % vcb->fs_st.maxExtent];
+        if (ext.startLoc == -1 || ext.countBlock < nBlocks) continue;
+
+        // Extents before the goal count as further than the whole volume
+        long distance = (ext.startLoc >= goal) ? ext.startLoc - goal 
+                                    : (long) vcb->total_blocks + goal - ext.startLoc;
+        if (found == -1 || distance < bestDistance) {
+            found = i;
+            bestDistance = distance;
+        }
+    }
+    return found;
+}
+
+// Count the [-1:0] slots of all tables (once per mount, then kept up to date)
+static int countTombstones() {
+    int count = 0;
+    for (int i = 0; i < vcb->fs_st.extentLength; i++) {
+        pageSwap(i / vcb->fs_st.maxExtent - 1);
+        if (vcb->free_space_map[i % vcb->fs_st.maxExtent].startLoc == -1) count++;
+    }
+    return count;
+}
+
+static int compareExtents(const void* a, const void* b) {
+    int startA = ((const extent_st*) a)->startLoc;
+    int startB = ((const extent_st*) b)->startLoc;
+    return (startA > startB) - (startA < startB);
+}
+
+// Sort extents by start and merge the adjacent ones; @return the new count
+static int mergeExtents(extent_st* exts, int n) {
+    if (n < 2) return n;
+    qsort(exts, n, sizeof(extent_st), compareExtents);
+
+    int out = 0;
+    for (int i = 1; i < n; i++) {
+        if (exts[out].startLoc + exts[out].countBlock == exts[i].startLoc) {
+            exts[out].countBlock += exts[i].countBlock;
+        } else {
+            exts[++out] = exts[i];
+        }
+    }
+    return out + 1;
+}
+
+// Number of extents once add is merged into the merged list exts
+static int countWithExtent(const extent_st* exts, int n, extent_st add) {
+    int merges = 0;
+    for (int i = 0; i < n; i++) {
+        if (exts[i].startLoc + exts[i].countBlock == add.startLoc) merges++;
+        if (add.startLoc + add.countBlock == exts[i].startLoc) merges++;
+    }
+    return n + 1 - merges;
+}
+
+// Secondary tables needed to hold nExtents extents
+static int secondariesNeeded(int nExtents) {
+    if (nExtents <= vcb->fs_st.maxExtent) return 0;
+    return (nExtents + vcb->fs_st.maxExtent - 1) / vcb->fs_st.maxExtent - 1;
+}
+
+/** Make the table of page idxPage current (-1: primary, n: secondary table n).
+ * Resident tables are switched by pointer, see loadFreeSpaceMap */
+void pageSwap(int idxPage) {
+    int tableLoc = (idxPage < 0) ? FREESPACE_START_LOC : getSecTBLocation(idxPage);
+    if (tableLoc == -1 || (curTable && tableLoc == curTable->startLoc)) return;
+
+    vcb->free_space_map = loadFreeSpaceMap(tableLoc);
 }
 
 /** Retrieves the location of a secondary extent table by its index
@@ -372,19 +1020,179 @@ int getSecTBLocation(int secIdx) {
     }
     return vcb->fs_st.terExtTBMap[secIdx];
 }
-/** Write the updated free space map and Volume Control Block (VCB) to disk 
- * when the user terminates the program. This also applies when allocating 
- * or releasing blocks from different tables */
-int writeFSToDisk(int startLoc) {
-    int wCount = LBAwrite (vcb->free_space_map, vcb->fs_st.reservedBlocks, startLoc);
-    if (wCount != vcb->fs_st.reservedBlocks) {
-        printf("ERROR - writeFSToDisk @ %d - wCount: %d - reservedBlocks: %d\n", startLoc, wCount, vcb->fs_st.reservedBlocks);
+/** Write the modified blocks of every resident extent table to disk. Only 
+ * blocks flagged by markFSDirty are written, each run of adjacent dirty blocks
+ * as one segment of a single vectored write. Called after allocating or
+ * releasing blocks (see syncFreeSpace), at commit and at unmount.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int writeFSToDisk() {
+    pthread_mutex_lock(&fsSyncLock);
+    fsLastFlush = time(NULL);
+
+    int status = 0;
+    if (vcb->free_space_map) {
+        if (vcb->fs_engine == FS_ENGINE_TREE) status = syncTreeImage();
+        if (status == 0) status = writeTables(NULL);
+    }
+    pthread_mutex_unlock(&fsSyncLock);
+    return status;
+}
+
+/** Persist the extent table after an allocate/release according to 
+ * FS_FLUSH_INTERVAL. Deferred changes stay flagged dirty in memory.
+ * @return 0 on success, -1 on failure
+ */
+int syncFreeSpace() {
+    if (FS_FLUSH_INTERVAL < 0) return 0;
+    if (FS_FLUSH_INTERVAL > 0 && time(NULL) - fsLastFlush < FS_FLUSH_INTERVAL) return 0;
+    return writeFSToDisk();
+}
+
+/** Flag the block of the loaded extent table that holds extent index as 
+ * modified so the next writeFSToDisk writes it */
+void markFSDirty(int index) {
+    markFSBlockDirty((index * sizeof(extent_st)) / vcb->block_size);
+}
+
+// Release the extent tables, tertiary table and tree kept in memory
+void freeFreeSpace() {
+    for (int i = 0; i < FS_TABLE_CACHE; i++) {
+        freePtr((void**) &fsTables[i].table, "Free space map");
+        freePtr((void**) &fsTables[i].dirty, "Free space dirty map");
+        fsTables[i].dirtyCount = 0;
+    }
+    curTable = NULL;
+    vcb->free_space_map = NULL;
+
+    freePtr((void**) &vcb->fs_st.terExtTBMap, "Tertiary extent table");
+    for (int g = 0; g < FS_MAX_GROUPS; g++) {
+        treeDestroy(&groupTree[g]);
+        groupImageUsed[g] = 0;
+        groupChanged[g] = 0;
+    }
+    bitmapDestroy();
+}
+
+// @return the resident table stored at startLoc, NULL if it is not in memory
+static fs_table_st* findTable(int startLoc) {
+    for (int i = 0; i < FS_TABLE_CACHE; i++) {
+        if (fsTables[i].table && fsTables[i].startLoc == startLoc) return &fsTables[i];
+    }
+    return NULL;
+}
+
+/** Take a slot for the table at startLoc: an unused one, else the least 
+ * recently used table after its dirty blocks are written back.
+ * @return the slot with clean dirty flags, NULL on failure */
+static fs_table_st* claimTable(int startLoc) {
+    fs_table_st* slot = NULL;
+    for (int i = 0; i < FS_TABLE_CACHE && (!slot || slot->table); i++) {
+        if (!slot || !fsTables[i].table || fsTables[i].lastUse < slot->lastUse) slot = &fsTables[i];
+    }
+
+    if (slot->table && writeTables(slot) == -1) return NULL;
+
+    if (!slot->table) {
+        slot->table = (extent_st*) allocateMemFS(vcb->fs_st.reservedBlocks);
+        slot->dirty = calloc(vcb->fs_st.reservedBlocks, 1);
+        if (!slot->table || !slot->dirty) {
+            dropTable(slot);
+            return NULL;
+        }
+    }
+
+    slot->startLoc = startLoc;
+    memset(slot->dirty, 0, vcb->fs_st.reservedBlocks);
+    slot->dirtyCount = 0;
+    return slot;
+}
+
+// Make a resident table the current one
+static void useTable(fs_table_st* t) {
+    t->lastUse = ++fsTableClock;
+    curTable = t;
+    vcb->fs_st.curExtentLBA = t->startLoc;
+    vcb->free_space_map = t->table;
+}
+
+// Give a slot back (its content is not valid)
+static void dropTable(fs_table_st* t) {
+    if (t == curTable) {
+        curTable = NULL;
+        vcb->free_space_map = NULL;
+    }
+    freePtr((void**) &t->table, "Free space map");
+    freePtr((void**) &t->dirty, "Free space dirty map");
+    t->dirtyCount = 0;
+}
+
+/** Write the dirty blocks of one table (only) or of all resident tables (NULL)
+ * in one vectored write
+ * @return 0 on success, -1 on failure */
+static int writeTables(fs_table_st* only) {
+    int dirtyBlocks = 0;
+    for (int t = 0; t < FS_TABLE_CACHE; t++) {
+        if (fsTables[t].table && (!only || only == &fsTables[t])) dirtyBlocks += fsTables[t].dirtyCount;
+    }
+    if (dirtyBlocks == 0) return 0;
+
+    lba_seg_st* segs = malloc(dirtyBlocks * sizeof(lba_seg_st));
+    if (!segs) return -1;
+
+    int nSegs = 0;
+    for (int t = 0; t < FS_TABLE_CACHE; t++) {
+        fs_table_st* table = &fsTables[t];
+        if (!table->table || table->dirtyCount == 0 || (only && only != table)) continue;
+
+        char* data = (char*) table->table;
+        for (int i = 0; i < vcb->fs_st.reservedBlocks; i++) {
+            if (!table->dirty[i]) continue;
+
+            int runEnd = i + 1;
+            while (runEnd < vcb->fs_st.reservedBlocks && table->dirty[runEnd]) runEnd++;
+
+            segs[nSegs++] = (lba_seg_st) { data + i * vcb->block_size, runEnd - i, table->startLoc + i };
+            i = runEnd;
+        }
+    }
+
+    int prevClass = ioSetClass(IO_CLASS_FREESPACE);
+    int wCount = cacheWritev(segs, nSegs);
+    ioSetClass(prevClass);
+    free(segs);
+
+    if (wCount != dirtyBlocks) {
+        printf("ERROR - writeFSToDisk - wCount: %d - dirtyBlocks: %d\n", wCount, dirtyBlocks);
         return -1;
     }
-    // printf("Saved Free Space Map to disk @ %d ... \n", startLoc);   
+
+    for (int t = 0; t < FS_TABLE_CACHE; t++) {
+        if (!fsTables[t].table || (only && only != &fsTables[t])) continue;
+        memset(fsTables[t].dirty, 0, vcb->fs_st.reservedBlocks);
+        fsTables[t].dirtyCount = 0;
+    }
     return 0;
 }
 
+// Flag a block of the current table as modified
+static void markFSBlockDirty(int block) {
+    if (!curTable || block < 0 || block >= vcb->fs_st.reservedBlocks) return;
+    if (curTable->dirty[block]) return;
+
+    curTable->dirty[block] = 1;
+    curTable->dirtyCount++;
+}
+
+// Flag (1) or clear (0) every block of the current table
+static void setAllFSDirty(int dirty) {
+    if (!curTable) return;
+
+    memset(curTable->dirty, dirty, vcb->fs_st.reservedBlocks);
+    curTable->dirtyCount = dirty ? vcb->fs_st.reservedBlocks : 0;
+}
+
 /** Reserve the minimum number of blocks required for free space by considers 
  * fragmentation and the size of each block.
  * @return estimated number of blocks, ensuring at least one block is allocated
@@ -0,0 +1,160 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: IOStats.c
+*
+* Description:: Counters behind the iostat command. The current I/O
+* class is kept per thread: a subsystem sets it around its cache calls
+* and every request picks it up when it is submitted, so the async
+* workers and cache write back still charge the right class.
+*
+**************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "structs/IOStats.h"
+
+static io_stats_st stats;
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread int currentClass = IO_CLASS_OTHER;
+
+static const char* className[IO_CLASSES] = {
+    "other", "data", "directory", "freespace", "tertiary", "vcb", "journal", "inode",
+    "readahead"
+};
+
+/** Sets the I/O class charged for the calls made by this thread
+ * @return the previous class so the caller can restore it
+ * @author Danish Nguyen
+ */
+int ioSetClass(int ioClass) {
+    int prevClass = currentClass;
+    if (ioClass >= 0 && ioClass < IO_CLASSES) currentClass = ioClass;
+    return prevClass;
+}
+
+/** @return the I/O class charged for the calls made by this thread */
+int ioGetClass() {
+    return currentClass;
+}
+
+/** @return monotonic time in nanoseconds, used to time LBA calls */
+uint64_t ioClockNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** Counts one LBA call of the given class and direction */
+void ioRecord(int ioClass, int op, uint64_t blocks, uint64_t nanos) {
+    if (ioClass < 0 || ioClass >= IO_CLASSES || (op != IO_OP_READ && op != IO_OP_WRITE)) return;
+
+    pthread_mutex_lock(&statsLock);
+    io_counter_st* c = &stats.classes[ioClass][op];
+    c->calls++;
+    c->blocks += blocks;
+    c->nanos += nanos;
+    if (nanos > c->maxNanos) c->maxNanos = nanos;
+    pthread_mutex_unlock(&statsLock);
+}
+
+/** Counts bytes moved between the user and b_read / b_write */
+void ioRecordUser(int op, uint64_t bytes) {
+    pthread_mutex_lock(&statsLock);
+    if (op == IO_OP_WRITE) stats.userWritten += bytes;
+    else stats.userRead += bytes;
+    pthread_mutex_unlock(&statsLock);
+}
+
+/** Counts block lookups served by the block cache (hits) or by the disk (misses) */
+void ioRecordCache(uint64_t hits, uint64_t misses) {
+    pthread_mutex_lock(&statsLock);
+    stats.cacheHits += hits;
+    stats.cacheMisses += misses;
+    pthread_mutex_unlock(&statsLock);
+}
+
+/** Counts one range of blocks punched out of the volume file */
+void ioRecordDiscard(uint64_t blocks) {
+    pthread_mutex_lock(&statsLock);
+    stats.discardCalls++;
+    stats.discardBlocks += blocks;
+    pthread_mutex_unlock(&statsLock);
+}
+
+/** Copies a consistent snapshot of the counters into out */
+void getIOStats(io_stats_st* out) {
+    pthread_mutex_lock(&statsLock);
+    *out = stats;
+    pthread_mutex_unlock(&statsLock);
+}
+
+void resetIOStats() {
+    pthread_mutex_lock(&statsLock);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&statsLock);
+}
+
+/** Prints the counters of each class, the totals and the write amplification:
+ * bytes written to the volume divided by bytes the user wrote through b_write.
+ * @author Danish Nguyen
+ */
+void printIOStats(uint64_t blockSize) {
+    io_stats_st s;
+    getIOStats(&s);
+
+    printf("%-10s %8s %10s %10s %8s %10s %10s %10s\n", "class", "rd_calls", "rd_blocks",
+            "rd_avg_us", "wr_calls", "wr_blocks", "wr_avg_us", "wr_max_us");
+
+    io_counter_st total[2];
+    memset(total, 0, sizeof(total));
+
+    for (int i = 0; i < IO_CLASSES; i++) {
+        io_counter_st* rd = &s.classes[i][IO_OP_READ];
+        io_counter_st* wr = &s.classes[i][IO_OP_WRITE];
+
+        for (int op = 0; op < 2; op++) {
+            total[op].calls += s.classes[i][op].calls;
+            total[op].blocks += s.classes[i][op].blocks;
+        }
+        if (rd->calls == 0 && wr->calls == 0) continue;
+
+        printf("%-10s %8llu %10llu %10.1f %8llu %10llu %10.1f %10.1f\n", className[i],
+                (ull_t) rd->calls, (ull_t) rd->blocks,
+                rd->calls ? rd->nanos / 1000.0 / rd->calls : 0.0,
+                (ull_t) wr->calls, (ull_t) wr->blocks,
+                wr->calls ? wr->nanos / 1000.0 / wr->calls : 0.0,
+                wr->maxNanos / 1000.0);
+    }
+    printf("%-10s %8llu %10llu %10s %8llu %10llu\n", "total",
+            (ull_t) total[IO_OP_READ].calls, (ull_t) total[IO_OP_READ].blocks, "",
+            (ull_t) total[IO_OP_WRITE].calls, (ull_t) total[IO_OP_WRITE].blocks);
+
+    uint64_t lookups = s.cacheHits + s.cacheMisses;
+    printf("cache: %llu hits, %llu misses (%.1f%% hit rate)\n", (ull_t) s.cacheHits,
+            (ull_t) s.cacheMisses, lookups ? 100.0 * s.cacheHits / lookups : 0.0);
+
+    if (s.discardCalls > 0) {
+        printf("discard: %llu ranges, %llu blocks punched\n", (ull_t) s.discardCalls, 
+                (ull_t) s.discardBlocks);
+    }
+
+    uint64_t diskWritten = total[IO_OP_WRITE].blocks * blockSize;
+    printf("user: %llu bytes read, %llu bytes written; volume: %llu bytes written\n",
+            (ull_t) s.userRead, (ull_t) s.userWritten, (ull_t) diskWritten);
+
+    if (s.userWritten > 0) {
+        printf("write amplification: %.2f\n", (double) diskWritten / s.userWritten);
+    } else {
+        printf("write amplification: n/a (no user writes)\n");
+    }
+}
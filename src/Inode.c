@@ -0,0 +1,392 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Inode.c
+*
+* Description:: Inode table and in-memory inodes. An inode is read
+* from the block of the table holding it, outside of the lock, and
+* shared by every holder until the last one puts it back. Writing an
+* inode writes back only its table block, as metadata (journaled). The
+* free list head and the table extents live in the VCB, which every
+* journal commit logs with the blocks it covers.
+*
+**************************************************************/
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "structs/VCB.h"
+#include "structs/Inode.h"
+
+static inode_node_st* buckets[INODE_CACHE_BUCKETS];
+static pthread_mutex_t inodeLock = PTHREAD_MUTEX_INITIALIZER;  // the in-memory inodes
+static pthread_mutex_t tableLock = PTHREAD_MUTEX_INITIALIZER;  // the table blocks and free list
+
+static int inodeLBA(uint32_t ino, int* offset);
+static int readInode(uint32_t ino, inode_st* inode);
+static int storeInode(inode_st* inode);
+static int initTableBlocks(const extent_st* exts, int nExts, uint32_t first, uint32_t count);
+static int growTable();
+static void freeInode(inode_st* inode);
+static inode_node_st* findNode(uint32_t ino);
+
+/** Creates the inode table of a new volume with room for nInodes inodes (a
+ * whole number of blocks), every inode but inode 0 on the free list
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int formatInodeTable(int nInodes) {
+    int perBlock = INODE_PER_BLOCK(vcb->block_size);
+    int blocks = computeBlockNeeded(nInodes, perBlock);
+
+    extents_st tableLoc = allocateBlocks(blocks, 0, -1);
+    if (!tableLoc.extents || tableLoc.size > INODE_TABLE_EXTENTS) {
+        printf(" --- ERROR: Failed to allocate blocks for the inode table --- \n");
+        returnExtents(tableLoc);
+        return -1;
+    }
+
+    vcb->it_st.count = 0;
+    vcb->it_st.free_head = INODE_NONE;
+    vcb->it_st.ext_length = 0;
+
+    int status = initTableBlocks(tableLoc.extents, tableLoc.size, 0, blocks * perBlock);
+    if (status == 0) {
+        memcpy(vcb->it_st.extents, tableLoc.extents, tableLoc.size * sizeof(extent_st));
+        vcb->it_st.ext_length = tableLoc.size;
+        vcb->it_st.count = blocks * perBlock;
+        vcb->it_st.free_head = 1;
+        freeExtents(&tableLoc);
+    } else {
+        returnExtents(tableLoc);
+    }
+    return status;
+}
+
+/** Takes an inode off the free list, growing the table when none is left.
+ * The inode has one link; the caller names it in a directory, or sets nlink
+ * to 0 before putting it back if that fails.
+ * @return the held inode, NULL on failure
+ * @author Danish Nguyen
+ */
+inode_st* inodeAlloc(int isDir) {
+    pthread_mutex_lock(&tableLock);
+    if (vcb->it_st.free_head == INODE_NONE && growTable() == -1) {
+        pthread_mutex_unlock(&tableLock);
+        printf("Error - no inode left\n");
+        return NULL;
+    }
+    uint32_t ino = vcb->it_st.free_head;
+
+    inode_st free;
+    if (readInode(ino, &free) == -1) {
+        pthread_mutex_unlock(&tableLock);
+        return NULL;
+    }
+    vcb->it_st.free_head = free.next_free;
+    pthread_mutex_unlock(&tableLock);
+
+    inode_node_st* node = calloc(1, sizeof(inode_node_st));
+    if (!node) return NULL;
+
+    time_t curTime = time(NULL);
+    node->inode.ino = ino;
+    node->inode.is_directory = isDir;
+    node->inode.nlink = 1;
+    node->inode.creation_time = curTime;
+    node->inode.modification_time = curTime;
+    node->inode.access_time = curTime;
+    node->refs = 1;
+
+    pthread_mutex_lock(&inodeLock);
+    int b = ino % INODE_CACHE_BUCKETS;
+    node->next = buckets[b];
+    buckets[b] = node;
+    pthread_mutex_unlock(&inodeLock);
+
+    if (writeInode(&node->inode) == -1) {
+        node->inode.nlink = 0;
+        inodePut(&node->inode);
+        return NULL;
+    }
+    return &node->inode;
+}
+
+/** Gets inode ino, read from the table only when nobody holds it. The
+ * caller holds a reference until inodePut.
+ * @return the shared inode, NULL if ino is not an inode in use
+ * @author Danish Nguyen
+ */
+inode_st* inodeGet(uint32_t ino) {
+    if (ino == INODE_NONE || ino >= vcb->it_st.count) return NULL;
+
+    pthread_mutex_lock(&inodeLock);
+    inode_node_st* node = findNode(ino);
+    if (node) {
+        node->refs++;
+        pthread_mutex_unlock(&inodeLock);
+        return &node->inode;
+    }
+    pthread_mutex_unlock(&inodeLock);
+
+    inode_node_st* loaded = malloc(sizeof(inode_node_st));
+    if (!loaded) return NULL;
+
+    if (readInode(ino, &loaded->inode) == -1 || loaded->inode.nlink < 1 || loaded->inode.ino != ino) {
+        free(loaded);
+        return NULL;
+    }
+
+    // Another thread may have read it meanwhile, its copy wins
+    pthread_mutex_lock(&inodeLock);
+    node = findNode(ino);
+    if (node) {
+        free(loaded);
+    } else {
+        node = loaded;
+        node->refs = 0;
+
+        int b = ino % INODE_CACHE_BUCKETS;
+        node->next = buckets[b];
+        buckets[b] = node;
+    }
+    node->refs++;
+    pthread_mutex_unlock(&inodeLock);
+    return &node->inode;
+}
+
+// Take one more reference on an inode
+void inodeHold(inode_st* inode) {
+    if (!inode) return;
+
+    pthread_mutex_lock(&inodeLock);
+    ((inode_node_st*) inode)->refs++;
+    pthread_mutex_unlock(&inodeLock);
+}
+
+/** Drops a reference taken by inodeGet/inodeHold/inodeAlloc. The last one
+ * frees the memory, and the inode itself (blocks included) once no name is
+ * left for it.
+ */
+void inodePut(inode_st* inode) {
+    if (!inode) return;
+    inode_node_st* node = (inode_node_st*) inode;
+
+    pthread_mutex_lock(&inodeLock);
+    if (--node->refs > 0) {
+        pthread_mutex_unlock(&inodeLock);
+        return;
+    }
+    inode_node_st** link = &buckets[inode->ino % INODE_CACHE_BUCKETS];
+    while (*link && *link != node) link = &(*link)->next;
+    if (*link) *link = node->next;
+    pthread_mutex_unlock(&inodeLock);
+
+    if (inode->nlink < 1) freeInode(inode);
+    free(node);
+}
+
+/** Copies an inode held in memory without taking a reference (readahead,
+ * from any thread). The copy may be older than the inode by the time it is used.
+ * @return 0 if copied, -1 if nobody holds inode ino
+ */
+int inodePeek(uint32_t ino, inode_st* copy) {
+    pthread_mutex_lock(&inodeLock);
+    inode_node_st* node = findNode(ino);
+    if (node) *copy = node->inode;
+    pthread_mutex_unlock(&inodeLock);
+    return node ? 0 : -1;
+}
+
+// @return the LBA of the table block holding inode ino and its offset in the block, -1 if none
+int inodeLocate(uint32_t ino, int* offset) {
+    pthread_mutex_lock(&tableLock);
+    int lba = inodeLBA(ino, offset);
+    pthread_mutex_unlock(&tableLock);
+    return lba;
+}
+
+/** Writes an inode back to its block of the table
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int writeInode(inode_st* inode) {
+    // Inodes sharing the block are written under the same lock
+    pthread_mutex_lock(&tableLock);
+    int status = storeInode(inode);
+    pthread_mutex_unlock(&tableLock);
+    return status;
+}
+
+/** Releases every block of an inode and empties it. The caller writes it.
+ * @return 0 on success, -1 on failure
+ */
+int inodeTruncate(inode_st* inode) {
+    for (int i = 0; i < inode->ext_length; i++) {
+        // Release all blocks associated with the target file or directory to FreeSpace
+        if (releaseBlocks(inode->extents[i].startLoc, inode->extents[i].countBlock) == -1) {
+            printf("Error - Failed to delete the data of inode %u\n", inode->ino);
+            return -1;
+        }
+    }
+    inode->file_size = 0;
+    inode->ext_length = 0;
+    inode->unwritten_blocks = 0;
+    return 0;
+}
+
+// @return the LBA of the table block holding inode ino and its offset in the block, -1 if none
+static int inodeLBA(uint32_t ino, int* offset) {
+    if (ino >= vcb->it_st.count) return -1;
+
+    int perBlock = INODE_PER_BLOCK(vcb->block_size);
+    int idx = ino / perBlock;
+    *offset = (ino % perBlock) * sizeof(inode_st);
+
+    for (int i = 0; i < vcb->it_st.ext_length; i++) {
+        if (idx < vcb->it_st.extents[i].countBlock) return vcb->it_st.extents[i].startLoc + idx;
+        idx -= vcb->it_st.extents[i].countBlock;
+    }
+    return -1;
+}
+
+// Copy inode ino out of the table: one block, usually served by the block cache
+static int readInode(uint32_t ino, inode_st* inode) {
+    int offset;
+    int lba = inodeLBA(ino, &offset);
+    if (lba == -1) return -1;
+
+    char* block = malloc(vcb->block_size);
+    if (!block) return -1;
+
+    int prevClass = ioSetClass(IO_CLASS_INODE);
+    int status = (cacheRead(block, 1, lba) == 1) ? 0 : -1;
+    ioSetClass(prevClass);
+
+    if (status == 0) memcpy(inode, block + offset, sizeof(inode_st));
+    free(block);
+    return status;
+}
+
+// Read-modify-write of the table block of an inode (caller holds tableLock)
+static int storeInode(inode_st* inode) {
+    int offset;
+    int lba = inodeLBA(inode->ino, &offset);
+    if (lba == -1) return -1;
+
+    char* block = malloc(vcb->block_size);
+    if (!block) return -1;
+
+    int prevClass = ioSetClass(IO_CLASS_INODE);
+    int status = -1;
+    if (cacheRead(block, 1, lba) == 1) {
+        memcpy(block + offset, inode, sizeof(inode_st));
+        status = (cacheWrite(block, 1, lba) == 1) ? 0 : -1;
+    }
+    ioSetClass(prevClass);
+
+    free(block);
+    return status;
+}
+
+/** Writes count empty inodes numbered from first to the blocks of exts, each
+ * one pointing to the next on the free list, the last one to the current head
+ * @return 0 on success, -1 on failure
+ */
+static int initTableBlocks(const extent_st* exts, int nExts, uint32_t first, uint32_t count) {
+    inode_st* inodes = calloc(count, sizeof(inode_st));
+    if (!inodes) return -1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        inodes[i].ino = first + i;
+        inodes[i].next_free = (i + 1 < count) ? first + i + 1 : vcb->it_st.free_head;
+    }
+
+    lba_seg_st segs[INODE_TABLE_EXTENTS];
+    char* pos = (char*) inodes;
+    int blocks = 0;
+
+    for (int i = 0; i < nExts; i++) {
+        segs[i] = (lba_seg_st) { pos, exts[i].countBlock, exts[i].startLoc };
+        pos += exts[i].countBlock * vcb->block_size;
+        blocks += exts[i].countBlock;
+    }
+
+    int prevClass = ioSetClass(IO_CLASS_INODE);
+    int written = cacheWritev(segs, nExts);
+    ioSetClass(prevClass);
+
+    free(inodes);
+    return (written < blocks) ? -1 : 0;
+}
+
+/** Doubles the inode table (caller holds tableLock). The new blocks follow
+ * its last extent when possible; the new inodes go on the free list.
+ * @return 0 on success, -1 on failure
+ */
+static int growTable() {
+    inode_table_st* table = &vcb->it_st;
+    int perBlock = INODE_PER_BLOCK(vcb->block_size);
+    int blocks = table->count / perBlock;
+
+    extent_st last = table->extents[table->ext_length - 1];
+    extents_st added = allocateBlocks(blocks, 0, last.startLoc + last.countBlock);
+    if (!added.extents) return -1;
+
+    // Count the extents the table ends up with before touching it
+    int nExts = table->ext_length;
+    int end = last.startLoc + last.countBlock;
+    for (int i = 0; i < added.size; i++) {
+        if (added.extents[i].startLoc != end) nExts++;
+        end = added.extents[i].startLoc + added.extents[i].countBlock;
+    }
+    if (nExts > INODE_TABLE_EXTENTS ||
+        initTableBlocks(added.extents, added.size, table->count, blocks * perBlock) == -1) {
+        returnExtents(added);
+        return -1;
+    }
+
+    for (int i = 0; i < added.size; i++) {
+        extent_st* tail = &table->extents[table->ext_length - 1];
+        if (tail->startLoc + tail->countBlock == added.extents[i].startLoc) {
+            tail->countBlock += added.extents[i].countBlock;
+        } else {
+            table->extents[table->ext_length++] = added.extents[i];
+        }
+    }
+    freeExtents(&added);
+
+    table->free_head = table->count;
+    table->count += blocks * perBlock;
+
+    int prevClass = ioSetClass(IO_CLASS_VCB);
+    int status = (cacheWrite(vcb, 1, 0) < 1) ? -1 : 0;
+    ioSetClass(prevClass);
+    return status;
+}
+
+// Give the blocks of an inode without names back to the free space, then the inode to the free list
+static void freeInode(inode_st* inode) {
+    inodeTruncate(inode);
+
+    // On the free list only once written, so no one takes it before
+    pthread_mutex_lock(&tableLock);
+    uint32_t ino = inode->ino;
+    memset(inode, 0, sizeof(inode_st));
+    inode->ino = ino;
+    inode->next_free = vcb->it_st.free_head;
+    if (storeInode(inode) == 0) vcb->it_st.free_head = ino;
+    pthread_mutex_unlock(&tableLock);
+}
+
+static inode_node_st* findNode(uint32_t ino) {
+    for (inode_node_st* node = buckets[ino % INODE_CACHE_BUCKETS]; node; node = node->next) {
+        if (node->inode.ino == ino) return node;
+    }
+    return NULL;
+}
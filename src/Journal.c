@@ -0,0 +1,663 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Journal.c
+*
+* Description:: Metadata write-ahead journal. The journal attaches to
+* the block cache, which keeps dirty metadata blocks pending until they
+* are committed. A commit first writes dirty file data home (ordered
+* mode), then writes every pending block as one transaction with a
+* single sequential LBAwrite. Checkpoints write committed blocks home
+* and restart the log; replay on mount applies every complete
+* transaction found after the superblock. A commit thread commits
+* what is left pending once the shell goes idle, and checkpoints the
+* log in the background once it is JOURNAL_CHECKPOINT_PCT full. Blocks released after
+* they were logged are revoked in the next transaction, so replay does
+* not bring their old metadata back over data written there since.
+*
+**************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "structs/VCB.h"
+#include "structs/Journal.h"
+#include "structs/Discard.h"
+
+// I/O classes whose dirty blocks are logged
+#define JOURNAL_CLASSES ((1 << IO_CLASS_DIR) | (1 << IO_CLASS_FREESPACE) | \
+                         (1 << IO_CLASS_TERTIARY) | (1 << IO_CLASS_VCB) | \
+                         (1 << IO_CLASS_INODE))
+#define ALL_CLASSES ((1 << IO_CLASSES) - 1)
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// What scanTransaction does with a transaction
+#define SCAN_CHECK 0        // only validate it
+#define SCAN_REVOKES 1      // collect its revoke records
+#define SCAN_APPLY 2        // write its blocks home, except revoked ones
+
+/* Revoke records found by replay, the latest transaction revoking each LBA
+ * - lbas / seqs: revoked LBA and the transaction of its last revoke
+ * - count / max: entries used and allocated */
+typedef struct revoke_set_st {
+    uint32_t* lbas;
+    uint64_t* seqs;
+    int count;
+    int max;
+} revoke_set_st;
+
+static int active = 0;          // 1 while the journal is attached to the cache
+static int committing = 0;      // set while journalCommit prepares a transaction
+static uint64_t nextSeq = 1;    // sequence number of the next transaction
+static unsigned int head = 1;   // next free block of the log, 0 is the superblock
+static time_t lastCommit = 0;
+
+static pthread_t commitThread;
+static int threadRunning = 0;   // 1 while the commit thread runs
+static int stopping = 0;        // set by exitJournal to end the thread
+static int checkpointDue = 0;   // set by journalCommit to wake the thread for a checkpoint
+static pthread_mutex_t timerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timerWake = PTHREAD_COND_INITIALIZER;
+
+// Both guarded by the cache lock and emptied by every checkpoint
+static int logged[JOURNAL_BLOCKS];  // home LBAs with a copy in the log, sorted
+static int nLogged = 0;
+static int revoked[JOURNAL_BLOCKS]; // logged LBAs released since, for the next transaction
+static int nRevoked = 0;
+
+static int journalHook(int request);
+static void* commitMain(void* arg);
+static void stopCommitThread();
+static void backgroundCheckpoint();
+static int commitPending();
+static int checkpointLog();
+static int flushAndReset();
+static int writeTransaction(const int* lbas, const char** data, int count, int nRevokes);
+static int scanTransaction(char* log, unsigned int start, int mode, revoke_set_st* revokes);
+static int addRevoke(revoke_set_st* revokes, uint32_t lba, uint64_t seq);
+static int isRevoked(const revoke_set_st* revokes, uint32_t lba, uint64_t seq);
+static int insertSorted(int* set, int* n, int lba);
+static int firstAtLeast(const int* set, int n, int lba);
+static int writeSuperblock();
+static int perDescriptor();
+static int transactionBlocks(int count, int nRevokes);
+static uint64_t checksum(uint64_t hash, const void* buf, size_t len);
+static uint64_t journalIO(int op, void* buf, uint64_t count, uint64_t pos);
+
+/** Reserves the journal region while formatting a new volume and writes an
+ * empty log. Volumes too small for JOURNAL_MIN_BLOCKS get no journal.
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int formatJournal(int numberOfBlocks) {
+    vcb->jn_st = (journal_st) { 0, 0, 0 };
+
+    int nBlocks = min(JOURNAL_BLOCKS, numberOfBlocks / 16);
+    if (nBlocks < JOURNAL_MIN_BLOCKS) {
+        printf("Volume is too small for a journal, metadata is written in place\n");
+        return 0;
+    }
+
+    int loc = createExtentTables(nBlocks, nBlocks);
+    if (loc == -1) return -1;
+
+    vcb->jn_st = (journal_st) { JOURNAL_MAGIC, loc, nBlocks };
+    nextSeq = 1;
+    head = 1;
+    return writeSuperblock();
+}
+
+/** Applies every complete transaction of the log to the volume, in order, and
+ * starts a new empty log after the last one. The revoke records of all of them
+ * are collected first, so a block released later is not written back. Must run
+ * right after the VCB is read, before any other metadata is loaded.
+ * @return number of transactions replayed, -1 on failure
+ * @author Danish Nguyen
+ */
+int replayJournal() {
+    if (vcb->jn_st.magic != JOURNAL_MAGIC) return 0;
+
+    char* log = malloc((size_t) vcb->jn_st.nBlocks * vcb->block_size);
+    if (!log) return -1;
+
+    if (journalIO(IO_OP_READ, log, vcb->jn_st.nBlocks, 0) < vcb->jn_st.nBlocks) {
+        free(log);
+        return -1;
+    }
+
+    journal_header_st* super = (journal_header_st*) log;
+    if (super->magic != JOURNAL_MAGIC || super->type != JBLOCK_SUPER) {
+        printf("Journal superblock is not valid, starting a new log\n");
+        nextSeq = 1;
+    } else {
+        nextSeq = super->seq;
+    }
+
+    int replayed = 0;
+    unsigned int pos = 1;
+    uint64_t firstSeq = nextSeq;
+    revoke_set_st revokes = { NULL, NULL, 0, 0 };
+
+    // Only the revokes of transactions validated in full are taken
+    while (pos < vcb->jn_st.nBlocks) {
+        int blocks = scanTransaction(log, pos, SCAN_CHECK, NULL);
+        if (blocks == 0) break;
+
+        if (scanTransaction(log, pos, SCAN_REVOKES, &revokes) == 0) {
+            free(revokes.lbas);
+            free(revokes.seqs);
+            free(log);
+            return -1;
+        }
+        pos += blocks;
+        nextSeq++;
+        replayed++;
+    }
+
+    nextSeq = firstSeq;
+    pos = 1;
+    for (int i = 0; i < replayed; i++) {
+        pos += scanTransaction(log, pos, SCAN_APPLY, &revokes);
+        nextSeq++;
+    }
+    free(revokes.lbas);
+    free(revokes.seqs);
+    free(log);
+
+    if (replayed > 0) {
+        if (cacheFlush() == -1) return -1;
+        printf("Replayed %d journal transaction(s)\n", replayed);
+    }
+
+    // Old transactions have a lower sequence number than the new superblock
+    head = 1;
+    if (writeSuperblock() == -1) return -1;
+    return replayed;
+}
+
+/** Attaches the journal to the block cache once the volume is mounted and
+ * starts the commit thread. Without the thread metadata is still committed,
+ * but only by the next metadata write or at unmount.
+ * @return 0 on success
+ */
+int startJournal() {
+    if (vcb->jn_st.magic != JOURNAL_MAGIC) return 0;
+
+    active = 1;
+    lastCommit = time(NULL);
+    nLogged = 0;
+    nRevoked = 0;
+    cacheSetJournal(journalHook, JOURNAL_CLASSES);
+
+    stopping = 0;
+    if (!threadRunning && pthread_create(&commitThread, NULL, commitMain, NULL) == 0) {
+        threadRunning = 1;
+    } else if (!threadRunning) {
+        printf("Unable to start the journal commit thread\n");
+    }
+    return 0;
+}
+
+/** Commits and checkpoints everything, then detaches the journal so the rest
+ * of the unmount writes in place.
+ * @return 0 on success, -1 on failure
+ */
+int exitJournal() {
+    if (!active) return 0;
+
+    stopCommitThread();
+    int status = journalCheckpoint();
+    cacheSetJournal(NULL, 0);
+    active = 0;
+    return status;
+}
+
+/** Group commit: brings the in-memory free space table and VCB into the cache,
+ * then logs every pending metadata block in one transaction. Once the log is
+ * JOURNAL_CHECKPOINT_PCT full the commit thread checkpoints it; the caller
+ * only waits for a checkpoint when the log is full (see commitPending).
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int journalCommit() {
+    if (!active) return 0;
+
+    // The free space lock comes before the cache's: the map is brought in
+    // first, the transaction is then built with the cache held
+    writeFSToDisk();
+
+    cacheEnter();
+    if (committing) {
+        cacheLeave();
+        return 0;
+    }
+    committing = 1;
+
+    int prevClass = ioSetClass(IO_CLASS_VCB);
+    cacheWrite(vcb, 1, 0);
+    ioSetClass(prevClass);
+
+    int status = commitPending();
+    committing = 0;
+
+    int due = (status == 0 && head * 100 >= vcb->jn_st.nBlocks * JOURNAL_CHECKPOINT_PCT);
+    if (due && !threadRunning) status = flushAndReset();
+    cacheLeave();
+
+    if (due && threadRunning) {
+        pthread_mutex_lock(&timerLock);
+        checkpointDue = 1;
+        pthread_cond_signal(&timerWake);
+        pthread_mutex_unlock(&timerLock);
+    }
+    return status;
+}
+
+/** Commits, writes every committed block home and restarts the log
+ * @return 0 on success, -1 on failure
+ */
+int journalCheckpoint() {
+    if (!active) return 0;
+    if (journalCommit() == -1) return -1;
+
+    cacheEnter();
+    int status = flushAndReset();
+    cacheLeave();
+    return status;
+}
+
+/** Called when blocks go back to the free space map. Those logged since the
+ * last checkpoint are revoked by the next transaction: the released blocks
+ * can hold file data before the log is checkpointed, and replay must not
+ * write their old metadata over it.
+ * @author Danish Nguyen
+ */
+void journalRevoke(int startLoc, int countBlocks) {
+    if (!active) return;
+
+    cacheEnter();
+    int end = startLoc + countBlocks;
+    for (int i = firstAtLeast(logged, nLogged, startLoc); i < nLogged && logged[i] < end; i++) {
+        insertSorted(revoked, &nRevoked, logged[i]);
+    }
+    cacheLeave();
+}
+
+/** Called by the block cache (see JOURNAL_HINT / COMMIT / BARRIER)
+ * @return 0 on success, -1 on failure */
+static int journalHook(int request) {
+    if (!active) return 0;
+
+    if (request == JOURNAL_HINT) {
+        // The free space map is written under its lock and a commit writes it
+        // again: a hint raised by that write waits for the next one
+        if (ioGetClass() == IO_CLASS_FREESPACE) return 0;
+
+        cacheEnter();
+        int due = !committing && (cacheUnlogged(NULL, NULL, 0) >= JOURNAL_GROUP_BLOCKS ||
+                                  time(NULL) - lastCommit >= JOURNAL_COMMIT_INTERVAL);
+        cacheLeave();
+        return due ? journalCommit() : 0;
+    }
+
+    // Forced with the cache locked, where the free space lock can not be taken:
+    // the blocks pending are logged without bringing in the map (the next
+    // commit does, as when a commit is forced while it prepares its transaction)
+    return (request == JOURNAL_BARRIER) ? checkpointLog() : commitPending();
+}
+
+/** Commit thread: checkpoints the log when journalCommit asks for it, and
+ * wakes up every JOURNAL_COMMIT_INTERVAL seconds to commit the metadata that
+ * waited that long, so an idle shell leaves nothing pending for more than
+ * about twice the interval. */
+static void* commitMain(void* arg) {
+    while (1) {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_sec += JOURNAL_COMMIT_INTERVAL;
+
+        pthread_mutex_lock(&timerLock);
+        while (!stopping && !checkpointDue &&
+               pthread_cond_timedwait(&timerWake, &timerLock, &wake) == 0);
+        int stop = stopping;
+        int checkpoint = checkpointDue;
+        checkpointDue = 0;
+        pthread_mutex_unlock(&timerLock);
+        if (stop) return NULL;
+
+        if (checkpoint) {
+            backgroundCheckpoint();
+            continue;
+        }
+
+        cacheEnter();
+        int due = !committing && time(NULL) - lastCommit >= JOURNAL_COMMIT_INTERVAL &&
+                  cacheUnlogged(NULL, NULL, 0) > 0;
+        cacheLeave();
+        if (due) journalCommit();
+    }
+}
+
+/** Checkpoint run by the commit thread. The committed blocks go home one run
+ * at a time, each with the cache held only for that run, so foreground work
+ * goes on meanwhile; the log is then reset with the few blocks committed since.
+ */
+static void backgroundCheckpoint() {
+    int written;
+    while ((written = cacheWriteBackLogged()) == 1);
+    if (written == -1) return;
+
+    // A full log may have been checkpointed by a commit in the meantime
+    cacheEnter();
+    if (head * 100 >= vcb->jn_st.nBlocks * JOURNAL_CHECKPOINT_PCT) flushAndReset();
+    cacheLeave();
+}
+
+// End the commit thread, the caller commits what is still pending
+static void stopCommitThread() {
+    if (!threadRunning) return;
+
+    pthread_mutex_lock(&timerLock);
+    stopping = 1;
+    pthread_cond_signal(&timerWake);
+    pthread_mutex_unlock(&timerLock);
+
+    pthread_join(commitThread, NULL);
+    threadRunning = 0;
+}
+
+/** Writes file data home (ordered mode), then logs every pending block of the
+ * cache; the first transaction also carries the revokes waiting. Does not
+ * claim cache slots, so it is safe to call from the cache.
+ * @return 0 on success, -1 on failure
+ */
+static int commitPending() {
+    if (cacheFlushClasses(ALL_CLASSES & ~JOURNAL_CLASSES) == -1) return -1;
+
+    int count = cacheUnlogged(NULL, NULL, 0);
+    if (count == 0) return 0;
+
+    int* lbas = malloc(count * sizeof(int));
+    const char** data = malloc(count * sizeof(char*));
+    if (!lbas || !data) {
+        free(lbas);
+        free(data);
+        return -1;
+    }
+    cacheUnlogged(lbas, data, count);
+
+    // Largest transaction that fits in an empty log, with the revokes waiting
+    int maxCount = vcb->jn_st.nBlocks - 3;
+    while (transactionBlocks(maxCount, nRevoked) > vcb->jn_st.nBlocks - 1) maxCount--;
+
+    int status = 0;
+    for (int done = 0; done < count; ) {
+        int n = min(count - done, maxCount);
+
+        // Only a full log is checkpointed here, the commit thread handles the rest
+        // (a checkpoint empties the log and the revokes with it)
+        if (head + transactionBlocks(n, nRevoked) > vcb->jn_st.nBlocks && flushAndReset() == -1) {
+            status = -1;
+            break;
+        }
+        if (writeTransaction(lbas + done, data + done, n, nRevoked) == -1) {
+            status = -1;
+            break;
+        }
+        cacheMarkLogged(lbas + done, n);
+        for (int i = done; i < done + n; i++) insertSorted(logged, &nLogged, lbas[i]);
+        nRevoked = 0;
+        done += n;
+    }
+
+    free(lbas);
+    free(data);
+    lastCommit = time(NULL);
+    return status;
+}
+
+// Commit what is pending and checkpoint without preparing a new transaction
+static int checkpointLog() {
+    if (commitPending() == -1) return -1;
+    return flushAndReset();
+}
+
+/** Writes every committed block home and starts an empty log. Pending blocks
+ * stay in the cache: their previous versions are already home.
+ * @return 0 on success, -1 on failure
+ */
+static int flushAndReset() {
+    if (cacheFlushClasses(ALL_CLASSES) == -1) return -1;
+
+    head = 1;
+    nLogged = 0;
+    nRevoked = 0;
+    if (writeSuperblock() == -1) return -1;
+
+    // Everything freeing the released blocks is home, they can be discarded
+    discardFlush();
+    return 0;
+}
+
+/** Builds descriptors, data, the first nRevokes revoked LBAs and the commit
+ * block of one transaction in a buffer and appends it to the log with a single
+ * write.
+ * @return 0 on success, -1 on failure
+ */
+static int writeTransaction(const int* lbas, const char** data, int count, int nRevokes) {
+    int blockSize = vcb->block_size;
+    int nBlocks = transactionBlocks(count, nRevokes);
+
+    char* buf = calloc(nBlocks, blockSize);
+    if (!buf) return -1;
+
+    uint64_t hash = FNV_OFFSET;
+    int pos = 0;
+
+    for (int i = 0; i < count; ) {
+        int inDesc = min(perDescriptor(), count - i);
+
+        journal_header_st* desc = (journal_header_st*) (buf + pos * blockSize);
+        *desc = (journal_header_st) { JOURNAL_MAGIC, JBLOCK_DESC, inDesc, nextSeq, 0 };
+
+        uint32_t* homes = (uint32_t*) (desc + 1);
+        for (int j = 0; j < inDesc; j++) homes[j] = lbas[i + j];
+        hash = checksum(hash, homes, inDesc * sizeof(uint32_t));
+        pos++;
+
+        for (int j = 0; j < inDesc; j++, pos++) {
+            memcpy(buf + pos * blockSize, data[i + j], blockSize);
+            hash = checksum(hash, data[i + j], blockSize);
+        }
+        i += inDesc;
+    }
+
+    for (int i = 0; i < nRevokes; pos++) {
+        int inBlock = min(perDescriptor(), nRevokes - i);
+
+        journal_header_st* rev = (journal_header_st*) (buf + pos * blockSize);
+        *rev = (journal_header_st) { JOURNAL_MAGIC, JBLOCK_REVOKE, inBlock, nextSeq, 0 };
+
+        uint32_t* lbaList = (uint32_t*) (rev + 1);
+        for (int j = 0; j < inBlock; j++) lbaList[j] = revoked[i + j];
+        hash = checksum(hash, lbaList, inBlock * sizeof(uint32_t));
+        i += inBlock;
+    }
+
+    journal_header_st* commit = (journal_header_st*) (buf + pos * blockSize);
+    *commit = (journal_header_st) { JOURNAL_MAGIC, JBLOCK_COMMIT, count, nextSeq, hash };
+
+    uint64_t written = journalIO(IO_OP_WRITE, buf, nBlocks, head);
+    free(buf);
+
+    if (written < nBlocks) {
+        printf("ERROR - writeTransaction @ %u - blocks: %d\n", head, nBlocks);
+        return -1;
+    }
+    head += nBlocks;
+    nextSeq++;
+    return 0;
+}
+
+/** Checks the transaction nextSeq starting at block start of the log buffer.
+ * SCAN_REVOKES adds its revoke records to revokes; SCAN_APPLY writes its
+ * blocks to their home LBAs through the cache, except those revoked by a
+ * later transaction (a copy in the revoking transaction itself was written
+ * after the release).
+ * @return number of log blocks used by the transaction, 0 if it is not complete
+ */
+static int scanTransaction(char* log, unsigned int start, int mode, revoke_set_st* revokes) {
+    int blockSize = vcb->block_size;
+    unsigned int pos = start;
+    uint64_t hash = FNV_OFFSET;
+    uint32_t total = 0;
+
+    int prevClass = ioSetClass(IO_CLASS_JOURNAL);
+    while (pos < vcb->jn_st.nBlocks) {
+        journal_header_st* h = (journal_header_st*) (log + (size_t) pos * blockSize);
+        if (h->magic != JOURNAL_MAGIC || h->seq != nextSeq) break;
+
+        if (h->type == JBLOCK_COMMIT) {
+            ioSetClass(prevClass);
+            return (h->count == total && h->checksum == hash) ? pos + 1 - start : 0;
+        }
+        if (h->count > perDescriptor()) break;
+
+        uint32_t* lbaList = (uint32_t*) (h + 1);
+        hash = checksum(hash, lbaList, h->count * sizeof(uint32_t));
+
+        if (h->type == JBLOCK_REVOKE) {
+            for (uint32_t j = 0; mode == SCAN_REVOKES && j < h->count; j++) {
+                if (addRevoke(revokes, lbaList[j], nextSeq) == -1) {
+                    ioSetClass(prevClass);
+                    return 0;
+                }
+            }
+            pos++;
+            continue;
+        }
+        if (h->type != JBLOCK_DESC || pos + 1 + h->count >= vcb->jn_st.nBlocks) break;
+
+        for (uint32_t j = 0; j < h->count; j++) {
+            char* block = log + (size_t) (pos + 1 + j) * blockSize;
+            hash = checksum(hash, block, blockSize);
+            if (mode == SCAN_APPLY && !isRevoked(revokes, lbaList[j], nextSeq)) {
+                cacheWrite(block, 1, lbaList[j]);
+            }
+        }
+        total += h->count;
+        pos += 1 + h->count;
+    }
+    ioSetClass(prevClass);
+    return 0;
+}
+
+/** Records that transaction seq revokes lba, keeping the latest revoke
+ * @return 0 on success, -1 on failure
+ */
+static int addRevoke(revoke_set_st* revokes, uint32_t lba, uint64_t seq) {
+    for (int i = 0; i < revokes->count; i++) {
+        if (revokes->lbas[i] == lba) {
+            revokes->seqs[i] = seq;
+            return 0;
+        }
+    }
+    if (revokes->count == revokes->max) {
+        int max = revokes->max ? revokes->max * 2 : 64;
+        uint32_t* lbas = realloc(revokes->lbas, max * sizeof(uint32_t));
+        if (!lbas) return -1;
+        revokes->lbas = lbas;
+
+        uint64_t* seqs = realloc(revokes->seqs, max * sizeof(uint64_t));
+        if (!seqs) return -1;
+        revokes->seqs = seqs;
+        revokes->max = max;
+    }
+    revokes->lbas[revokes->count] = lba;
+    revokes->seqs[revokes->count++] = seq;
+    return 0;
+}
+
+// @return 1 if a transaction after seq revokes lba
+static int isRevoked(const revoke_set_st* revokes, uint32_t lba, uint64_t seq) {
+    for (int i = 0; i < revokes->count; i++) {
+        if (revokes->lbas[i] == lba) return revokes->seqs[i] > seq;
+    }
+    return 0;
+}
+
+/** Adds lba to a sorted set of at most JOURNAL_BLOCKS LBAs
+ * @return 0 on success, -1 if the set is full */
+static int insertSorted(int* set, int* n, int lba) {
+    int i = firstAtLeast(set, *n, lba);
+    if (i < *n && set[i] == lba) return 0;
+    if (*n == JOURNAL_BLOCKS) return -1;
+
+    memmove(&set[i + 1], &set[i], (*n - i) * sizeof(int));
+    set[i] = lba;
+    (*n)++;
+    return 0;
+}
+
+// @return index of the first LBA of a sorted set that is >= lba
+static int firstAtLeast(const int* set, int n, int lba) {
+    int low = 0, high = n;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (set[mid] < lba) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// Write the superblock: the log starts empty with transaction nextSeq
+static int writeSuperblock() {
+    journal_header_st* super = calloc(1, vcb->block_size);
+    if (!super) return -1;
+
+    *super = (journal_header_st) { JOURNAL_MAGIC, JBLOCK_SUPER, 0, nextSeq, 0 };
+    uint64_t written = journalIO(IO_OP_WRITE, super, 1, 0);
+    free(super);
+    return (written == 1) ? 0 : -1;
+}
+
+// @return number of home LBAs that fit in one descriptor block
+static int perDescriptor() {
+    return (vcb->block_size - sizeof(journal_header_st)) / sizeof(uint32_t);
+}
+
+// @return log blocks used by a transaction of count data blocks and nRevokes revokes
+static int transactionBlocks(int count, int nRevokes) {
+    int descriptors = (count + perDescriptor() - 1) / perDescriptor();
+    int revokeBlocks = (nRevokes + perDescriptor() - 1) / perDescriptor();
+    return descriptors + count + revokeBlocks + 1;
+}
+
+// FNV-1a over buf, continuing from hash
+static uint64_t checksum(uint64_t hash, const void* buf, size_t len) {
+    const unsigned char* p = buf;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/** Reads or writes blocks of the journal region. The log never goes through
+ * the block cache: it is written once and only read back on mount.
+ * @return number of blocks transferred */
+static uint64_t journalIO(int op, void* buf, uint64_t count, uint64_t pos) {
+    int prevClass = ioSetClass(IO_CLASS_JOURNAL);
+    uint64_t done = (op == IO_OP_READ) ? lockedLBAread(buf, count, vcb->jn_st.startLoc + pos)
+                                       : lockedLBAwrite(buf, count, vcb->jn_st.startLoc + pos);
+    ioSetClass(prevClass);
+    return done;
+}
@@ -0,0 +1,295 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Readahead.c
+*
+* Description:: Directory readahead thread. The thread does not use
+* the cache: blocks are read with snapshotLBAread and handed to the
+* cache, which installs them on its next read unless the disk was
+* written in between. What is read ahead is only a guess made from
+* inodes that may be stale, but what gets installed is always what
+* the disk holds at those blocks.
+*
+**************************************************************/
+
+#include <stdio.h>
+
+#include "structs/Readahead.h"
+
+static pthread_t raThread;
+static int running = 0;                 // 1 while the thread runs
+static int stopping = 0;                // set by exitReadahead to end the thread
+
+static ra_job_st jobs[RA_MAX_JOBS];     // circular queue of directories, newest served first
+static int jHead = 0;
+static int jCount = 0;
+static uint32_t recent[RA_MAX_JOBS];    // directories queued lately, not queued again
+static int nextRecent = 0;
+
+static ra_read_st* ready = NULL;        // reads waiting for the cache
+static int readyBlocks = 0;
+
+static pthread_mutex_t raLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t raWork = PTHREAD_COND_INITIALIZER;
+
+static char* tableBlock = NULL;         // last table block read by the thread
+static int tableLba = -1;
+
+static void* raMain(void* arg);
+static int isStopping();
+static void runJob(ra_job_st* job);
+static int readInodeAhead(uint32_t ino, inode_st* inode);
+static int readBlocksAhead(inode_st* inode, int nBlocks, char* copy);
+static int queueRead(char* data, int count, int lba, uint64_t gen);
+static void installReady();
+
+/** Starts the readahead thread and attaches it to the block cache
+ * @return 0 on success, -1 on failure
+ * @author Danish Nguyen
+ */
+int initReadahead() {
+    if (running) return 0;
+
+    stopping = 0;
+    if (pthread_create(&raThread, NULL, raMain, NULL) != 0) return -1;
+    running = 1;
+
+    cacheSetReadahead(installReady);
+    return 0;
+}
+
+// Stop the thread, the blocks not installed yet are dropped
+void exitReadahead() {
+    if (!running) return;
+
+    pthread_mutex_lock(&raLock);
+    stopping = 1;
+    pthread_cond_signal(&raWork);
+    pthread_mutex_unlock(&raLock);
+
+    pthread_join(raThread, NULL);
+    running = 0;
+    cacheSetReadahead(NULL);
+
+    while (ready) {
+        ra_read_st* next = ready->next;
+        free(ready->data);
+        free(ready);
+        ready = next;
+    }
+    readyBlocks = 0;
+    jCount = 0;
+    memset(recent, 0, sizeof(recent));
+}
+
+/** Queues the entries of a loaded directory to be read ahead. Returns at once;
+ * a directory queued lately is not queued again.
+ * @author Danish Nguyen
+ */
+void readaheadDir(directory_entry* dir) {
+    if (!running || !dir) return;
+
+    ra_job_st job = { dirInode(dir)->ino, 0 };
+    for (int i = 2; i < sizeOfDE(dir) && job.count < RA_MAX_CHILDREN; i++) {
+        if (dir[i].is_used && dir[i].inode != INODE_NONE) job.inos[job.count++] = dir[i].inode;
+    }
+    if (job.count == 0) return;
+
+    pthread_mutex_lock(&raLock);
+    for (int i = 0; i < RA_MAX_JOBS; i++) {
+        if (recent[i] == job.ino) {
+            pthread_mutex_unlock(&raLock);
+            return;
+        }
+    }
+    recent[nextRecent] = job.ino;
+    nextRecent = (nextRecent + 1) % RA_MAX_JOBS;
+
+    // The oldest directory is the least likely to be used now
+    if (jCount == RA_MAX_JOBS) {
+        jHead = (jHead + 1) % RA_MAX_JOBS;
+        jCount--;
+    }
+    jobs[(jHead + jCount) % RA_MAX_JOBS] = job;
+    jCount++;
+
+    pthread_cond_signal(&raWork);
+    pthread_mutex_unlock(&raLock);
+}
+
+// Thread loop: take the newest directory and read it ahead
+static void* raMain(void* arg) {
+    ioSetClass(IO_CLASS_READAHEAD);
+
+    while (1) {
+        pthread_mutex_lock(&raLock);
+        while (jCount == 0 && !stopping) pthread_cond_wait(&raWork, &raLock);
+
+        if (stopping) {
+            pthread_mutex_unlock(&raLock);
+            return NULL;
+        }
+        jCount--;
+        ra_job_st job = jobs[(jHead + jCount) % RA_MAX_JOBS];
+        pthread_mutex_unlock(&raLock);
+
+        runJob(&job);
+    }
+}
+
+static int isStopping() {
+    pthread_mutex_lock(&raLock);
+    int stop = stopping;
+    pthread_mutex_unlock(&raLock);
+    return stop;
+}
+
+/** Reads ahead the entries of a directory level by level: the inodes, then
+ * the blocks of each entry; the subdirectories read give the next level
+ */
+static void runJob(ra_job_st* job) {
+    int blockSize = vcb->block_size;
+    int budget = RA_BUDGET_BLOCKS;
+
+    uint32_t level[RA_MAX_CHILDREN];
+    uint32_t next[RA_MAX_CHILDREN];
+    int n = job->count;
+    memcpy(level, job->inos, n * sizeof(uint32_t));
+
+    tableBlock = malloc(blockSize);
+    char* dirCopy = malloc((size_t) RA_DIR_BLOCKS * blockSize);
+    if (!tableBlock || !dirCopy) n = 0;
+    tableLba = -1;
+
+    for (int depth = 1; depth <= RA_MAX_DEPTH && n > 0 && budget > 0; depth++) {
+        int nNext = 0;
+
+        for (int i = 0; i < n && budget > 0 && !isStopping(); i++) {
+            inode_st inode;
+            if (readInodeAhead(level[i], &inode) == -1) continue;
+
+            int blocks = 0;
+            for (int e = 0; e < inode.ext_length; e++) blocks += inode.extents[e].countBlock;
+
+            // A file is read whole or not at all, only its written blocks
+            if (!inode.is_directory) {
+                blocks = computeBlockNeeded(inode.file_size, blockSize);
+                if (blocks > RA_FILE_BLOCKS) continue;
+            }
+            blocks = min(min(blocks, RA_DIR_BLOCKS), budget);
+            if (blocks < 1) continue;
+
+            int wantEntries = inode.is_directory && depth < RA_MAX_DEPTH;
+            int read = readBlocksAhead(&inode, blocks, wantEntries ? dirCopy : NULL);
+            if (read < 1) continue;
+            budget -= read;
+
+            // The entries read give the next level
+            if (!wantEntries) continue;
+            int nEntries = min(inode.file_size, read * blockSize) / sizeof(directory_entry);
+            directory_entry* entries = (directory_entry*) dirCopy;
+
+            for (int k = 2; k < nEntries && nNext < RA_MAX_CHILDREN; k++) {
+                if (entries[k].is_used && entries[k].inode != INODE_NONE) next[nNext++] = entries[k].inode;
+            }
+        }
+        memcpy(level, next, nNext * sizeof(uint32_t));
+        n = nNext;
+    }
+    freePtr((void**) &tableBlock, "Readahead table block");
+    free(dirCopy);
+}
+
+/** Gets a copy of inode ino: from memory when it is held, else from its table
+ * block, which is read ahead too (once for its neighbours)
+ * @return 0 if the copy looks like an inode in use, -1 otherwise
+ */
+static int readInodeAhead(uint32_t ino, inode_st* inode) {
+    if (inodePeek(ino, inode) == -1) {
+        int offset;
+        int lba = inodeLocate(ino, &offset);
+        if (lba == -1) return -1;
+
+        if (lba != tableLba) {
+            char* data = malloc(vcb->block_size);
+            uint64_t gen;
+            if (!data || snapshotLBAread(data, 1, lba, &gen) < 1) {
+                free(data);
+                tableLba = -1;
+                return -1;
+            }
+            memcpy(tableBlock, data, vcb->block_size);
+            tableLba = lba;
+            queueRead(data, 1, lba, gen);
+        }
+        memcpy(inode, tableBlock + offset, sizeof(inode_st));
+    }
+    return (inode->ino == ino && inode->nlink >= 1 && inode->ext_length >= 1 &&
+            inode->ext_length <= MAX_EXTENTS) ? 0 : -1;
+}
+
+/** Reads the first nBlocks blocks of an inode, one read per extent, and
+ * queues them for the cache. A copy goes to copy when it is not NULL.
+ * @return number of blocks read, -1 on failure
+ */
+static int readBlocksAhead(inode_st* inode, int nBlocks, char* copy) {
+    int blockSize = vcb->block_size;
+    int done = 0;
+
+    for (int e = 0; e < inode->ext_length && done < nBlocks; e++) {
+        int lba = inode->extents[e].startLoc;
+        int count = min(inode->extents[e].countBlock, nBlocks - done);
+        if (lba < 0 || count < 1 || lba + count > (int) vcb->total_blocks) return -1;
+
+        char* data = malloc((size_t) count * blockSize);
+        uint64_t gen;
+        if (!data || snapshotLBAread(data, count, lba, &gen) < count) {
+            free(data);
+            return (done > 0) ? done : -1;
+        }
+        if (copy) memcpy(copy + (size_t) done * blockSize, data, (size_t) count * blockSize);
+        if (queueRead(data, count, lba, gen) == -1) return (done > 0) ? done : -1;
+        done += count;
+    }
+    return done;
+}
+
+// Hand a read to the cache (it owns data from now on), refused past RA_MAX_READY blocks
+static int queueRead(char* data, int count, int lba, uint64_t gen) {
+    ra_read_st* read = malloc(sizeof(ra_read_st));
+
+    pthread_mutex_lock(&raLock);
+    if (!read || readyBlocks + count > RA_MAX_READY) {
+        pthread_mutex_unlock(&raLock);
+        free(read);
+        free(data);
+        return -1;
+    }
+    *read = (ra_read_st) { data, count, lba, gen, ready };
+    ready = read;
+    readyBlocks += count;
+    pthread_mutex_unlock(&raLock);
+    return 0;
+}
+
+// Cache hook, with the cache locked: install every read done so far
+static void installReady() {
+    pthread_mutex_lock(&raLock);
+    ra_read_st* list = ready;
+    ready = NULL;
+    readyBlocks = 0;
+    pthread_mutex_unlock(&raLock);
+
+    while (list) {
+        ra_read_st* next = list->next;
+        cacheInstall(list->data, list->count, list->lba, list->gen);
+        free(list->data);
+        free(list);
+        list = next;
+    }
+}
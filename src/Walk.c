@@ -0,0 +1,278 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Walk.c
+*
+* Description:: Parallel tree walk. Directories are loaded through
+* the directory cache and inodes through the inode cache, both shared
+* by the threads; blocks come from the block cache under its lock. A
+* thread that finds no task sleeps until a task is pushed or the last
+* one is done.
+*
+**************************************************************/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "structs/Walk.h"
+#include "structs/ParsePath.h"
+#include "structs/DirCache.h"
+#include "mfs.h"
+
+static void* walkThread(void* arg);
+static int takeTask(walk_st* walk, int id, walk_task_st* task);
+static void runTask(walk_st* walk, int id, walk_task_st* task);
+static int pushTask(walk_st* walk, int id, uint32_t ino, int depth, const char* path);
+static void finishTask(walk_st* walk);
+static void stopWalk(walk_st* walk, int result);
+static int isStopped(walk_st* walk);
+static int joinPath(char* dest, const char* dir, const char* name);
+
+/** Walks the tree at pathname: fn is called for pathname itself (depth 0)
+ * and for every entry below it, by nThreads threads (0 or less: one per core,
+ * at most WALK_MAX_THREADS). The order of the calls is not defined. A hard
+ * link is visited once per name.
+ * @return 0 when done, the value of the callback that stopped the walk, -1 if
+ * the path does not exist or a part of the tree could not be read
+ * @author Danish Nguyen
+ */
+int fs_walk(const char* pathname, fs_walk_fn fn, void* arg, int nThreads) {
+    if (!pathname || !fn) return -1;
+
+    parsepath_st parser = { NULL, -1, "" };
+    if (parsePath(pathname, &parser) != 0 || parser.retParent == NULL) return -1;
+
+    // The entry of the path, "." of the directory itself for an empty last element
+    if (parser.index == -1 && parser.lastElement[0] != '\0') {
+        releaseDir(parser.retParent);
+        return -1;
+    }
+    directory_entry* start = &parser.retParent[(parser.index == -1) ? 0 : parser.index];
+
+    inode_st* inode = inodeGet(start->inode);
+    if (!inode) {
+        releaseDir(parser.retParent);
+        return -1;
+    }
+    int status = fn(pathname, start, inode, 0, arg);
+    int isDir = inode->is_directory;
+    uint32_t ino = inode->ino;
+
+    inodePut(inode);
+    releaseDir(parser.retParent);
+    if (status != 0 || !isDir) return status;
+
+    if (nThreads < 1) nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    nThreads = max(1, min(nThreads, WALK_MAX_THREADS));
+
+    walk_st* walk = calloc(1, sizeof(walk_st));
+    if (!walk) return -1;
+
+    walk->fn = fn;
+    walk->arg = arg;
+    walk->nThreads = nThreads;
+    pthread_mutex_init(&walk->lock, NULL);
+    pthread_cond_init(&walk->changed, NULL);
+    for (int i = 0; i < nThreads; i++) pthread_mutex_init(&walk->deques[i].lock, NULL);
+
+    status = pushTask(walk, 0, ino, 0, pathname);
+
+    // Thread 0 starts with the whole tree, the others steal from it
+    pthread_t threads[WALK_MAX_THREADS];
+    walk_worker_st workers[WALK_MAX_THREADS];
+    int started = 0;
+
+    for (int i = 0; i < nThreads && status == 0; i++) {
+        workers[i] = (walk_worker_st) { walk, i };
+        if (pthread_create(&threads[i], NULL, walkThread, &workers[i]) != 0) break;
+        started++;
+    }
+    // Without any thread the caller walks alone
+    if (status == 0 && started == 0) walkThread(&workers[0]);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    if (status == 0) status = walk->stop ? walk->result : (walk->failed ? -1 : 0);
+
+    for (int i = 0; i < nThreads; i++) {
+        walk_deque_st* deque = &walk->deques[i];
+        for (int k = 0; k < deque->count; k++) free(deque->tasks[(deque->top + k) % deque->capacity].path);
+        free(deque->tasks);
+        pthread_mutex_destroy(&deque->lock);
+    }
+    pthread_cond_destroy(&walk->changed);
+    pthread_mutex_destroy(&walk->lock);
+    free(walk);
+    return status;
+}
+
+// Thread loop: run tasks until none is pending
+static void* walkThread(void* arg) {
+    walk_worker_st* worker = (walk_worker_st*) arg;
+    walk_st* walk = worker->walk;
+
+    while (1) {
+        pthread_mutex_lock(&walk->lock);
+        unsigned long seen = walk->pushes;
+        pthread_mutex_unlock(&walk->lock);
+
+        walk_task_st task;
+        if (takeTask(walk, worker->id, &task)) {
+            if (!isStopped(walk)) runTask(walk, worker->id, &task);
+            free(task.path);
+            finishTask(walk);
+            continue;
+        }
+
+        // Nothing to take: wait for a push (missed ones are seen through the counter)
+        pthread_mutex_lock(&walk->lock);
+        while (walk->pending > 0 && walk->pushes == seen) pthread_cond_wait(&walk->changed, &walk->lock);
+        int done = (walk->pending == 0);
+        pthread_mutex_unlock(&walk->lock);
+
+        if (done) return NULL;
+    }
+}
+
+/** Takes the newest task of the thread's own deque, else steals the oldest
+ * task of another thread
+ * @return 1 if a task was taken, 0 if every deque is empty
+ */
+static int takeTask(walk_st* walk, int id, walk_task_st* task) {
+    for (int n = 0; n < walk->nThreads; n++) {
+        walk_deque_st* deque = &walk->deques[(id + n) % walk->nThreads];
+
+        pthread_mutex_lock(&deque->lock);
+        if (deque->count == 0) {
+            pthread_mutex_unlock(&deque->lock);
+            continue;
+        }
+        if (n == 0) {
+            *task = deque->tasks[(deque->top + deque->count - 1) % deque->capacity];
+        } else {
+            *task = deque->tasks[deque->top];
+            deque->top = (deque->top + 1) % deque->capacity;
+        }
+        deque->count--;
+        pthread_mutex_unlock(&deque->lock);
+        return 1;
+    }
+    return 0;
+}
+
+/** Calls the callback for every entry of the directory of a task and pushes
+ * a task for every subdirectory
+ */
+static void runTask(walk_st* walk, int id, walk_task_st* task) {
+    directory_entry* dir = dirCacheGet(task->ino);
+    if (!dir) {
+        stopWalk(walk, 0);
+        return;
+    }
+    char* path = malloc(WALK_PATH_MAX);
+
+    for (int i = 2; path && i < sizeOfDE(dir) && !isStopped(walk); i++) {
+        if (!dir[i].is_used) continue;
+        if (joinPath(path, task->path, dir[i].file_name) == -1) continue;
+
+        inode_st* inode = inodeGet(dir[i].inode);
+        if (!inode) {
+            stopWalk(walk, 0);
+            continue;
+        }
+        int status = walk->fn(path, &dir[i], inode, task->depth + 1, walk->arg);
+        int isDir = inode->is_directory;
+        inodePut(inode);
+
+        if (status != 0) {
+            stopWalk(walk, status);
+        } else if (isDir && pushTask(walk, id, dir[i].inode, task->depth + 1, path) == -1) {
+            stopWalk(walk, 0);
+        }
+    }
+    if (!path) stopWalk(walk, 0);
+
+    free(path);
+    releaseDir(dir);
+}
+
+/** Pushes a directory at the bottom of the deque of thread id
+ * @return 0 on success, -1 on failure
+ */
+static int pushTask(walk_st* walk, int id, uint32_t ino, int depth, const char* path) {
+    walk_deque_st* deque = &walk->deques[id];
+    walk_task_st task = { ino, depth, strdup(path) };
+    if (!task.path) return -1;
+
+    // Counted before it can be taken: a thief finishing it first must not
+    // see the walk done
+    pthread_mutex_lock(&walk->lock);
+    walk->pending++;
+    pthread_mutex_unlock(&walk->lock);
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        int capacity = (deque->capacity > 0) ? deque->capacity * 2 : WALK_DEQUE_INITIAL;
+        walk_task_st* tasks = malloc(capacity * sizeof(walk_task_st));
+        if (!tasks) {
+            pthread_mutex_unlock(&deque->lock);
+            free(task.path);
+            finishTask(walk);
+            return -1;
+        }
+        // Unroll the ring from its top
+        for (int k = 0; k < deque->count; k++) tasks[k] = deque->tasks[(deque->top + k) % deque->capacity];
+        free(deque->tasks);
+
+        deque->tasks = tasks;
+        deque->top = 0;
+        deque->capacity = capacity;
+    }
+    deque->tasks[(deque->top + deque->count) % deque->capacity] = task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+
+    pthread_mutex_lock(&walk->lock);
+    walk->pushes++;
+    pthread_cond_broadcast(&walk->changed);
+    pthread_mutex_unlock(&walk->lock);
+    return 0;
+}
+
+static void finishTask(walk_st* walk) {
+    pthread_mutex_lock(&walk->lock);
+    if (--walk->pending == 0) pthread_cond_broadcast(&walk->changed);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+// Stop the walk with the value of a callback, or mark it failed (result 0) and go on
+static void stopWalk(walk_st* walk, int result) {
+    pthread_mutex_lock(&walk->lock);
+    if (result == 0) {
+        walk->failed = 1;
+    } else if (!walk->stop) {
+        walk->stop = 1;
+        walk->result = result;
+    }
+    pthread_mutex_unlock(&walk->lock);
+}
+
+static int isStopped(walk_st* walk) {
+    pthread_mutex_lock(&walk->lock);
+    int stop = walk->stop;
+    pthread_mutex_unlock(&walk->lock);
+    return stop;
+}
+
+// Join a directory path and a name into dest (WALK_PATH_MAX bytes), -1 if too long
+static int joinPath(char* dest, const char* dir, const char* name) {
+    size_t len = strlen(dir);
+    const char* sep = (len > 0 && dir[len - 1] == '/') ? "" : "/";
+
+    int written = snprintf(dest, WALK_PATH_MAX, "%s%s%s", dir, sep, name);
+    return (written < 0 || written >= WALK_PATH_MAX) ? -1 : 0;
+}
@@ -28,6 +28,10 @@ int min(int a, int b) {
     return (a) < (b) ? (a) : (b);
 } 
 
+int max(int a, int b) {
+    return (a) > (b) ? (a) : (b);
+}
+
 // Frees memory allocated forfree space map and resets the pointer
 void freePtr(void** ptr, const char* type){
     if (ptr && *ptr) {
@@ -0,0 +1,97 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: AsyncIO.h
+*
+* Description:: Asynchronous block I/O engine next to fsLow.h. Callers
+* fill an array of block requests, submit them as one batch and later
+* reap the completions, so the I/O of a multi extent transfer overlaps
+* instead of running extent by extent. With fsLow.o the engine opens
+* the volume file itself (initVolumeIO) and hands requests to io_uring,
+* or to a pool of worker threads issuing pread/pwrite where the kernel
+* has no io_uring. With the mmap backend the workers call LBAread/
+* LBAwrite, which copy blocks in parallel.
+*
+**************************************************************/
+
+#ifndef _ASYNCIO_H
+#define _ASYNCIO_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "fsLow.h"
+#include "structs/IOStats.h"
+
+#define AIO_WORKERS 4       // Worker threads started by initAsyncIO
+#define AIO_MAX_WORKERS 16
+#define AIO_QUEUE_DEPTH 128 // Requests waiting for a worker / in flight in io_uring
+
+#define AIO_READ IO_OP_READ
+#define AIO_WRITE IO_OP_WRITE
+
+struct aio_batch_st;
+
+/* A single block request.
+ * - op: AIO_READ or AIO_WRITE
+ * - buffer, lbaCount, lbaPosition: same meaning as for LBAread/LBAwrite
+ * - result: number of blocks transferred, set on completion
+ * - done: 1 once the request is complete
+ * - batch: batch the request was submitted with (set by asyncSubmit)
+ * - ioClass: I/O class charged for the request (set by asyncSubmit)
+ * - started: clock when the request was handed to io_uring (set by asyncSubmit) */
+typedef struct aio_req_st {
+    int op;
+    void* buffer;
+    uint64_t lbaCount;
+    uint64_t lbaPosition;
+    uint64_t result;
+    int done;
+    struct aio_batch_st* batch;
+    int ioClass;
+    uint64_t started;
+} aio_req_st;
+
+/* A group of requests that is waited on together.
+ * - reqs / count: the requests of the batch
+ * - pending: requests submitted but not completed yet
+ * - failed: number of requests that transferred fewer blocks than asked */
+typedef struct aio_batch_st {
+    aio_req_st* reqs;
+    int count;
+    int pending;
+    int failed;
+} aio_batch_st;
+
+/* One segment of a vectored transfer, same meaning as the arguments of
+ * LBAread/LBAwrite */
+typedef struct lba_seg_st {
+    void* buffer;
+    uint64_t lbaCount;
+    uint64_t lbaPosition;
+} lba_seg_st;
+
+int initVolumeIO(const char* volumePath, uint64_t blockSize, uint64_t numberOfBlocks);
+int initAsyncIO(int nWorkers);
+void exitAsyncIO();
+
+int asyncSubmit(aio_batch_st* batch, aio_req_st* req);
+int asyncSubmitAll(aio_batch_st* batch);
+int asyncPending(aio_batch_st* batch);
+int asyncWait(aio_batch_st* batch);
+
+uint64_t LBAreadv(lba_seg_st* segs, int nSegs);
+uint64_t LBAwritev(lba_seg_st* segs, int nSegs);
+
+uint64_t lockedLBAread(void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+uint64_t lockedLBAwrite(void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+
+uint64_t snapshotLBAread(void* buffer, uint64_t lbaCount, uint64_t lbaPosition, uint64_t* gen);
+uint64_t lbaWriteGeneration();
+
+#endif
@@ -0,0 +1,45 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: BitmapAlloc.h
+*
+* Description:: Hierarchical bitmap used by the FS_ENGINE_BITMAP free
+* space engine. Level 0 is one bit per block of the volume (1 = free),
+* stored as 64-bit words; it is also the on-disk image of the engine.
+* Level 1 keeps the number of free blocks of every chunk of
+* BITMAP_CHUNK_BITS blocks, so full chunks are skipped without reading
+* their words. Inside a chunk, runs of all-used or all-free words are
+* skipped with SIMD compares (AVX2 or SSE2, picked at runtime) and
+* mixed words are walked with bit scans.
+*
+**************************************************************/
+
+#ifndef _BITMAPALLOC_H
+#define _BITMAPALLOC_H
+
+#include <sys/types.h>
+
+#include "fsLow.h"
+#include "structs/Extent.h"
+
+#define BITMAP_WORD_BITS 64
+#define BITMAP_CHUNK_WORDS 64       // words summarized by one level 1 counter
+#define BITMAP_CHUNK_BITS (BITMAP_CHUNK_WORDS * BITMAP_WORD_BITS)
+
+int bitmapInit(uint64_t* bitmap, int numberOfBits, int firstFree);
+int bitmapLoad(uint64_t* bitmap, int numberOfBits);
+void bitmapDestroy();
+
+extents_st bitmapAllocate(int nBlocks, int minContinuous, int goal);
+int bitmapRelease(int startLoc, int countBlock);
+
+int bitmapFreeBlocks();
+int bitmapExtentCount();
+int bitmapBytes(int numberOfBits);
+
+#endif
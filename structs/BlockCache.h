@@ -0,0 +1,110 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: BlockCache.h
+*
+* Description:: Write-back block cache that sits between the file system
+* and LBAread/LBAwrite. Blocks are kept in a fixed pool of slots, found
+* through a hash table keyed by LBA and evicted in LRU order. Dirty blocks
+* are only written to disk on eviction or when the cache is flushed.
+* Reads always copy out of the cache: its callers (directories, the
+* free space tables) keep and edit what they read, so a block lent in
+* place would have to be copied anyway.
+*
+**************************************************************/
+
+#ifndef _BLOCKCACHE_H
+#define _BLOCKCACHE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsLow.h"
+#include "structs/AsyncIO.h"
+
+#define BLOCK_CACHE_SIZE 512   // Default number of blocks kept in the cache
+
+// Transfers larger than this fraction of the cache go straight to disk so
+// that a single big file read/write does not wipe out all cached metadata
+#define CACHE_BYPASS_DIVISOR 4
+
+#define CACHE_EMPTY_SLOT -1    // lba of a slot that does not hold a block
+
+// Journal state of a cached block (see cacheSetJournal)
+#define CACHE_JNONE 0      // not journaled: clean, or of a class that is not logged
+#define CACHE_JPENDING 1   // dirty metadata not in the journal yet, can't go home
+#define CACHE_JLOGGED 2    // dirty metadata already committed to the journal
+
+// Requests the cache makes to the journal hook
+#define JOURNAL_HINT 0     // metadata was dirtied, commit if a group is ready (cache unlocked)
+#define JOURNAL_COMMIT 1   // pending metadata is about to be written in place (cache locked)
+#define JOURNAL_BARRIER 2  // metadata bypasses the cache, commit and checkpoint (cache locked)
+
+/* One cached block.
+ * - lba: block number on disk or CACHE_EMPTY_SLOT
+ * - dirty: 1 when the data differs from the copy on disk
+ * - prev / next: neighbours in the LRU list (slot index, -1 for none)
+ * - hashNext: next slot in the same hash bucket (-1 for none)
+ * - ioClass: I/O class that last filled or dirtied the block, charged on write back
+ * - jstate: CACHE_JNONE, CACHE_JPENDING or CACHE_JLOGGED
+ * - data: pointer into the cache's data pool (block_size bytes) */
+typedef struct cache_block_st {
+    int lba;
+    int dirty;
+    int prev;
+    int next;
+    int hashNext;
+    int ioClass;
+    int jstate;
+    char* data;
+} cache_block_st;
+
+/* Block cache state. The LRU list runs from lruHead (most recently used)
+ * to lruTail (next victim). */
+typedef struct block_cache_st {
+    int capacity;           // number of slots
+    int blockSize;          // size of one block in bytes
+
+    cache_block_st* slots;  // slot descriptors
+    char* pool;             // capacity * blockSize bytes of block data
+
+    int* buckets;           // hash buckets holding the first slot index
+    int nBuckets;
+
+    int lruHead;
+    int lruTail;
+} block_cache_st;
+
+int initBlockCache(int nBlocks, int blockSize);
+void freeBlockCache();
+
+uint64_t cacheRead(void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+uint64_t cacheWrite(void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+
+int cacheSubmit(aio_batch_st* batch);
+int cacheWait(aio_batch_st* batch);
+
+uint64_t cacheReadv(lba_seg_st* segs, int nSegs);
+uint64_t cacheWritev(lba_seg_st* segs, int nSegs);
+
+int cacheFlush();
+int cacheFlushRange(uint64_t lbaCount, uint64_t lbaPosition);
+void cacheDropRange(uint64_t lbaCount, uint64_t lbaPosition);
+
+void cacheSetJournal(int (*hook)(int request), int classMask);
+void cacheSetReadahead(void (*hook)());
+int cacheInstall(const void* buffer, uint64_t lbaCount, uint64_t lbaPosition, uint64_t gen);
+int cacheUnlogged(int* lbas, const char** data, int max);
+void cacheMarkLogged(const int* lbas, int count);
+int cacheFlushClasses(int classMask);
+int cacheWriteBackLogged();
+
+void cacheEnter();
+void cacheLeave();
+
+#endif
@@ -8,48 +8,54 @@
 *
 * File:: DE.h
 *
-* Description:: Directory Entry is a data structure that stores metadata for 
-* a file or directory in the filesystem. It includes information such as creation, 
-* modification, and access timestamps; file size; entry type (file or directory); 
-* usage status; file name; and an array of extents that specify the locations of 
-* data blocks on disk
+* Description:: Directory Entry names a file or directory in the filesystem: 
+* its file name, usage status, entry type (file or directory) and the number 
+* of the inode holding its metadata (timestamps, size and the extents of its 
+* data blocks on disk, see Inode.h). A loaded directory keeps a reference on 
+* its own inode, reached with dirInode
 *
 **************************************************************/
 #ifndef DE_H
 #define DE_H
 #include <time.h>
+#include <stdint.h>
 #include "Extent.h"
+#include "Inode.h"
 #include "fs_utils.h"
 #include "FreeSpace.h"  // Add this to get access to releaseBlocks
 
 #define MAX_FILENAME 32
-#define MAX_EXTENTS 8    // Maximum number of extents
 
 #define UNUSED_ENTRY '\0' // Marker for unused entries
 #define DIRECTORY_ENTRIES 50 
-//SIZE OF DE 40 + 32 + 64 = 136
+#define DIRECTORY_MAX_ENTRIES 131072  // a directory grows up to this many entries
+#define DIRECTORY_SHRINK_RATIO 4      // shrink a directory once 1 in 4 entries or less is used
+//SIZE OF DE 32 + 4 + 4 + 4 = 44
 typedef struct {
-    time_t creation_time;         // creation time of the file or directory
-    time_t modification_time;     // last modification time
-    time_t access_time;           // last access time
-    
-    int file_size;                // size of the file or directory
-    int is_directory;             // 1 if directory, 0 if file
-    int is_used;                  // 1 if used, 0 if unused
-    
-    int ext_length;               // number of extents
-
     char file_name[MAX_FILENAME]; // File or directory name
-    extent_st extents[MAX_EXTENTS]; // An of extent for data blocks (Processing... )
-    
+    uint32_t inode;               // inode holding the metadata and extents
+    int is_used;                  // 1 if used, 0 if unused
+    int is_directory;             // 1 if directory, 0 if file
 } directory_entry;
 
 directory_entry* createDirectory(int numEntries, directory_entry *parent);
 
 int writeDirHelper(directory_entry *newDir);
-directory_entry* readDirHelper(int dirLoc);
+int writeDirRange(directory_entry *dir, int offset, int length);
+int writeDirEntry(directory_entry *dir, int idx);
+directory_entry* readDirHelper(uint32_t ino);
 directory_entry* loadDir(directory_entry* directoryEntry);
+void releaseDir(directory_entry* dir);
+
+int growDir(directory_entry* dir);
+int shrinkDir(directory_entry* dir);
+int moveDir(directory_entry* dir, const extent_st* extents, int nExtents);
+
+directory_entry* allocDirBuffer(int bytes);
+int resizeDirBuffer(directory_entry* dir, int oldBytes, int newBytes);
+void freeDirBuffer(directory_entry* dir);
+inode_st* dirInode(directory_entry* dir);
 
-int removeDE(directory_entry *de, int idx, int isUsed);
+int removeDE(directory_entry *de, int idx);
 int sizeOfDE (directory_entry* de);
 #endif
@@ -0,0 +1,49 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Defrag.h
+*
+* Description:: Online defragmenter. Walks the directory tree and
+* moves every file or directory held by several extents to fewer
+* (ideally one) extents. Only its inode is updated: directory entries
+* name the inode, not the blocks. A file with several names is visited
+* once per name and moved at most once. A run stops when its time budget is spent; the next run picks up
+* where it stopped. Files must not be open while it runs.
+*
+**************************************************************/
+
+#ifndef _DEFRAG_H
+#define _DEFRAG_H
+
+#include "structs/VCB.h"
+
+#define DEFRAG_CHUNK_BLOCKS 256     // blocks copied per read / write
+
+/* Result of one defragmentation run
+ * - files / dirs: entries visited by this run
+ * - fragmentedBefore / After: visited entries held by more than one extent
+ * - extentsBefore / After: extents held by the visited entries
+ * - freeExtentsBefore / After: extents of the free space
+ * - moved: entries relocated
+ * - complete: 1 if the walk reached the end, 0 if the budget ran out */
+typedef struct defrag_stats_st {
+    int files;
+    int dirs;
+    int fragmentedBefore;
+    int fragmentedAfter;
+    int extentsBefore;
+    int extentsAfter;
+    int freeExtentsBefore;
+    int freeExtentsAfter;
+    int moved;
+    int complete;
+} defrag_stats_st;
+
+int defragVolume(int budgetMs, defrag_stats_st* stats);
+
+#endif
@@ -0,0 +1,78 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: DirCache.h
+*
+* Description:: Directory cache used by path resolution. Loaded
+* directories are shared and reference counted, keyed by the inode
+* number of the directory: every holder of a directory sees the same copy, and
+* an unreferenced directory stays cached until DIR_CACHE_DIRS of them
+* are kept. Name lookups are cached as (parent inode, name) -> index in
+* the parent, including names that were not found, so a repeated
+* lookup of a deep path does no directory scan and no I/O.
+*
+**************************************************************/
+
+#ifndef _DIRCACHE_H
+#define _DIRCACHE_H
+
+#include <pthread.h>
+
+#include "structs/DE.h"
+
+#define DIR_CACHE_DIRS 64         // unreferenced directories kept in memory
+#define DIR_CACHE_NAMES 512       // name lookups kept
+#define DIR_CACHE_BUCKETS 127
+
+#define DIR_NAME_UNKNOWN -2       // dirCacheLookup: nothing cached for the name
+#define DIR_NAME_ABSENT -1        // dirCacheLookup: the name is known not to exist
+
+/* A cached directory.
+ * - ino: inode of the directory, the key
+ * - dir: the loaded entries, shared by every holder
+ * - refs: holders that have not released it yet
+ * - streams: holders iterating it by entry index (fs_opendir)
+ * - lastUse: stamp of the last get or release, for LRU eviction
+ * - stale: 1 once invalidated, freed with its last reference
+ * - next: next directory in the same bucket (or in the stale list) */
+typedef struct dir_node_st {
+    uint32_t ino;
+    directory_entry* dir;
+    int refs;
+    int streams;
+    unsigned long lastUse;
+    int stale;
+    struct dir_node_st* next;
+} dir_node_st;
+
+/* A cached name lookup
+ * - parentIno: inode of the directory searched, -1 for a free slot
+ * - index: index of the entry in the directory or DIR_NAME_ABSENT
+ * - hashNext: next slot in the same bucket (-1 for none) */
+typedef struct dir_name_st {
+    int parentIno;
+    int index;
+    char name[MAX_FILENAME];
+    unsigned long lastUse;
+    int hashNext;
+} dir_name_st;
+
+directory_entry* dirCacheGet(uint32_t ino);
+int dirCacheAdd(directory_entry* dir);
+void dirCacheHold(directory_entry* dir);
+void dirCacheRelease(directory_entry* dir);
+void dirCacheInvalidate(uint32_t ino);
+int dirCacheStreams(directory_entry* dir, int delta);
+void freeDirCache();
+
+int dirCacheLookup(int parentIno, const char* name);
+void dirCacheRemember(int parentIno, const char* name, int index);
+void dirCacheForget(int parentIno, const char* name);
+void dirCacheForgetAll(int parentIno);
+
+#endif
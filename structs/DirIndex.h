@@ -0,0 +1,70 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: DirIndex.h
+*
+* Description:: Hashed name index of a directory, stored on disk in
+* the blocks that follow its entries (in the extents of its inode).
+* The index is an open addressing table of entry indexes keyed by the
+* hash of the name, with at least DIR_INDEX_LOAD slots per entry. The
+* index is loaded with the entries (readDirHelper reads both in one
+* vectored call, about 8 bytes of slots per 44 byte entry, so a cold
+* load reads some 18% more blocks) and stays in memory while the
+* directory is in the dir cache. A lookup then probes the slots in
+* memory instead of comparing every name, and an insert or delete
+* writes back only the slot block and the entry block it touched,
+* whatever the size of the directory. The header also keeps the free
+* slot hint and the used entry count of the directory. A directory
+* without index blocks (formatted before the index existed) is searched
+* entry by entry.
+*
+**************************************************************/
+
+#ifndef _DIRINDEX_H
+#define _DIRINDEX_H
+
+#include <stdint.h>
+
+#include "structs/DE.h"
+
+#define DIR_INDEX_MAGIC 0x58444944  // "DIDX"
+#define DIR_INDEX_LOAD 2            // slots per directory entry, at least
+#define DIR_INDEX_NONE -2           // dirIndexFind: the directory has no index
+
+/* Header of the index, at the first block after the entries
+ * - magic: DIR_INDEX_MAGIC once the index is built
+ * - nSlots: slots of the table
+ * - nEntries: entries of the directory the index was built for
+ * - nUsed / lastUsed: used entries and the highest one of them
+ * - freeHint: no entry below it is free
+ * - slots: 0 for an empty slot, else the top 8 bits of the hash of the
+ *   name and the entry index + 1 in the low 24 bits
+ * nUsed, lastUsed and freeHint are kept up to date in memory only and
+ * recounted whenever the directory is loaded. */
+typedef struct dir_index_st {
+    uint32_t magic;
+    uint32_t nSlots;
+    uint32_t nEntries;
+    uint32_t nUsed;
+    uint32_t lastUsed;
+    uint32_t freeHint;
+    uint32_t reserved[2];
+    uint32_t slots[];
+} dir_index_st;
+
+int dirIndexBlocks(int nEntries, int blockSize);
+int dirIndexBuild(directory_entry* dir);
+void dirIndexRecount(directory_entry* dir);
+dir_index_st* dirIndexOf(directory_entry* dir);
+
+int dirIndexFind(directory_entry* dir, const char* name);
+int dirIndexFreeEntry(directory_entry* dir);
+int dirIndexAdd(directory_entry* dir, int idx);
+int dirIndexRemove(directory_entry* dir, int idx);
+
+#endif
@@ -0,0 +1,38 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Discard.h
+*
+* Description:: Discard of released blocks. Ranges given back to the
+* free space map are queued, sorted and coalesced, and punched out of
+* the volume file on the host (fallocate PUNCH_HOLE) once the metadata
+* that frees them is home: at journal checkpoints and at unmount. A
+* range that is allocated again before that is taken off the queue, so
+* new data is never punched. The host file then only keeps blocks in
+* use. Without hole punching on the host the queue stays disabled.
+*
+**************************************************************/
+
+#ifndef _DISCARD_H
+#define _DISCARD_H
+
+#include <sys/types.h>
+
+#include "fsLow.h"
+#include "structs/Extent.h"
+
+#define DISCARD_MAX_RANGES 1024   // ranges queued between two flushes
+
+int initDiscard(const char* volumePath, uint64_t blockSize);
+void exitDiscard();
+
+void discardBlocks(int startLoc, int countBlocks);
+void discardCancel(int startLoc, int countBlocks);
+int discardFlush();
+
+#endif
@@ -0,0 +1,73 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: ExtentTree.h
+*
+* Description:: Free-extent tree used by the FS_ENGINE_TREE free space
+* engine. Every free extent is one node linked into two AVL trees: one
+* ordered by start LBA (neighbour lookup for coalescing and overlap
+* checks) and one ordered by length (best-fit allocation). Both are
+* O(log n) and there are no tombstones. On disk the tree is stored in
+* the free space region as a header followed by varint-encoded
+* (gap, length) pairs in start order.
+*
+**************************************************************/
+
+#ifndef _EXTENTTREE_H
+#define _EXTENTTREE_H
+
+#include <sys/types.h>
+
+#include "fsLow.h"
+#include "structs/Extent.h"
+
+#define TREE_BY_START 0
+#define TREE_BY_SIZE 1
+
+#define TREE_IMAGE_MAGIC 0x45455254 // "TREE"
+#define TREE_GOAL_SCAN 8            // free extents after the goal checked for a fit
+
+/* A free extent linked into both trees.
+ * - ext: start and length of the free run
+ * - child: [tree][0 left / 1 right]
+ * - height: AVL height in each tree */
+typedef struct ext_node_st {
+    extent_st ext;
+    struct ext_node_st* child[2][2];
+    int height[2];
+} ext_node_st;
+
+/* One free-extent tree (a volume, or an allocation group of it)
+ * - roots: root of the start tree and of the size tree
+ * - nExtents / totalFree: free extents and free blocks in the tree */
+typedef struct extent_tree_st {
+    ext_node_st* roots[2];
+    int nExtents;
+    int totalFree;
+} extent_tree_st;
+
+/* Header of the on-disk image
+ * - nExtents: number of (gap, length) pairs that follow
+ * - nBytes: size of the image including this header
+ * - totalFree: sum of all lengths, used to validate the image */
+typedef struct tree_image_st {
+    uint32_t magic;
+    uint32_t nExtents;
+    uint32_t nBytes;
+    uint32_t totalFree;
+} tree_image_st;
+
+int treeInit(extent_tree_st* tree, int startLoc, int countBlock);
+int treeLoad(extent_tree_st* tree, const char* image, int maxBytes);
+int treeSerialize(extent_tree_st* tree, char* image, int maxBytes);
+void treeDestroy(extent_tree_st* tree);
+
+extents_st treeAllocate(extent_tree_st* tree, int nBlocks, int minContinuous, int goal);
+int treeRelease(extent_tree_st* tree, int startLoc, int countBlock);
+
+#endif
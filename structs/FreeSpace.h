@@ -24,6 +24,7 @@
 #include <string.h> // memcpy
 
 #include "fsLow.h"
+#include "structs/BlockCache.h"
 #include "structs/Extent.h"
 #include "structs/fs_utils.h"
 
@@ -35,6 +36,47 @@
 #define FRAGMENTATION_PERCENT 0.05 //Number of Blocks need for FreeSpace
 #define FREESPACE_START_LOC 1
 
+// Free space engines. A volume keeps the engine it was formatted with; 
+// volumes formatted before the engine was recorded use the extent tables.
+#define FS_ENGINE_EXTENT 0    // primary/secondary/tertiary extent tables
+#define FS_ENGINE_TREE 1      // free-extent tree (ExtentTree.h)
+#define FS_ENGINE_BITMAP 2    // hierarchical bitmap (BitmapAlloc.h)
+#define FS_ENGINE_MAGIC 0x46534547 // "FSEG", validates vcb->fs_engine
+
+#ifndef FS_ENGINE_DEFAULT
+#define FS_ENGINE_DEFAULT FS_ENGINE_TREE
+#endif
+
+// Allocation groups (FS_ENGINE_TREE): the free blocks are split into groups,
+// each with its own tree, counters and lock, so threads allocating from 
+// different groups do not contend. Small volumes get fewer groups.
+#define FS_MAX_GROUPS 8             // groups the VCB can describe
+#ifndef FS_ALLOC_GROUPS
+#define FS_ALLOC_GROUPS 4           // groups created at format
+#endif
+#define FS_MIN_GROUP_BLOCKS 1024    // minimum blocks of a group
+#define FS_GROUP_MAGIC 0x46534147   // "FSAG", validates vcb->fs_groups
+
+// How long changes to the loaded extent table may stay in memory (seconds):
+// 0 writes the modified blocks after every allocate/release, N > 0 writes them
+// at most every N seconds and -1 only when the table is swapped or unmounted.
+#ifndef FS_FLUSH_INTERVAL
+#define FS_FLUSH_INTERVAL 0
+#endif
+
+// Number of extent tables (primary and secondary) kept in memory at once
+#ifndef FS_TABLE_CACHE
+#define FS_TABLE_CACHE 8
+#endif
+
+// The extent tables are compacted after an allocate/release once they hold at
+// least FS_COMPACT_MIN_EXTENTS slots and FS_COMPACT_TOMBSTONE_PCT percent of
+// them are empty [-1:0] slots. The shell command "compact" runs it on demand.
+#ifndef FS_COMPACT_TOMBSTONE_PCT
+#define FS_COMPACT_TOMBSTONE_PCT 50
+#endif
+#define FS_COMPACT_MIN_EXTENTS 64
+
 
 typedef struct freespace_st {
     unsigned int totalBlocksFree; // total blocks are free on disk
@@ -50,16 +92,46 @@ typedef struct freespace_st {
     int* terExtTBMap;      // Retain tertiary Extent TB in memory;
 } freespace_st;
 
+/* Allocation group, stored in the VCB
+ * - startLoc / nBlocks: range of the volume the group allocates from
+ * - imageLoc / imageBlocks: part of the free space region holding its tree,
+ *   relative to FREESPACE_START_LOC
+ * - freeBlocks: free blocks in the group */
+typedef struct fs_group_st {
+    unsigned int startLoc;
+    unsigned int nBlocks;
+    unsigned int imageLoc;
+    unsigned int imageBlocks;
+    unsigned int freeBlocks;
+} fs_group_st;
+
+/* An extent table resident in memory (runtime only)
+ * - startLoc: first block of the table on disk
+ * - table: the reservedBlocks blocks of the table, NULL when the slot is unused
+ * - dirty / dirtyCount: one flag per block modified since it was last written
+ * - lastUse: when the table was last made current, the oldest is evicted */
+typedef struct fs_table_st {
+    int startLoc;
+    extent_st* table;
+    unsigned char* dirty;
+    int dirtyCount;
+    unsigned long lastUse;
+} fs_table_st;
+
 
 extent_st* initFreeSpace(int numberOfBlocks, int blockSize); 
 extent_st* loadFreeSpaceMap(int startLoc);
+int validateFSEngine();
+void freeFreeSpace();
 
-extents_st allocateBlocks(int nBlocks, int minContinuous);
+extents_st allocateBlocks(int nBlocks, int minContinuous, int goal);
 int releaseBlocks(int startLoc, int nBlocks);
 void returnExtents(extents_st exts);
 
 int addExtent(int startLoc, int countBlock);
 void removeExtent( int startLoc, int i );
+int compactFreeSpace();
+int freeExtentCount();
 
 // int findLBABlockLocation(int n, int nBlock);
 
@@ -70,7 +142,9 @@ int createSecondaryExtentTB();
 int createTertiaryExtentTB();
 int loadTertiaryTB();
 
-int writeFSToDisk(int startLoc);
+int writeFSToDisk();
+int syncFreeSpace();
+void markFSDirty(int index);
 
 int calBlocksNeededFS(int numberOfBlocks, int blockSize);
 int getSecTBLocation(int secIdx);
@@ -79,7 +153,7 @@ int indexExtentTB();
 int secondaryTBIndex();
 
 int isOverlap(extent_st existExt, int addExtStart, int addExtCount);
-void pageSwap(int idx, int idxPage);
+void pageSwap(int idxPage);
 void freeExtents(extents_st* reqBlocks);
 void* allocateMemFS(int nBlocks);
 
@@ -0,0 +1,80 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: IOStats.h
+*
+* Description:: Per-subsystem accounting of the LBA layer. Every block
+* transfer that reaches LBAread/LBAwrite is counted under the I/O class
+* of the code that issued it (file data, directory, free space map,
+* tertiary table, VCB, journal) together with its latency. The bytes
+* handed to b_read/b_write are counted too, so the physical blocks
+* written can be compared with what the user wrote (write amplification).
+*
+**************************************************************/
+
+#ifndef _IOSTATS_H
+#define _IOSTATS_H
+
+#include <sys/types.h>
+
+#include "fsLow.h"
+
+#define IO_CLASS_OTHER 0        // I/O issued outside of a tagged subsystem
+#define IO_CLASS_DATA 1         // file content (b_io)
+#define IO_CLASS_DIR 2          // directory entries
+#define IO_CLASS_FREESPACE 3    // free space map and secondary extent tables
+#define IO_CLASS_TERTIARY 4     // tertiary extent table
+#define IO_CLASS_VCB 5          // volume control block
+#define IO_CLASS_JOURNAL 6      // metadata journal region
+#define IO_CLASS_INODE 7        // inode table
+#define IO_CLASS_READAHEAD 8    // blocks read ahead of directories and small files
+#define IO_CLASSES 9
+
+#define IO_OP_READ 0
+#define IO_OP_WRITE 1
+
+/* Counters of one I/O class and one direction (read or write).
+ * - calls: number of LBA calls
+ * - blocks: number of blocks transferred
+ * - nanos / maxNanos: total and worst latency of the calls */
+typedef struct io_counter_st {
+    uint64_t calls;
+    uint64_t blocks;
+    uint64_t nanos;
+    uint64_t maxNanos;
+} io_counter_st;
+
+/* All counters kept since mount (or the last reset)
+ * - classes: physical LBA traffic by class, [class][IO_OP_READ / IO_OP_WRITE]
+ * - userRead / userWritten: bytes returned by b_read and accepted by b_write
+ * - cacheHits / cacheMisses: block lookups served by the block cache or not
+ * - discardCalls / discardBlocks: holes punched in the volume file and their blocks */
+typedef struct io_stats_st {
+    io_counter_st classes[IO_CLASSES][2];
+    uint64_t userRead;
+    uint64_t userWritten;
+    uint64_t cacheHits;
+    uint64_t cacheMisses;
+    uint64_t discardCalls;
+    uint64_t discardBlocks;
+} io_stats_st;
+
+int ioSetClass(int ioClass);
+int ioGetClass();
+
+uint64_t ioClockNanos();
+void ioRecord(int ioClass, int op, uint64_t blocks, uint64_t nanos);
+void ioRecordUser(int op, uint64_t bytes);
+void ioRecordCache(uint64_t hits, uint64_t misses);
+void ioRecordDiscard(uint64_t blocks);
+
+void getIOStats(io_stats_st* out);
+void resetIOStats();
+void printIOStats(uint64_t blockSize);
+
+#endif
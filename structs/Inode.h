@@ -0,0 +1,97 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Inode.h
+*
+* Description:: Inode table. The metadata of every file and directory
+* (times, size, type, link count and extents) lives in one inode of a
+* table on disk, found by its number in a single indexed read; a
+* directory entry only names an inode. The table is made of the blocks
+* listed by the extents kept in the VCB and doubles when it runs out of
+* free inodes. Free inodes are chained from the VCB through next_free.
+* Inodes in use are shared in memory and reference counted: an inode
+* whose last name is removed is released with its last reference.
+*
+**************************************************************/
+
+#ifndef _INODE_H
+#define _INODE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "structs/Extent.h"
+
+#define MAX_EXTENTS 8             // Maximum number of extents of an inode
+#define INODE_NONE 0              // inode 0 is never used, it ends the free list
+#define INODE_TABLE_INITIAL 256   // inodes of a newly formatted table
+#define INODE_TABLE_EXTENTS 16    // extents the table can grow to
+#define INODE_CACHE_BUCKETS 127
+
+/* An inode on disk, 128 bytes (INODE_PER_BLOCK of them in a block)
+ * - times, file_size, ext_length, unwritten_blocks, extents: as they were
+ *   in the directory entry before the table existed
+ * - nlink: names of the inode in directories, 0 while free
+ * - ino: number of the inode, its index in the table
+ * - next_free: next free inode while free, INODE_NONE ends the list */
+typedef struct {
+    time_t creation_time;         // creation time of the file or directory
+    time_t modification_time;     // last modification time
+    time_t access_time;           // last access time
+
+    int file_size;                // size of the file or directory
+    int is_directory;             // 1 if directory, 0 if file
+    int nlink;                    // number of directory entries naming it
+
+    int ext_length;               // number of extents
+    int unwritten_blocks;         // last blocks of the extents reserved by b_fallocate, not written yet
+
+    uint32_t ino;
+    uint32_t next_free;
+    uint32_t reserved[3];
+
+    extent_st extents[MAX_EXTENTS]; // extents of the data blocks
+} inode_st;
+
+#define INODE_PER_BLOCK(blockSize) ((blockSize) / sizeof(inode_st))
+
+/* Location of the inode table, stored in the VCB
+ * - count: inodes in the table, inode 0 included
+ * - free_head: first free inode, INODE_NONE when the table is full
+ * - ext_length / extents: blocks of the table, in inode order */
+typedef struct inode_table_st {
+    unsigned int count;
+    unsigned int free_head;
+    unsigned int ext_length;
+    extent_st extents[INODE_TABLE_EXTENTS];
+} inode_table_st;
+
+/* An inode in memory. The inode comes first: a pointer to it is a pointer
+ * to its node.
+ * - refs: holders that have not put it back yet
+ * - next: next node in the same bucket */
+typedef struct inode_node_st {
+    inode_st inode;
+    int refs;
+    struct inode_node_st* next;
+} inode_node_st;
+
+int formatInodeTable(int nInodes);
+
+inode_st* inodeAlloc(int isDir);
+inode_st* inodeGet(uint32_t ino);
+void inodeHold(inode_st* inode);
+void inodePut(inode_st* inode);
+
+int writeInode(inode_st* inode);
+int inodeTruncate(inode_st* inode);
+
+int inodePeek(uint32_t ino, inode_st* copy);
+int inodeLocate(uint32_t ino, int* offset);
+
+#endif
@@ -0,0 +1,87 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Journal.h
+*
+* Description:: Write-ahead journal for metadata (VCB, free space map,
+* tertiary table and directory blocks). The journal is a contiguous
+* region reserved at format time: a superblock followed by a log of
+* transactions. Metadata changes of many operations wait in the block
+* cache and are committed together as one sequential write (group
+* commit); they only reach their home location once committed. A
+* commit is due after JOURNAL_GROUP_BLOCKS blocks or JOURNAL_COMMIT_INTERVAL
+* seconds; a commit thread takes care of the interval when no metadata
+* is written. The same thread checkpoints the log in the background once
+* it is JOURNAL_CHECKPOINT_PCT full; a commit only checkpoints itself
+* when the log is full. The log is replayed on mount.
+*
+* Transaction layout in the log:
+*   [descriptor: header + LBAs] [data blocks] ... [revoke: header + LBAs]
+*   ... [commit: header]
+* A transaction is valid only when its commit block carries the same
+* sequence number and the checksum of its LBAs and data. A revoke
+* record lists logged blocks that were released since: replay does not
+* write their copies from earlier transactions, as the blocks may hold
+* file data by then.
+*
+**************************************************************/
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include <sys/types.h>
+
+#include "fsLow.h"
+
+#define JOURNAL_MAGIC 0x304C4E524A434141ULL // "AACJRNL0"
+
+#define JOURNAL_BLOCKS 1024         // Size of the journal region at format
+#define JOURNAL_MIN_BLOCKS 16       // Smaller volumes are formatted without journal
+#define JOURNAL_GROUP_BLOCKS 64     // Pending metadata blocks that trigger a commit
+#define JOURNAL_COMMIT_INTERVAL 5   // Max seconds metadata waits for a commit
+#define JOURNAL_CHECKPOINT_PCT 75   // Log usage (%) that triggers a checkpoint
+
+#define JBLOCK_SUPER 1
+#define JBLOCK_DESC 2
+#define JBLOCK_COMMIT 3
+#define JBLOCK_REVOKE 4
+
+/* Journal location, stored in the VCB.
+ * - magic: JOURNAL_MAGIC when the volume has a journal
+ * - startLoc: first block of the region (journal superblock)
+ * - nBlocks: size of the region including the superblock */
+typedef struct journal_st {
+    unsigned long magic;
+    unsigned int startLoc;
+    unsigned int nBlocks;
+} journal_st;
+
+/* Header at the start of every superblock, descriptor, revoke and commit block.
+ * - type: JBLOCK_SUPER, JBLOCK_DESC, JBLOCK_REVOKE or JBLOCK_COMMIT
+ * - count: LBAs listed in a descriptor or revoke / data blocks of a commit
+ * - seq: superblock: first transaction of the log; others: transaction
+ * - checksum: commit only, FNV-1a of the LBAs, data and revokes of the transaction
+ * Descriptor and revoke blocks continue with `count` uint32_t LBAs. */
+typedef struct journal_header_st {
+    uint64_t magic;
+    uint32_t type;
+    uint32_t count;
+    uint64_t seq;
+    uint64_t checksum;
+} journal_header_st;
+
+int formatJournal(int numberOfBlocks);
+int replayJournal();
+int startJournal();
+int exitJournal();
+
+int journalCommit();
+int journalCheckpoint();
+void journalRevoke(int startLoc, int countBlocks);
+
+#endif
@@ -0,0 +1,61 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Readahead.h
+*
+* Description:: Directory readahead. When a directory is opened or
+* becomes the cwd, a background thread reads the inodes of its entries,
+* the first blocks of its subdirectories and small files whole, down to
+* RA_MAX_DEPTH levels and within RA_BUDGET_BLOCKS blocks. The blocks go
+* to the block cache the next time it reads, so the loads that follow
+* are served from memory.
+*
+**************************************************************/
+
+#ifndef _READAHEAD_H
+#define _READAHEAD_H
+
+#include <pthread.h>
+
+#include "structs/VCB.h"
+
+#define RA_MAX_JOBS 8           // directories waiting, the oldest is dropped when full
+#define RA_MAX_CHILDREN 64      // entries read ahead per level
+#define RA_MAX_DEPTH 2          // levels read ahead below the directory opened
+#define RA_DIR_BLOCKS 16        // first blocks read of a directory
+#define RA_FILE_BLOCKS 8        // files up to this size are read whole, larger ones skipped
+#define RA_BUDGET_BLOCKS 64     // blocks read per directory opened
+#define RA_MAX_READY 128        // blocks waiting for the cache, reads stop past it
+
+/* A directory to read ahead
+ * - ino: inode of the directory opened
+ * - count / inos: inodes of its entries */
+typedef struct ra_job_st {
+    uint32_t ino;
+    int count;
+    uint32_t inos[RA_MAX_CHILDREN];
+} ra_job_st;
+
+/* Blocks read ahead, waiting to be installed in the cache
+ * - data / count / lba: count blocks read at lba
+ * - gen: write generation the blocks were read at (see snapshotLBAread)
+ * - next: next read in the ready list */
+typedef struct ra_read_st {
+    char* data;
+    int count;
+    int lba;
+    uint64_t gen;
+    struct ra_read_st* next;
+} ra_read_st;
+
+int initReadahead();
+void exitReadahead();
+
+void readaheadDir(directory_entry* dir);
+
+#endif
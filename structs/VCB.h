@@ -19,6 +19,8 @@
 
 #include "structs/FreeSpace.h"
 #include "structs/DE.h"
+#include "structs/Journal.h"
+#include "structs/Inode.h"
 
 /* Volume Control Block contains both persistent fields (stored on disk) and 
 runtime-only pointers */ 
@@ -30,10 +32,20 @@ typedef struct volume_control_block {
     
     unsigned int total_blocks;  // total number of blocks in the LBA
     unsigned int block_size;    // size of one block in bytes
-    unsigned int root_loc;      // location of block containing the directory
+    unsigned int root_ino;      // inode of the root directory
     unsigned int free_space_loc;// start location of the free space block on disk
 
     freespace_st fs_st;         // fs structure store fields to manage freespace
+    journal_st jn_st;           // location of the metadata journal
+
+    unsigned int fs_engine;     // free space engine chosen at format (FS_ENGINE_*)
+    unsigned int fs_engine_chk; // FS_ENGINE_MAGIC ^ fs_engine, missing on older volumes
+
+    unsigned int fs_groups;     // number of allocation groups (FS_ENGINE_TREE)
+    unsigned int fs_groups_chk; // FS_GROUP_MAGIC ^ fs_groups
+    fs_group_st fs_group[FS_MAX_GROUPS];
+
+    inode_table_st it_st;       // location and free list of the inode table
 
     // Pointers for Runtime-only (NOT WRITTEN TO DISK)
     extent_st* free_space_map;     // pointer to free space map
@@ -0,0 +1,90 @@
+/**************************************************************
+* Class::  CSC-415-03 FALL 2024
+* Name:: Danish Nguyen
+* Student IDs:: 923091933
+* GitHub-Name:: dlikecoding
+* Group-Name:: 0xAACD
+* Project:: Basic File System
+*
+* File:: Walk.h
+*
+* Description:: Parallel tree walk (nftw-like). The walk starts from
+* a path resolved once; below it every directory is a task naming its
+* inode, its depth and its path, so nothing is resolved again. Tasks
+* are spread over a pool of threads: each thread works depth first on
+* its own deque and steals the oldest tasks of the others when it runs
+* dry, which hands out whole subtrees.
+*
+**************************************************************/
+
+#ifndef _WALK_H
+#define _WALK_H
+
+#include <pthread.h>
+
+#include "structs/VCB.h"
+
+#define WALK_MAX_THREADS 16       // threads of a walk, fewer when the host has fewer cores
+#define WALK_DEQUE_INITIAL 64     // tasks a deque holds before it grows
+#define WALK_PATH_MAX 4096        // longest path given to the callback, deeper entries are skipped
+
+/* Called for every entry of the walk, the path walked included (depth 0),
+ * on any thread of the walk and concurrently: it must not modify the volume
+ * and must protect its own state.
+ * - path: the path walked joined with the names below it
+ * - entry: the entry in its loaded parent, valid during the call
+ * - inode: the inode of the entry, valid during the call
+ * @return 0 to go on, any other value stops the walk and is returned by fs_walk */
+typedef int (*fs_walk_fn)(const char* path, const directory_entry* entry, const inode_st* inode,
+                          int depth, void* arg);
+
+/* A directory to walk
+ * - ino / depth / path: the directory, its depth and its path (owned by the task) */
+typedef struct walk_task_st {
+    uint32_t ino;
+    int depth;
+    char* path;
+} walk_task_st;
+
+/* Tasks of one thread. The owner pushes and takes at the bottom (the newest),
+ * thieves take at the top (the oldest, usually the largest subtrees).
+ * - tasks: ring of capacity slots, count tasks from top */
+typedef struct walk_deque_st {
+    walk_task_st* tasks;
+    int top;
+    int count;
+    int capacity;
+    pthread_mutex_t lock;
+} walk_deque_st;
+
+/* State shared by the threads of a walk
+ * - pending: tasks pushed and not finished, the walk ends at 0
+ * - pushes: tasks pushed so far, an idle thread sleeps until it changes
+ * - stop / result: set by the first callback that stops the walk
+ * - failed: 1 if a directory or an inode could not be read */
+typedef struct walk_st {
+    fs_walk_fn fn;
+    void* arg;
+
+    walk_deque_st deques[WALK_MAX_THREADS];
+    int nThreads;
+
+    int pending;
+    unsigned long pushes;
+    int stop;
+    int result;
+    int failed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} walk_st;
+
+// A thread of a walk and the deque it owns
+typedef struct walk_worker_st {
+    walk_st* walk;
+    int id;
+} walk_worker_st;
+
+int fs_walk(const char* pathname, fs_walk_fn fn, void* arg, int nThreads);
+
+#endif
@@ -22,6 +22,7 @@
 int computeBlockNeeded(int m, int n);
 
 int min(int a, int b);
+int max(int a, int b);
 
 void freePtr(void** ptr, const char* type);
 